@@ -2,10 +2,12 @@
 #define __AST_H__
 
 #include "Lexer.h"
+#include "SSA.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/APSInt.h"
 #include "llvm/ADT/APInt.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
@@ -14,8 +16,10 @@
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
+#include "llvm/Support/Allocator.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Host.h"
 #include "llvm/Support/raw_ostream.h"
@@ -23,6 +27,10 @@
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetOptions.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/Transforms/Scalar/GVN.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
@@ -38,247 +46,1201 @@
 #include <memory>
 #include <string>
 #include <vector>
-#ifdef linux    //linux
-#include "KaleidoscopeJIT.h"
-#else //windows
-#include "../include/KaleidoscopeJIT.h"
-#endif
 
 using namespace llvm;
-using namespace llvm::orc;
-
-Function *printFunc;	//printf函数声明
 
 class PrototypeAST;
-Function *getFunction(std::string Name);
-static AllocaInst *CreateEntryBlockAlloca(Function *TheFunction,
-	const std::string &VarName);
 
-	//IR 部分
-	static LLVMContext TheContext;
-	static IRBuilder<> Builder(TheContext);
-	std::unique_ptr<Module> Owner(new Module("test", TheContext));
-	static /*std::unique_ptr<Module>*/Module * TheModule;
+	//语法树内存池:每个编译单元(并行分析时每个线程)一个。
+	//节点及其子节点数组、名字列表和字符串都从这里连续分配,整棵树随内存池一次释放,
+	//因此节点中不能含有需要析构的成员。
+	class ASTContext {
+		BumpPtrAllocator Alloc;
+		size_t NumAllocs = 0;	//若逐个 new 需要的堆分配次数
+		size_t NumBytes = 0;	//请求的字节数
+		size_t HeapBytes = 0;	//逐个分配时估计占用的堆内存(含 malloc 头部和对齐)
+
+		void *allocate(size_t Size, size_t Align) {
+			++NumAllocs;
+			NumBytes += Size;
+			HeapBytes += std::max<size_t>(alignTo(Size + sizeof(size_t), 16), 32);
+			return Alloc.Allocate(Size, Align);
+		}
+
+	public:
+		template <typename T, typename... ArgTs> T *create(ArgTs &&... Args) {
+			return new (allocate(sizeof(T), alignof(T))) T(std::forward<ArgTs>(Args)...);
+		}
+
+		template <typename T> ArrayRef<T> copyArray(ArrayRef<T> Src) {
+			if (Src.empty())
+				return ArrayRef<T>();
+			T *Dst = static_cast<T *>(allocate(Src.size() * sizeof(T), alignof(T)));
+			std::uninitialized_copy(Src.begin(), Src.end(), Dst);
+			return ArrayRef<T>(Dst, Src.size());
+		}
+
+		StringRef copyString(StringRef Src) {
+			if (Src.empty())
+				return StringRef();
+			char *Dst = static_cast<char *>(allocate(Src.size(), 1));
+			memcpy(Dst, Src.data(), Src.size());
+			return StringRef(Dst, Src.size());
+		}
+
+		size_t getNumAllocs() const { return NumAllocs; }
+		size_t getNumBytes() const { return NumBytes; }
+		size_t getHeapBytes() const { return HeapBytes; }
+		size_t getArenaBytes() const { return Alloc.getTotalMemory(); }
+		size_t getNumSlabs() const { return Alloc.GetNumSlabs(); }
+	};
+
+	//统计内存池相对于逐个堆分配节省的分配次数和内存
+	static void PrintASTStats(ArrayRef<std::unique_ptr<ASTContext>> Pools) {
+		size_t Allocs = 0, Bytes = 0, Heap = 0, Arena = 0, Slabs = 0;
+		for (auto &Pool : Pools) {
+			Allocs += Pool->getNumAllocs();
+			Bytes += Pool->getNumBytes();
+			Heap += Pool->getHeapBytes();
+			Arena += Pool->getArenaBytes();
+			Slabs += Pool->getNumSlabs();
+		}
+		fprintf(stderr, "AST: %zu nodes and arrays in %zu arena slabs (%zu heap allocations saved)\n",
+			Allocs, Slabs, Allocs - Slabs);
+		fprintf(stderr, "AST: %zu bytes requested, %zu bytes of arena, ~%zu bytes if heap-allocated (%lld bytes saved)\n",
+			Bytes, Arena, Heap, (long long)Heap - (long long)Arena);
+	}
+
+	//分作用域的变量表:以符号编号为下标直接查找,绑定时把旧值记入撤销日志,
+	//离开作用域时按日志恢复,查找、声明和退出作用域的代价都与作用域中的变量数无关。
+	//值为当前函数中的变量编号,0 表示没有这个变量
+	class ScopedSymbolTable {
+		std::vector<unsigned> Values;	//符号编号 -> 当前可见的变量
+		std::vector<std::pair<unsigned, unsigned>> UndoLog;	//(符号, 被覆盖的旧值)
+		std::vector<size_t> Scopes;	//每个作用域开始时 UndoLog 的长度
+
+	public:
+		unsigned lookup(unsigned Sym) const {
+			return Sym < Values.size() ? Values[Sym] : 0;
+		}
+
+		void bind(unsigned Sym, unsigned V) {
+			if (Sym >= Values.size())
+				Values.resize(std::max<size_t>(Sym + 1, Values.size() * 2));
+			UndoLog.push_back(std::make_pair(Sym, Values[Sym]));
+			Values[Sym] = V;
+		}
+
+		void pushScope() { Scopes.push_back(UndoLog.size()); }
+
+		void popScope() {
+			size_t Mark = Scopes.back();
+			Scopes.pop_back();
+			while (UndoLog.size() > Mark) {
+				Values[UndoLog.back().first] = UndoLog.back().second;
+				UndoLog.pop_back();
+			}
+		}
 
-	static std::map<std::string, AllocaInst *> NamedValues;
+		//开始新的函数:撤销所有绑定
+		void clear() {
+			Scopes.assign(1, 0);
+			popScope();
+		}
 
-	static std::unique_ptr<legacy::FunctionPassManager> TheFPM;
-	static std::unique_ptr<KaleidoscopeJIT> TheJIT;
-	//包含每个元素的最新原型
-	static std::map<std::string, std::unique_ptr<PrototypeAST>> FunctionProtos;
+		size_t getNumBindings() const { return UndoLog.size(); }
+	};
+
+	//代码生成状态:每次编译一份,通过参数传给所有 codegen 函数,
+	//不同编译的 CodeGenContext 之间互不影响,可以在不同线程上同时使用
+	struct CodeGenContext {
+		//IR 部分
+		LLVMContext TheContext;
+		IRBuilder<> Builder;
+		std::unique_ptr<Module> Owner;
+		Module *TheModule;
+
+		//以符号编号为下标的变量表,每个块一个作用域
+		ScopedSymbolTable NamedValues;
+		//当前函数的局部变量,下标为变量编号(从 1 开始):
+		//默认每个变量是入口块中的一个 alloca,UseSSA(-ssa)时由 SSA 直接维护变量的当前值
+		std::vector<AllocaInst *> VarSlots;
+		bool UseSSA = false;
+		SSABuilder SSA;
+		//数组变量(下标为变量编号,标量为空)的首元素地址,以及当前函数中放在堆上、返回前要释放的数组
+		std::vector<Value *> ArrayBases;
+		std::vector<Value *> HeapArrays;
+
+		std::unique_ptr<TargetMachine> TM;	//提供数据布局和优化使用的目标信息
+		std::unique_ptr<legacy::FunctionPassManager> TheFPM;	//每个函数生成后运行
+		std::unique_ptr<legacy::PassManager> TheMPM;	//整个模块生成后运行
+		size_t InstsBeforeOpt = 0;	//优化前的 IR 指令数
+		//包含每个元素的最新原型
+		std::map<unsigned, PrototypeAST *> FunctionProtos;
+		StringMap<Constant *> PrintStrings;	//PRINT 中的文本 -> 模块中的常量字符串,相同的文本只生成一个
+
+		//并行生成代码时各线程共享的只读原型表:符号编号 -> (函数在源文件中的序号, 原型),
+		//CurFunc 为正在生成的函数的序号。只能调用在它之前定义的函数,与串行生成一致
+		const std::vector<std::pair<size_t, PrototypeAST *>> *SharedProtos = nullptr;
+		size_t CurFunc = 0;
+
+		//尾递归(TailRec.h):正在生成的函数的循环头、按顺序的形参变量,
+		//以及累加器变量,函数的返回值为 TailMul * v + TailAdd
+		BasicBlock *TailRecHeader = nullptr;
+		std::vector<unsigned> TailArgs;
+		unsigned TailMul = 0, TailAdd = 0;
+
+		//WHILE 循环的展开和向量化提示,见 CreateLoopMetadata
+		int LoopUnroll = -1, LoopVectorize = -1;
+
+		//记忆化函数的结果缓存项数(2 的幂),见 EmitMemoWrapper
+		unsigned MemoCacheSize = 4096;
+
+		//剖析,见 ProfileCounter:-fprofile-generate 时插入计数器,
+		//-fprofile-use 时 ProfileData 为读入的各函数计数(函数名 -> 计数器的值)
+		bool ProfileGenerate = false;
+		const StringMap<std::vector<uint64_t>> *ProfileData = nullptr;
+		GlobalVariable *ProfCounters = nullptr;	//当前函数计数器数组的占位
+		ArrayRef<uint64_t> ProfCounts;	//当前函数在剖析文件中的计数
+		unsigned NumProfCounters = 0;	//当前函数已分配的计数器
+		std::vector<std::pair<std::string, unsigned>> ProfiledFunctions;	//(计数器数组名, 计数器个数)
+
+		//分层执行(-tier),见 TierCounter:TierThreshold 不为 0 时函数入口和每条回边把计数器加一,
+		//达到阈值时调用 vsl_tier_up 请求生成优化的代码(Tier.h)
+		unsigned TierThreshold = 0;
+		GlobalVariable *TierCount = nullptr;	//当前函数的计数器,不升级的函数为空
+		unsigned TierSym = 0;	//当前函数名的符号编号
+		std::vector<unsigned> TieredFunctions;	//插入了计数器的函数(符号编号)
+
+		StringInterner &Symbols;
+
+		CodeGenContext(StringInterner &Symbols, StringRef ModuleName)
+			: Builder(TheContext), Owner(new Module(ModuleName, TheContext)),
+			TheModule(Owner.get()), SSA(TheContext), Symbols(Symbols) {}
+
+		//本次代码生成报告的错误数,-cache 不缓存有错误的程序
+		unsigned NumErrors = 0;
+
+		StringRef getName(unsigned Sym) const { return Symbols.getName(Sym); }
+		Function *getFunction(unsigned Sym);
+		Value *LogErrorV(const char *Str);
+	};
 
 	//表达式抽象语法树基类
 	class ExprAST {
 	public:
 		virtual ~ExprAST() = default;
-		virtual Value *codegen() = 0;
+		virtual Value *codegen(CodeGenContext &CG) = 0;
 	};
 
 	/*statement部分 -- lh*/
 	//statement 基类
 	class StatAST {
 	public:
+		//节点种类,用于 isa/dyn_cast 以及下标式语法树(FlatAST.h)
+		enum StatKind {
+			SK_Number,
+			SK_Variable,
+			SK_Neg,
+			SK_Binary,
+			SK_Call,
+			SK_Null,
+			SK_Dec,
+			SK_Block,
+			SK_Print,
+			SK_If,
+			SK_Ret,
+			SK_Assign,
+			SK_While,
+			SK_Index,
+			SK_ArrayAssign,
+		};
+
+		//RETURN 语句中对本函数的尾递归调用形式,由 TailRec.h 标记
+		enum TailRecKind {
+			TR_None,
+			TR_Call,	//RETURN f(...)
+			TR_CallLeft,	//RETURN f(...) op e
+			TR_CallRight,	//RETURN e op f(...)
+		};
+
+	private:
+		const StatKind Kind;
+
+	public:
+		StatAST(StatKind Kind) : Kind(Kind) {}
 		virtual ~StatAST() = default;
-		virtual Value* codegen() = 0;
+		virtual Value* codegen(CodeGenContext &CG) = 0;
+
+		StatKind getKind() const { return Kind; }
 	};
 
-	std::unique_ptr<StatAST> LogError(const char *Str);
+	StatAST *LogError(const char *Str);
 
 	//report errors found during code generation
-	Value *LogErrorV(const char *Str) {
+	inline Value *CodeGenContext::LogErrorV(const char *Str) {
+		++NumErrors;
 		LogError(Str);
 		return nullptr;
 	}
 
-	//数字抽象语法树
-	class NumberExprAST : public StatAST {
-		int Val;
+	//函数原型抽象语法树--函数名和参数列表
+	class PrototypeAST {
+		unsigned Sym;
+		ArrayRef<unsigned> Args;
 
 	public:
-		NumberExprAST(int Val) : Val(Val) {}
+		PrototypeAST(unsigned Sym, ArrayRef<unsigned> Args)
+			: Sym(Sym), Args(Args) {}
 
-		Value * codegen() {
-			return ConstantInt::get(TheContext, APInt(32,Val,true));
+		unsigned getSym() const { return Sym; }
+		ArrayRef<unsigned> getArgs() const { return Args; }
+
+		Function * codegen(CodeGenContext &CG) {
+			StringRef Name = CG.getName(Sym);
+			//不允许函数重定义
+			Function *TheFunction = CG.TheModule->getFunction(Name);
+			if (TheFunction)
+				return (Function*)CG.LogErrorV("Function cannot be redefined.");
+
+			// 函数形参类型为 int
+			std::vector<Type*> Integers(Args.size(),
+				Type::getInt32Ty(CG.TheContext));
+			FunctionType *FT =
+				FunctionType::get(Type::getInt32Ty(CG.TheContext), Integers, false);
+
+			// 注册该函数
+			Function *F =
+				Function::Create(FT, Function::ExternalLinkage, Name, CG.TheModule);
+
+			// 为函数参数命名
+			unsigned Idx = 0;
+			for (auto &Arg : F->args())
+				Arg.setName(CG.getName(Args[Idx++]));
+
+			return F;
 		}
 	};
 
-	//变量抽象语法树
-	class VariableExprAST : public StatAST {
-		std::string Name;
+	// CreateEntryBlockAlloca - Create an alloca instruction in the entry block of
+	// the function.  This is used for mutable variables etc.
+	static AllocaInst *CreateEntryBlockAlloca(CodeGenContext &CG, Function *TheFunction,
+		StringRef VarName) {
+		IRBuilder<> TmpB(&TheFunction->getEntryBlock(),
+			TheFunction->getEntryBlock().begin());
+		return TmpB.CreateAlloca(Type::getInt32Ty(CG.TheContext), nullptr,
+			VarName);
+	}
 
-	public:
-		std::string getName() {
-			return Name;
+	//局部变量的读写都经过以下函数:alloca 模式下为栈空间的 load/store,
+	//SSA 模式下记录和查找变量在当前基本块中的值
+
+	//为当前函数新建一个局部变量,返回其编号
+	static unsigned NewVariable(CodeGenContext &CG, StringRef Name) {
+		if (CG.UseSSA)
+			return CG.SSA.newVariable(Name);
+		Function *TheFunction = CG.Builder.GetInsertBlock()->getParent();
+		CG.VarSlots.push_back(CreateEntryBlockAlloca(CG, TheFunction, Name));
+		return CG.VarSlots.size() - 1;
+	}
+
+	static Value *ReadVariable(CodeGenContext &CG, unsigned Var, StringRef Name) {
+		if (CG.UseSSA)
+			return CG.SSA.readVariable(Var, CG.Builder.GetInsertBlock());
+		return CG.Builder.CreateLoad(CG.VarSlots[Var], Name);
+	}
+
+	static void WriteVariable(CodeGenContext &CG, unsigned Var, Value *V) {
+		if (CG.UseSSA)
+			CG.SSA.writeVariable(Var, CG.Builder.GetInsertBlock(), V);
+		else
+			CG.Builder.CreateStore(V, CG.VarSlots[Var]);
+	}
+
+	//数组:VAR a[N] 声明 N 个 i32 的连续空间,不超过 MaxStackArray 个元素的放在栈上
+	//(入口块中的 alloca),更大的在入口块中 malloc、函数返回前 free,避免递归时栈溢出。
+	//存储空间只在入口块中分配一次,每次执行声明时清零,与标量变量一致。
+	//数组不能作为实参、返回值或赋给其他变量,不同数组的空间互不重叠,地址也不会传出函数,
+	//所以别名分析可以确定不同数组之间、数组与其他内存之间都没有别名,循环可以向量化。
+	//下标不做越界检查
+	static const unsigned MaxStackArray = 4096;
+
+	static bool IsArray(CodeGenContext &CG, unsigned Var) {
+		return Var < CG.ArrayBases.size() && CG.ArrayBases[Var];
+	}
+
+	//生成的代码调用的外部函数(C 库和 VSLRuntime.h 中的运行时),第一次使用时在模块中声明
+	static Function *GetExternalFunction(CodeGenContext &CG, StringRef Name, FunctionType *FT) {
+		if (Function *F = CG.TheModule->getFunction(Name))
+			return F;
+		Function *F = Function::Create(FT, Function::ExternalLinkage, Name, CG.TheModule);
+		F->addFnAttr(Attribute::NoUnwind);
+		return F;
+	}
+
+	//malloc/free 的声明,返回值标为 noalias
+	static Function *GetHeapFunction(CodeGenContext &CG, StringRef Name) {
+		Type *I8Ptr = CG.Builder.getInt8PtrTy();
+		if (Name != "malloc")
+			return GetExternalFunction(CG, Name, FunctionType::get(CG.Builder.getVoidTy(), { I8Ptr }, false));
+		Function *F = GetExternalFunction(CG, Name, FunctionType::get(I8Ptr, { CG.Builder.getInt64Ty() }, false));
+		F->addAttribute(AttributeList::ReturnIndex, Attribute::NoAlias);
+		return F;
+	}
+
+	//为当前函数新建一个有 Size 个元素的数组变量,返回其编号
+	static unsigned NewArray(CodeGenContext &CG, StringRef Name, unsigned Size) {
+		unsigned Var;
+		if (CG.UseSSA)
+			Var = CG.SSA.newVariable(Name);
+		else {
+			CG.VarSlots.push_back(nullptr);
+			Var = CG.VarSlots.size() - 1;
+		}
+
+		Function *TheFunction = CG.Builder.GetInsertBlock()->getParent();
+		IRBuilder<> TmpB(&TheFunction->getEntryBlock(), TheFunction->getEntryBlock().begin());
+		Type *I32 = TmpB.getInt32Ty();
+		Value *Base;
+		if (Size <= MaxStackArray) {
+			AllocaInst *A = TmpB.CreateAlloca(ArrayType::get(I32, Size), nullptr, Name);
+			A->setAlignment(16);
+			Base = TmpB.CreateConstInBoundsGEP2_32(A->getAllocatedType(), A, 0, 0, Name);
+		}
+		else {
+			Value *Mem = TmpB.CreateCall(GetHeapFunction(CG, "malloc"),
+				{ TmpB.getInt64(uint64_t(Size) * 4) }, Name);
+			CG.HeapArrays.push_back(Mem);
+			Base = TmpB.CreateBitCast(Mem, I32->getPointerTo(), Name);
+		}
+		if (CG.ArrayBases.size() <= Var)
+			CG.ArrayBases.resize(Var + 1);
+		CG.ArrayBases[Var] = Base;
+		return Var;
+	}
+
+	//在函数的每个 ret 之前释放堆上的数组
+	static void FreeHeapArrays(CodeGenContext &CG, Function *F) {
+		if (CG.HeapArrays.empty())
+			return;
+		Function *Free = GetHeapFunction(CG, "free");
+		for (BasicBlock &BB : *F)
+			if (auto *Ret = dyn_cast<ReturnInst>(BB.getTerminator()))
+				for (Value *Mem : CG.HeapArrays)
+					CallInst::Create(Free, { Mem }, "", Ret);
+		CG.HeapArrays.clear();
+	}
+
+	//BB 的前驱已经全部生成,SSA 模式下补全其中的 phi
+	static void SealBlock(CodeGenContext &CG, BasicBlock *BB) {
+		if (CG.UseSSA)
+			CG.SSA.sealBlock(BB);
+	}
+
+	//剖析:每个函数有一个 i64 计数器数组 <函数名>.prof,按生成的顺序为
+	//函数入口、每个 IF 的条件(执行次数, 为真次数)、每个 WHILE 的条件(求值次数, 进入循环体次数)。
+	//-fprofile-generate 时在当前位置插入计数器加一的代码,-fprofile-use 时返回剖析文件中对应的计数。
+	//数组大小在函数生成完后才知道,生成期间先使用一个占位的全局变量,见 FinishProfile
+	static uint64_t ProfileCounter(CodeGenContext &CG) {
+		unsigned Idx = CG.NumProfCounters++;
+		if (CG.ProfileGenerate) {
+			IRBuilder<> &B = CG.Builder;
+			Constant *Idxs[] = { B.getInt32(0), B.getInt32(Idx) };
+			Constant *Ptr = ConstantExpr::getInBoundsGetElementPtr(CG.ProfCounters->getValueType(),
+				CG.ProfCounters, Idxs);
+			B.CreateStore(B.CreateAdd(B.CreateLoad(B.getInt64Ty(), Ptr), B.getInt64(1)), Ptr);
 		}
+		return Idx < CG.ProfCounts.size() ? CG.ProfCounts[Idx] : 0;
+	}
 
-		VariableExprAST(const std::string &Name) : Name(Name) {}
+	//按剖析的计数给条件跳转加上分支权重,Taken 为跳到第一个后继的次数
+	static void SetBranchWeights(CodeGenContext &CG, BranchInst *Br, uint64_t Taken, uint64_t Total) {
+		if (!CG.ProfileData || Total == 0 || Taken > Total)
+			return;
+		//权重是 32 位的,计数太大时按比例缩小
+		uint64_t Scale = Total / UINT32_MAX + 1;
+		Br->setMetadata(LLVMContext::MD_prof, MDBuilder(CG.TheContext).createBranchWeights(
+			(uint32_t)(Taken / Scale), (uint32_t)((Total - Taken) / Scale)));
+	}
 
-		Value * codegen() {
-			// Look this variable up in the function.
-			Value *V = NamedValues[Name];
-			if (!V)
-				return LogErrorV("Unknown variable name");
-			return Builder.CreateLoad(V, Name.c_str());
+	static void StartProfile(CodeGenContext &CG, StringRef FuncName) {
+		CG.NumProfCounters = 0;
+		CG.ProfCounts = ArrayRef<uint64_t>();
+		if (CG.ProfileGenerate)
+			CG.ProfCounters = new GlobalVariable(*CG.TheModule, ArrayType::get(CG.Builder.getInt64Ty(), 0),
+				false, GlobalValue::ExternalLinkage, nullptr, "prof.placeholder");
+		if (CG.ProfileData) {
+			auto It = CG.ProfileData->find(FuncName);
+			if (It != CG.ProfileData->end())
+				CG.ProfCounts = It->second;
 		}
-	};
+	}
 
-	class NegExprAST : public StatAST {
-		std::unique_ptr<StatAST> EXP;
+	//函数生成完后:-fprofile-generate 时建立真正的计数器数组,
+	//-fprofile-use 时设置入口计数;计数器个数与剖析文件不符(程序或编译选项改变了)时不使用剖析。
+	//特化的副本(Local)本来就是为了内联和化简,只调用一两次也不应按冷函数处理,不设入口计数
+	static void FinishProfile(CodeGenContext &CG, Function *F, StringRef FuncName, bool Local) {
+		if (CG.ProfileGenerate) {
+			ArrayType *Ty = ArrayType::get(CG.Builder.getInt64Ty(), CG.NumProfCounters);
+			auto *Counters = new GlobalVariable(*CG.TheModule, Ty, false, GlobalValue::ExternalLinkage,
+				ConstantAggregateZero::get(Ty), FuncName + ".prof");
+			CG.ProfCounters->replaceAllUsesWith(ConstantExpr::getBitCast(Counters, CG.ProfCounters->getType()));
+			CG.ProfCounters->eraseFromParent();
+			CG.ProfCounters = nullptr;
+			CG.ProfiledFunctions.push_back(std::make_pair(Counters->getName().str(), CG.NumProfCounters));
+		}
+		if (CG.ProfCounts.empty())
+			return;
+		if (CG.ProfCounts.size() != CG.NumProfCounters) {
+			errs() << "warning: profile for " << FuncName << " does not match, ignored\n";
+			for (BasicBlock &BB : *F)
+				if (auto *Br = dyn_cast<BranchInst>(BB.getTerminator()))
+					Br->setMetadata(LLVMContext::MD_prof, nullptr);
+			return;
+		}
+		if (!Local)
+			F->setEntryCount(CG.ProfCounts[0]);
+	}
 
-		public:
-			NegExprAST(std::unique_ptr<StatAST> EXP)
-				: EXP(std::move(EXP)) {
-			}
+	//分层执行:当前函数的计数器加一,恰好达到阈值时调用 vsl_tier_up(管理器, 函数名的符号编号)。
+	//管理器是 JIT 中定义的外部符号 vsl.tier.manager,生成的代码中没有宿主进程的地址
+	static void TierCounter(CodeGenContext &CG) {
+		if (!CG.TierCount)
+			return;
+		IRBuilder<> &B = CG.Builder;
+		Value *N = B.CreateAdd(B.CreateLoad(B.getInt32Ty(), CG.TierCount), B.getInt32(1), "tier.count");
+		B.CreateStore(N, CG.TierCount);
+		Function *TheFunction = B.GetInsertBlock()->getParent();
+		BasicBlock *HotBB = BasicBlock::Create(CG.TheContext, "tier.hot", TheFunction);
+		BasicBlock *ContBB = BasicBlock::Create(CG.TheContext, "tier.cont", TheFunction);
+		B.CreateCondBr(B.CreateICmpEQ(N, B.getInt32(CG.TierThreshold)), HotBB, ContBB);
+		SealBlock(CG, HotBB);
+
+		B.SetInsertPoint(HotBB);
+		Type *I8 = B.getInt8Ty();
+		GlobalVariable *Manager = CG.TheModule->getNamedGlobal("vsl.tier.manager");
+		if (!Manager)
+			Manager = new GlobalVariable(*CG.TheModule, I8, false, GlobalValue::ExternalLinkage,
+				nullptr, "vsl.tier.manager");
+		Function *TierUp = GetExternalFunction(CG, "vsl_tier_up",
+			FunctionType::get(B.getVoidTy(), { I8->getPointerTo(), B.getInt32Ty() }, false));
+		B.CreateCall(TierUp, { Manager, B.getInt32(CG.TierSym) });
+		B.CreateBr(ContBB);
+		SealBlock(CG, ContBB);
+		B.SetInsertPoint(ContBB);
+	}
 
-			Value * codegen() {
-				auto Value = EXP->codegen();
-				if (!Value)
-					return nullptr;
+	//以下 Emit* 函数是两种语法树表示(指针树和 FlatAST)共用的 IR 生成部分,
+	//子节点的代码由调用者通过回调生成。返回 nullptr 表示出错。
+
+	static Value *EmitVariable(CodeGenContext &CG, unsigned Sym) {
+		// Look this variable up in the function.
+		unsigned Var = CG.NamedValues.lookup(Sym);
+		if (!Var)
+			return CG.LogErrorV("Unknown variable name");
+		if (IsArray(CG, Var))
+			return CG.LogErrorV("Array used without subscript");
+		return ReadVariable(CG, Var, CG.getName(Sym));
+	}
+
+	//数组元素 Sym[Idx] 的地址
+	static Value *EmitElementPtr(CodeGenContext &CG, unsigned Sym, Value *Idx) {
+		unsigned Var = CG.NamedValues.lookup(Sym);
+		if (!Var)
+			return CG.LogErrorV("Unknown variable name");
+		if (!IsArray(CG, Var))
+			return CG.LogErrorV("Subscripted variable is not an array");
+		return CG.Builder.CreateInBoundsGEP(CG.Builder.getInt32Ty(), CG.ArrayBases[Var], Idx,
+			CG.getName(Sym));
+	}
+
+	static Value *EmitIndex(CodeGenContext &CG, unsigned Sym, Value *Idx) {
+		Value *Ptr = EmitElementPtr(CG, Sym, Idx);
+		if (!Ptr)
+			return nullptr;
+		return CG.Builder.CreateLoad(Ptr, "elem");
+	}
+
+	static Value *EmitArrayAssign(CodeGenContext &CG, unsigned Sym, Value *Idx, Value *EValue) {
+		Value *Ptr = EmitElementPtr(CG, Sym, Idx);
+		if (!Ptr)
+			return nullptr;
+		CG.Builder.CreateStore(EValue, Ptr);
+		return EValue;
+	}
 
-				return Builder.CreateNeg(Value);
+	//'+','-','*','/'
+	static Value *EmitBinary(CodeGenContext &CG, char Op, Value *L, Value *R) {
+		switch (Op) {
+		case '+':
+			return CG.Builder.CreateAdd(L, R, "addtmp");
+		case '-':
+			return CG.Builder.CreateSub(L, R, "subtmp");
+		case '*':
+			return CG.Builder.CreateMul(L, R, "multmp");
+		case '/':
+			return CG.Builder.CreateSDiv(L, R, "divtmp");
+		default:
+			return CG.LogErrorV("invalid binary operator");
+		}
+	}
+
+	static Value *EmitCall(CodeGenContext &CG, unsigned Callee, unsigned NumArgs,
+		function_ref<Value *(unsigned)> GenArg) {
+		// Look up the name in the global module table.
+		Function *CalleeF = CG.getFunction(Callee);
+		if (!CalleeF)
+			return CG.LogErrorV("Unknown function referenced");
+
+		// If argument mismatch error.
+		if (CalleeF->arg_size() != NumArgs)
+			return CG.LogErrorV("Incorrect # arguments passed");
+
+		std::vector<Value *> ArgsV;
+		for (unsigned i = 0; i != NumArgs; ++i) {
+			ArgsV.push_back(GenArg(i));
+			if (!ArgsV.back())
+				return nullptr;
+		}
+
+		return CG.Builder.CreateCall(CalleeF, ArgsV, "calltmp");
+	}
+
+	//变量声明:新建变量并初始化为 0。Sizes 为空时都是标量,否则与 VarNames 一一对应,
+	//0 表示标量,其余为数组的元素个数
+	static void EmitDec(CodeGenContext &CG, ArrayRef<unsigned> VarNames, ArrayRef<unsigned> Sizes) {
+		for (unsigned i = 0; i < VarNames.size(); i++) {
+			unsigned VarName = VarNames[i];
+			unsigned Size = Sizes.empty() ? 0 : Sizes[i];
+			unsigned Var;
+			if (Size) {
+				Var = NewArray(CG, CG.getName(VarName), Size);
+				CG.Builder.CreateMemSet(CG.ArrayBases[Var], CG.Builder.getInt8(0), uint64_t(Size) * 4, 16);
 			}
-	};
+			else {
+				Value *InitVal = ConstantInt::get(CG.TheContext, APInt(32,0));
 
-	//'+','-','*','/'二元运算表达式抽象语法树
-	class BinaryExprAST : public StatAST {
-		char Op;
-		std::unique_ptr<StatAST> LHS, RHS;
+				Var = NewVariable(CG, CG.getName(VarName));
+				WriteVariable(CG, Var, InitVal);
+			}
 
-	public:
-		BinaryExprAST(char Op, std::unique_ptr<StatAST> LHS,
-			std::unique_ptr<StatAST> RHS)
-			: Op(Op), LHS(std::move(LHS)), RHS(std::move(RHS)) {}
+			CG.NamedValues.bind(VarName, Var);
+		}
+	}
 
+	//PRINT 中的文本在模块中的常量,不带结尾的 '\0'
+	static Constant *GetPrintString(CodeGenContext &CG, StringRef Text) {
+		Constant *&Str = CG.PrintStrings[Text];
+		if (!Str) {
+			Constant *Init = ConstantDataArray::getString(CG.TheContext, Text, false);
+			auto *GV = new GlobalVariable(*CG.TheModule, Init->getType(), true,
+				GlobalValue::PrivateLinkage, Init, "str");
+			GV->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+			GV->setAlignment(1);
+			Str = ConstantExpr::getBitCast(GV, CG.Builder.getInt8PtrTy());
+		}
+		return Str;
+	}
 
-		Value * codegen() {
+	//PRINT:Texts[i] 是第 i 个表达式之前的文本,Texts 比表达式多一个。
+	//先求出所有表达式的值(其中调用的函数可能也有 PRINT),再按顺序对每段非空文本调用
+	//vsl_print_str、对每个值调用 vsl_print_int,输出与原来的一次 printf 相同
+	static Value *EmitPrint(CodeGenContext &CG, ArrayRef<StringRef> Texts, unsigned NumExprs,
+		function_ref<Value *(unsigned)> GenExpr) {
+		std::vector<llvm::Value *> Vals;
+		for (unsigned i = 0; i < NumExprs; i++) {
+			Vals.push_back(GenExpr(i));
+			if (!Vals.back())
+				return nullptr;
+		}
 
-			Value *L = LHS->codegen();
-			Value *R = RHS->codegen();
-			if (!L || !R)
+		IRBuilder<> &B = CG.Builder;
+		Function *PrintStr = GetExternalFunction(CG, "vsl_print_str",
+			FunctionType::get(B.getVoidTy(), { B.getInt8PtrTy(), B.getInt32Ty() }, false));
+		Function *PrintInt = GetExternalFunction(CG, "vsl_print_int",
+			FunctionType::get(B.getVoidTy(), { B.getInt32Ty() }, false));
+		for (unsigned i = 0; i <= NumExprs; i++) {
+			if (!Texts[i].empty())
+				B.CreateCall(PrintStr, { GetPrintString(CG, Texts[i]), B.getInt32(Texts[i].size()) });
+			if (i < NumExprs)
+				B.CreateCall(PrintInt, { Vals[i] });
+		}
+
+		return CG.Builder.getInt32(0);//print always return 0
+	}
+
+	//没有 ELSE 分支时 GenElse 为空
+	static Value *EmitIf(CodeGenContext &CG, function_ref<Value *()> GenCond, function_ref<Value *()> GenThen,
+		function_ref<Value *()> GenElse, bool HasElse) {
+		Value *CondV = GenCond();
+		if (!CondV)
+			return nullptr;
+
+		// Convert condition to a bool by comparing non-equal to 0.0.
+		CondV = CG.Builder.CreateICmpNE(
+			CondV, CG.Builder.getInt32(0), "ifcond");
+		uint64_t Total = ProfileCounter(CG);
+
+		Function *TheFunction = CG.Builder.GetInsertBlock()->getParent();
+
+		// Create blocks for the then and else cases.  Insert the 'then' block at the
+		// end of the function.
+		BasicBlock *ThenBB = BasicBlock::Create(CG.TheContext, "then", TheFunction);
+		BasicBlock *MergeBB = BasicBlock::Create(CG.TheContext, "ifcont");
+		BasicBlock *ElseBB = nullptr;
+		BranchInst *Br;
+		if (HasElse) {
+			ElseBB = BasicBlock::Create(CG.TheContext, "else");
+			Br = CG.Builder.CreateCondBr(CondV, ThenBB, ElseBB);
+		}
+		else {
+			Br = CG.Builder.CreateCondBr(CondV, ThenBB, MergeBB);
+		}
+
+		// Emit then value.
+		SealBlock(CG, ThenBB);
+		CG.Builder.SetInsertPoint(ThenBB);
+		SetBranchWeights(CG, Br, ProfileCounter(CG), Total);
+
+		Value *ThenV = GenThen();
+		if (!ThenV)
+			return nullptr;
+
+		CG.Builder.CreateBr(MergeBB);
+
+		// Emit else block.
+		if (HasElse) {
+			TheFunction->getBasicBlockList().push_back(ElseBB);
+			SealBlock(CG, ElseBB);
+			CG.Builder.SetInsertPoint(ElseBB);
+
+			Value *ElseV = GenElse();
+			if (!ElseV)
+				return nullptr;
+			CG.Builder.CreateBr(MergeBB);
+		}
+
+		// Emit merge block.
+		TheFunction->getBasicBlockList().push_back(MergeBB);
+		SealBlock(CG, MergeBB);
+		CG.Builder.SetInsertPoint(MergeBB);
+
+		return CG.Builder.getInt32(0); //if always return 0
+	}
+
+	//WHILE 循环的 llvm.loop 元数据:第一个操作数指向自身,其后是展开和向量化的提示。
+	//LoopUnroll/LoopVectorize 为 -1 时不加提示,0 时禁止,1 时启用,更大的数为展开次数/向量宽度
+	static MDNode *CreateLoopMetadata(CodeGenContext &CG) {
+		LLVMContext &C = CG.TheContext;
+		auto Hint = [&](const char *Name, Metadata *Val) -> Metadata * {
+			SmallVector<Metadata *, 2> Ops;
+			Ops.push_back(MDString::get(C, Name));
+			if (Val)
+				Ops.push_back(Val);
+			return MDNode::get(C, Ops);
+		};
+		auto Int = [&](Type *Ty, int V) {
+			return ConstantAsMetadata::get(ConstantInt::get(Ty, V));
+		};
+
+		SmallVector<Metadata *, 4> Ops;
+		Ops.push_back(nullptr);
+		if (CG.LoopUnroll == 0)
+			Ops.push_back(Hint("llvm.loop.unroll.disable", nullptr));
+		else if (CG.LoopUnroll == 1)
+			Ops.push_back(Hint("llvm.loop.unroll.enable", nullptr));
+		else if (CG.LoopUnroll > 1)
+			Ops.push_back(Hint("llvm.loop.unroll.count", Int(CG.Builder.getInt32Ty(), CG.LoopUnroll)));
+		if (CG.LoopVectorize >= 0)
+			Ops.push_back(Hint("llvm.loop.vectorize.enable",
+				Int(CG.Builder.getInt1Ty(), CG.LoopVectorize != 0)));
+		if (CG.LoopVectorize > 1)
+			Ops.push_back(Hint("llvm.loop.vectorize.width", Int(CG.Builder.getInt32Ty(), CG.LoopVectorize)));
+
+		MDNode *Loop = MDNode::getDistinct(C, Ops);
+		Loop->replaceOperandWith(0, Loop);
+		return Loop;
+	}
+
+	//循环头(条件)、循环体、回边所在的锁存块、出口各一个基本块,条件只生成一次,
+	//进入循环的块和出口都只与循环头相连,LoopSimplify 不需要再做调整。
+	//SSA 模式下循环头要等回边生成后才能封闭
+	static Value *EmitWhile(CodeGenContext &CG, function_ref<Value *()> GenCond, function_ref<Value *()> GenBody) {
+		Function *TheFunction = CG.Builder.GetInsertBlock()->getParent();
+		BasicBlock *CondBB = BasicBlock::Create(CG.TheContext, "loopCond", TheFunction);
+		BasicBlock *LoopBB = BasicBlock::Create(CG.TheContext, "loop");
+		BasicBlock *LatchBB = BasicBlock::Create(CG.TheContext, "loopLatch");
+		BasicBlock *AfterBB = BasicBlock::Create(CG.TheContext, "afterLoop");
+
+		CG.Builder.CreateBr(CondBB);
+		CG.Builder.SetInsertPoint(CondBB);
+		Value *EndCond = GenCond();
+		if(!EndCond)
+			return nullptr;
+		EndCond = CG.Builder.CreateICmpNE(EndCond, CG.Builder.getInt32(0), "loopCond");
+		uint64_t Total = ProfileCounter(CG);
+		BranchInst *Br = CG.Builder.CreateCondBr(EndCond, LoopBB, AfterBB);
+
+		TheFunction->getBasicBlockList().push_back(LoopBB);
+		SealBlock(CG, LoopBB);
+		CG.Builder.SetInsertPoint(LoopBB);
+		SetBranchWeights(CG, Br, ProfileCounter(CG), Total);
+		Value *inLoopVal = GenBody();
+		if(!inLoopVal)
+			return nullptr;
+		CG.Builder.CreateBr(LatchBB);
+
+		TheFunction->getBasicBlockList().push_back(LatchBB);
+		SealBlock(CG, LatchBB);
+		CG.Builder.SetInsertPoint(LatchBB);
+		TierCounter(CG);
+		CG.Builder.CreateBr(CondBB)->setMetadata(LLVMContext::MD_loop, CreateLoopMetadata(CG));
+		SealBlock(CG, CondBB);
+
+		TheFunction->getBasicBlockList().push_back(AfterBB);
+		SealBlock(CG, AfterBB);
+		CG.Builder.SetInsertPoint(AfterBB);
+
+		return CG.Builder.getInt32(0);
+	}
+
+	//尾递归的函数中,返回值要按累加器调整为 TailMul * V + TailAdd
+	static Value *AdjustReturnValue(CodeGenContext &CG, Value *V) {
+		if (!CG.TailRecHeader)
+			return V;
+		Value *Mul = ReadVariable(CG, CG.TailMul, "tailrec.mul");
+		Value *Add = ReadVariable(CG, CG.TailAdd, "tailrec.add");
+		return CG.Builder.CreateAdd(CG.Builder.CreateMul(Mul, V), Add, "tailrec.ret");
+	}
+
+	static Value *EmitRet(CodeGenContext &CG, Value *RetVal) {
+		Function *TheFunction = CG.Builder.GetInsertBlock()->getParent();
+		CG.Builder.CreateRet(AdjustReturnValue(CG, RetVal));
+		BasicBlock *afterRet = BasicBlock::Create(CG.TheContext, "afterReturn", TheFunction);
+		SealBlock(CG, afterRet);
+		CG.Builder.SetInsertPoint(afterRet);
+
+		return RetVal;
+	}
+
+	static Value *EmitAssign(CodeGenContext &CG, unsigned Sym, Value *EValue) {
+		unsigned Var = CG.NamedValues.lookup(Sym);
+		if (!Var)
+			return CG.LogErrorV("Unknown variable name");
+		if (IsArray(CG, Var))
+			return CG.LogErrorV("Array used without subscript");
+
+		WriteVariable(CG, Var, EValue);
+
+		return EValue;
+	}
+
+	//RETURN 中对本函数的尾递归调用:更新累加器和形参后跳回循环头。
+	//Kind 为 TR_Call 时没有另一个操作数 e,GenOperand 为空;
+	//TR_CallLeft 时 e 在实参之后求值,TailRec.h 保证此时 e 中没有函数调用
+	static Value *EmitTailRec(CodeGenContext &CG, StatAST::TailRecKind Kind, char Op,
+		function_ref<Value *()> GenOperand, unsigned NumArgs, function_ref<Value *(unsigned)> GenArg) {
+		if (CG.TailArgs.size() != NumArgs)
+			return CG.LogErrorV("Incorrect # arguments passed");
+
+		Value *E = nullptr;
+		if (Kind == StatAST::TR_CallRight && !(E = GenOperand()))
+			return nullptr;
+		std::vector<Value *> ArgsV;
+		for (unsigned i = 0; i != NumArgs; ++i) {
+			ArgsV.push_back(GenArg(i));
+			if (!ArgsV.back())
 				return nullptr;
+		}
+		if (Kind == StatAST::TR_CallLeft && !(E = GenOperand()))
+			return nullptr;
 
+		//返回值 Mul * (e op r) + Add 仍写成 Mul' * r + Add' 的形式,r 为递归调用的结果
+		if (E) {
+			Value *Mul = ReadVariable(CG, CG.TailMul, "tailrec.mul");
+			Value *Add = ReadVariable(CG, CG.TailAdd, "tailrec.add");
 			switch (Op) {
 			case '+':
-				return Builder.CreateAdd(L, R, "addtmp");
+				Add = CG.Builder.CreateAdd(Add, CG.Builder.CreateMul(Mul, E));
+				break;
 			case '-':
-				return Builder.CreateSub(L, R, "subtmp");
+				if (Kind == StatAST::TR_CallLeft)
+					Add = CG.Builder.CreateSub(Add, CG.Builder.CreateMul(Mul, E));
+				else {
+					Add = CG.Builder.CreateAdd(Add, CG.Builder.CreateMul(Mul, E));
+					Mul = CG.Builder.CreateNeg(Mul);
+				}
+				break;
 			case '*':
-				return Builder.CreateMul(L, R, "multmp");
-			case '/':
-				L = Builder.CreateExactSDiv(L, R, "divtmp");
-				// Convert bool 0/1 to int 0 or 1
-				return Builder.CreateUIToFP(L, Type::getInt32Ty(TheContext), "booltmp");
+				Mul = CG.Builder.CreateMul(Mul, E);
+				break;
 			default:
-				return LogErrorV("invalid binary operator");
+				return CG.LogErrorV("invalid binary operator");
 			}
+			WriteVariable(CG, CG.TailMul, Mul);
+			WriteVariable(CG, CG.TailAdd, Add);
 		}
-	};
 
-	//函数原型抽象语法树--函数名和参数列表
-	class PrototypeAST {
-		std::string Name;
-		std::vector<std::string> Args;
+		for (unsigned i = 0; i != NumArgs; ++i)
+			WriteVariable(CG, CG.TailArgs[i], ArgsV[i]);
+		TierCounter(CG);
+		CG.Builder.CreateBr(CG.TailRecHeader);
 
-	public:
-		PrototypeAST(const std::string &Name, std::vector<std::string> Args)
-			: Name(Name), Args(std::move(Args)) {}
+		Function *TheFunction = CG.Builder.GetInsertBlock()->getParent();
+		BasicBlock *afterRet = BasicBlock::Create(CG.TheContext, "afterTailCall", TheFunction);
+		SealBlock(CG, afterRet);
+		CG.Builder.SetInsertPoint(afterRet);
 
-		const std::string &getName() const { return Name; }
+		return CG.Builder.getInt32(0);
+	}
 
-		Function * codegen() {
-			//不允许函数重定义
-			Function *TheFunction = TheModule->getFunction(Name);
-			if (TheFunction)
-				return (Function*)LogErrorV("Function cannot be redefined.");
+	static size_t CountInstructions(const Function &F) {
+		size_t N = 0;
+		for (const BasicBlock &BB : F)
+			N += BB.size();
+		return N;
+	}
 
-			// 函数形参类型为 int
-			std::vector<Type*> Integers(Args.size(),
-				Type::getInt32Ty(TheContext));
-			FunctionType *FT =
-				FunctionType::get(Type::getInt32Ty(TheContext), Integers, false);
+	static size_t CountInstructions(const Module &M) {
+		size_t N = 0;
+		for (const Function &F : M)
+			N += CountInstructions(F);
+		return N;
+	}
 
-			// 注册该函数
-			Function *F =
-				Function::Create(FT, Function::ExternalLinkage, Name, TheModule);
+	//模块中定义(非声明)的函数数
+	static size_t CountFunctions(const Module &M) {
+		size_t N = 0;
+		for (const Function &F : M)
+			N += !F.isDeclaration();
+		return N;
+	}
 
-			// 为函数参数命名
-			unsigned Idx = 0;
+	//记忆化(Memoize.h)的函数 F:函数体生成在内部函数 Body 中,F 先在开放定址的缓存中
+	//查找实参,命中时直接返回缓存的结果,否则调用 Body 并记录结果。
+	//函数体中的递归调用仍然调用 F,所以同样经过缓存。
+	//缓存是 MemoCacheSize 项的全局数组,每项为 [有效标志, 实参..., 结果],从实参的散列值
+	//开始至多探测 MemoProbes 项,都不匹配时写入遇到的第一个空项,没有空项则覆盖第一项,
+	//所以占用的内存是固定的。命中和未命中次数记在全局变量 <F>.memo.hits/<F>.memo.misses 中
+	static const unsigned MemoProbes = 4;
+
+	static void EmitMemoWrapper(CodeGenContext &CG, Function *F, Function *Body) {
+		IRBuilder<> &B = CG.Builder;
+		unsigned NumArgs = F->arg_size();
+		Type *I32 = B.getInt32Ty(), *I64 = B.getInt64Ty();
+		ArrayType *CacheTy = ArrayType::get(ArrayType::get(I32, NumArgs + 2), CG.MemoCacheSize);
+		auto *Cache = new GlobalVariable(*CG.TheModule, CacheTy, false, GlobalValue::InternalLinkage,
+			ConstantAggregateZero::get(CacheTy), F->getName() + ".memo.cache");
+		//计数器不是内部符号,运行后可以按名字读取
+		auto *Hits = new GlobalVariable(*CG.TheModule, I64, false, GlobalValue::ExternalLinkage,
+			B.getInt64(0), F->getName() + ".memo.hits");
+		auto *Misses = new GlobalVariable(*CG.TheModule, I64, false, GlobalValue::ExternalLinkage,
+			B.getInt64(0), F->getName() + ".memo.misses");
+		auto Field = [&](Value *Slot, unsigned I) {
+			Value *Idx[] = { B.getInt32(0), Slot, B.getInt32(I) };
+			return B.CreateInBoundsGEP(CacheTy, Cache, Idx);
+		};
+		auto Increment = [&](GlobalVariable *Counter) {
+			B.CreateStore(B.CreateAdd(B.CreateLoad(I64, Counter), B.getInt64(1)), Counter);
+		};
+
+		B.SetInsertPoint(BasicBlock::Create(CG.TheContext, "entry", F));
+		Value *Hash = B.getInt32(0);
+		for (auto &Arg : F->args())
+			Hash = B.CreateMul(B.CreateXor(Hash, &Arg), B.getInt32(0x9E3779B1));
+		Hash = B.CreateXor(Hash, B.CreateLShr(Hash, 16));
+		Value *Home = B.CreateAnd(Hash, CG.MemoCacheSize - 1, "memo.home");
+
+		BasicBlock *HitBB = BasicBlock::Create(CG.TheContext, "memo.hit");
+		BasicBlock *MissBB = BasicBlock::Create(CG.TheContext, "memo.miss");
+		PHINode *HitSlot = PHINode::Create(I32, MemoProbes, "memo.slot", HitBB);
+		PHINode *MissSlot = PHINode::Create(I32, MemoProbes + 1, "memo.slot", MissBB);
+		for (unsigned P = 0; P < MemoProbes; P++) {
+			Value *Slot = Home;
+			if (P)
+				Slot = B.CreateAnd(B.CreateAdd(Home, B.getInt32(P)), CG.MemoCacheSize - 1);
+			Value *Valid = B.CreateLoad(I32, Field(Slot, 0), "memo.valid");
+			BasicBlock *CmpBB = BasicBlock::Create(CG.TheContext, "memo.cmp", F);
+			MissSlot->addIncoming(Slot, B.GetInsertBlock());
+			B.CreateCondBr(B.CreateICmpEQ(Valid, B.getInt32(0)), MissBB, CmpBB);
+
+			B.SetInsertPoint(CmpBB);
+			Value *Match = B.getTrue();
+			unsigned I = 1;
 			for (auto &Arg : F->args())
-				Arg.setName(Args[Idx++]);
+				Match = B.CreateAnd(Match, B.CreateICmpEQ(B.CreateLoad(I32, Field(Slot, I++)), &Arg));
+			HitSlot->addIncoming(Slot, CmpBB);
+			if (P + 1 == MemoProbes) {
+				MissSlot->addIncoming(Home, CmpBB);
+				B.CreateCondBr(Match, HitBB, MissBB);
+				break;
+			}
+			BasicBlock *NextBB = BasicBlock::Create(CG.TheContext, "memo.probe", F);
+			B.CreateCondBr(Match, HitBB, NextBB);
+			B.SetInsertPoint(NextBB);
+		}
 
-			return F;
+		F->getBasicBlockList().push_back(HitBB);
+		B.SetInsertPoint(HitBB);
+		Increment(Hits);
+		B.CreateRet(B.CreateLoad(I32, Field(HitSlot, NumArgs + 1), "memo.result"));
+
+		//结果在调用返回后才写入,递归调用期间缓存中不会出现不完整的项
+		F->getBasicBlockList().push_back(MissBB);
+		B.SetInsertPoint(MissBB);
+		Increment(Misses);
+		std::vector<Value *> Args;
+		for (auto &Arg : F->args())
+			Args.push_back(&Arg);
+		Value *Result = B.CreateCall(Body, Args, "memo.result");
+		B.CreateStore(B.getInt32(1), Field(MissSlot, 0));
+		for (unsigned I = 0; I < NumArgs; I++)
+			B.CreateStore(Args[I], Field(MissSlot, I + 1));
+		B.CreateStore(Result, Field(MissSlot, NumArgs + 1));
+		B.CreateRet(Result);
+	}
+
+	//生成后统计指令数并运行函数级优化
+	static void FinishFunction(CodeGenContext &CG, Function *F) {
+		CG.InstsBeforeOpt += CountInstructions(*F);
+
+		//只优化正确的函数,出错的函数可能含有没有终结指令的基本块
+		if (!verifyFunction(*F) && CG.TheFPM)
+			CG.TheFPM->run(*F);
+	}
+
+	//TailRec 表示函数中有已标记的尾递归调用,此时函数体放在循环中;
+	//Memoize 表示函数体生成在内部函数 <name>.body 中,函数本身是带缓存的包装;
+	//Local 表示函数只在编译器内部使用(如特化的副本),串行生成时设为内部链接,
+	//全部调用被内联后可以删去。
+	//分层执行时 main 以外、没有记忆化的函数都插入计数器,要能经由桩调用,都是外部链接
+	static Function *EmitFunction(CodeGenContext &CG, PrototypeAST *Proto, function_ref<Value *()> GenBody,
+		bool TailRec = false, bool Memoize = false, bool Local = false) {
+		//可在当前模块中获取任何先前声明的函数的函数声明
+		auto &P = *Proto;
+		CG.FunctionProtos[Proto->getSym()] = Proto;
+		Function *TheFunction = CG.getFunction(P.getSym());
+		if (!TheFunction)
+			return nullptr;
+		//并行生成时其他线程的模块可能调用它
+		bool Tiered = CG.TierThreshold && !Memoize && TheFunction->getName() != "main";
+		if (Local && !CG.SharedProtos && !Tiered)
+			TheFunction->setLinkage(Function::InternalLinkage);
+		Function *BodyFunction = TheFunction;
+		if (Memoize) {
+			BodyFunction = Function::Create(TheFunction->getFunctionType(), Function::InternalLinkage,
+				TheFunction->getName() + ".body", CG.TheModule);
+			unsigned Idx = 0;
+			for (auto &Arg : BodyFunction->args())
+				Arg.setName(CG.getName(P.getArgs()[Idx++]));
 		}
-	};
 
-	// CreateEntryBlockAlloca - Create an alloca instruction in the entry block of
-	// the function.  This is used for mutable variables etc.
-	static AllocaInst *CreateEntryBlockAlloca(Function *TheFunction,
-		const std::string &VarName) {
-		IRBuilder<> TmpB(&TheFunction->getEntryBlock(),
-			TheFunction->getEntryBlock().begin());
-		return TmpB.CreateAlloca(Type::getInt32Ty(TheContext), nullptr,
-			VarName.c_str());
+		// Create a new basic block to start insertion into.
+		BasicBlock *BB = BasicBlock::Create(CG.TheContext, "entry", BodyFunction);
+		CG.Builder.SetInsertPoint(BB);
+
+		// Record the function arguments in the NamedValues map.
+		CG.NamedValues.clear();
+		CG.TailArgs.clear();
+		CG.VarSlots.assign(1, nullptr);
+		CG.ArrayBases.clear();
+		CG.HeapArrays.clear();
+		CG.SSA.reset();
+		SealBlock(CG, BB);
+		StartProfile(CG, TheFunction->getName());
+		ProfileCounter(CG);
+		CG.TierCount = nullptr;
+		if (Tiered) {
+			CG.TierCount = new GlobalVariable(*CG.TheModule, CG.Builder.getInt32Ty(), false,
+				GlobalValue::InternalLinkage, CG.Builder.getInt32(0), TheFunction->getName() + ".tier.count");
+			CG.TierSym = P.getSym();
+			CG.TieredFunctions.push_back(P.getSym());
+			TierCounter(CG);
+		}
+		unsigned Idx = 0;
+		for (auto &Arg : BodyFunction->args()) {
+			unsigned ArgSym = P.getArgs()[Idx++];
+
+			// Create a variable for this argument and store the initial value.
+			unsigned Var = NewVariable(CG, CG.getName(ArgSym));
+			WriteVariable(CG, Var, &Arg);
+
+			// Add arguments to variable symbol table.
+			CG.NamedValues.bind(ArgSym, Var);
+			CG.TailArgs.push_back(Var);
+		}
+
+		CG.TailRecHeader = nullptr;
+		if (TailRec) {
+			CG.TailMul = NewVariable(CG, "tailrec.mul");
+			CG.TailAdd = NewVariable(CG, "tailrec.add");
+			WriteVariable(CG, CG.TailMul, CG.Builder.getInt32(1));
+			WriteVariable(CG, CG.TailAdd, CG.Builder.getInt32(0));
+			BasicBlock *Header = BasicBlock::Create(CG.TheContext, "tailrecurse", BodyFunction);
+			CG.Builder.CreateBr(Header);
+			CG.Builder.SetInsertPoint(Header);
+			CG.TailRecHeader = Header;
+		}
+
+		GenBody();
+
+		//如果函数没有返回语句，添加个RETURN 0
+		CG.Builder.CreateRet(AdjustReturnValue(CG, CG.Builder.getInt32(0)));
+		//所有尾递归调用都已生成,循环头的前驱才完整
+		if (CG.TailRecHeader)
+			SealBlock(CG, CG.TailRecHeader);
+		CG.TailRecHeader = nullptr;
+		FreeHeapArrays(CG, BodyFunction);
+		FinishProfile(CG, BodyFunction, TheFunction->getName(), Local);
+		CG.TierCount = nullptr;
+
+		FinishFunction(CG, BodyFunction);
+		if (Memoize) {
+			EmitMemoWrapper(CG, TheFunction, BodyFunction);
+			FinishFunction(CG, TheFunction);
+		}
+
+		return TheFunction;
 	}
 
-	//空语句
-	class NullStatAST:public StatAST {
+	//数字抽象语法树
+	class NumberExprAST : public StatAST {
+		int Val;
+
 	public:
-		Value *codegen() {
-            return Builder.getInt32(0); //null always return 0
+		NumberExprAST(int Val) : StatAST(SK_Number), Val(Val) {}
+
+		int getVal() const { return Val; }
+		static bool classof(const StatAST *S) { return S->getKind() == SK_Number; }
+
+		Value * codegen(CodeGenContext &CG) {
+			return ConstantInt::get(CG.TheContext, APInt(32,Val,true));
 		}
 	};
 
-	//变量声明语句
-	class DecAST : public StatAST {
-		std::vector<std::string> VarNames;
-		std::unique_ptr<StatAST> Body;
+	//变量抽象语法树
+	class VariableExprAST : public StatAST {
+		unsigned Sym;
 
 	public:
-		DecAST(std::vector<std::string> VarNames, std::unique_ptr<StatAST> Body)
-			:VarNames(std::move(VarNames)), Body(std::move(Body)) {}
+		unsigned getSym() {
+			return Sym;
+		}
 
-		Value *codegen() {
-			std::vector<AllocaInst *> OldBindings;
+		VariableExprAST(unsigned Sym) : StatAST(SK_Variable), Sym(Sym) {}
 
-			Function *TheFunction = Builder.GetInsertBlock()->getParent();
+		static bool classof(const StatAST *S) { return S->getKind() == SK_Variable; }
 
-			for (unsigned i = 0, e = VarNames.size(); i != e; ++i) {
-				const std::string &VarName = VarNames[i];
+		Value * codegen(CodeGenContext &CG) {
+			return EmitVariable(CG, Sym);
+		}
+	};
 
-				Value *InitVal = ConstantInt::get(TheContext, APInt(32,0));
+	class NegExprAST : public StatAST {
+		StatAST *EXP;
+
+		public:
+			NegExprAST(StatAST *EXP)
+				: StatAST(SK_Neg), EXP(EXP) {
+			}
+
+			StatAST *getExpr() const { return EXP; }
+			static bool classof(const StatAST *S) { return S->getKind() == SK_Neg; }
 
-				AllocaInst *Alloca = CreateEntryBlockAlloca(TheFunction, VarName);
-				Builder.CreateStore(InitVal, Alloca);
+			Value * codegen(CodeGenContext &CG) {
+				auto Value = EXP->codegen(CG);
+				if (!Value)
+					return nullptr;
 
-				OldBindings.push_back(NamedValues[VarName]);
-				NamedValues[VarName] = Alloca;
+				return CG.Builder.CreateNeg(Value);
 			}
+	};
+
+	//'+','-','*','/'二元运算表达式抽象语法树
+	class BinaryExprAST : public StatAST {
+		char Op;
+		StatAST *LHS, *RHS;
+
+	public:
+		BinaryExprAST(char Op, StatAST *LHS, StatAST *RHS)
+			: StatAST(SK_Binary), Op(Op), LHS(LHS), RHS(RHS) {}
+
+		char getOp() const { return Op; }
+		StatAST *getLHS() const { return LHS; }
+		StatAST *getRHS() const { return RHS; }
+		static bool classof(const StatAST *S) { return S->getKind() == SK_Binary; }
+
+		Value * codegen(CodeGenContext &CG) {
+
+			Value *L = LHS->codegen(CG);
+			Value *R = RHS->codegen(CG);
+			if (!L || !R)
+				return nullptr;
+
+			return EmitBinary(CG, Op, L, R);
+		}
+	};
+
+	//空语句
+	class NullStatAST:public StatAST {
+	public:
+		NullStatAST() : StatAST(SK_Null) {}
 
+		static bool classof(const StatAST *S) { return S->getKind() == SK_Null; }
+
+		Value *codegen(CodeGenContext &CG) {
+            return CG.Builder.getInt32(0); //null always return 0
+		}
+	};
+
+	//变量声明语句
+	class DecAST : public StatAST {
+		ArrayRef<unsigned> VarNames;
+		StatAST *Body;
+		ArrayRef<unsigned> Sizes;	//没有数组时为空,否则为每个变量的元素个数(标量为 0)
+
+	public:
+		DecAST(ArrayRef<unsigned> VarNames, StatAST *Body, ArrayRef<unsigned> Sizes = ArrayRef<unsigned>())
+			:StatAST(SK_Dec), VarNames(VarNames), Body(Body), Sizes(Sizes) {}
+
+		ArrayRef<unsigned> getVarNames() const { return VarNames; }
+		ArrayRef<unsigned> getSizes() const { return Sizes; }
+		static bool classof(const StatAST *S) { return S->getKind() == SK_Dec; }
+
+		Value *codegen(CodeGenContext &CG) {
+			EmitDec(CG, VarNames, Sizes);
 			return nullptr;
 		}
 	};
 
 	//块语句
 	class BlockStatAST : public StatAST {
-		std::vector<std::unique_ptr<DecAST>> DecList;
-		std::vector<std::unique_ptr<StatAST>> StatList;
+		ArrayRef<DecAST *> DecList;
+		ArrayRef<StatAST *> StatList;
 
 	public:
-		BlockStatAST(std::vector<std::unique_ptr<DecAST>> DecList, std::vector<std::unique_ptr<StatAST>> StatList)
-			:DecList(std::move(DecList)), StatList(std::move(StatList)){}
+		BlockStatAST(ArrayRef<DecAST *> DecList, ArrayRef<StatAST *> StatList)
+			:StatAST(SK_Block), DecList(DecList), StatList(StatList){}
+
+		ArrayRef<DecAST *> getDecList() const { return DecList; }
+		ArrayRef<StatAST *> getStatList() const { return StatList; }
+		static bool classof(const StatAST *S) { return S->getKind() == SK_Block; }
 
 	public:
-		Value* codegen()
+		Value* codegen(CodeGenContext &CG)
 		{
+			//块中声明的变量只在块内可见,离开时恢复外层同名变量
+			CG.NamedValues.pushScope();
 			for (int i = 0; i < DecList.size(); i++)
 			{
-				DecList[i]->codegen();
+				DecList[i]->codegen(CG);
 			}
 			for (int j = 0; j < StatList.size(); j++)
 			{
-				StatList[j]->codegen();
+				StatList[j]->codegen(CG);
 			}
-			return Builder.getInt32(0); //block always return 0
+			CG.NamedValues.popScope();
+			return CG.Builder.getInt32(0); //block always return 0
 		}
 	};
 
@@ -287,298 +1249,282 @@ static AllocaInst *CreateEntryBlockAlloca(Function *TheFunction,
 
 	};
 
+	//texts[i] 为 expr[i] 之前的文本,最后一个为所有表达式之后的文本
 	class PrintStatAST : public StatAST {
-        std::string text;
-		std::vector<std::unique_ptr<StatAST>> expr;
+        ArrayRef<StringRef> texts;
+		ArrayRef<StatAST *> expr;
 
 	  public:
-        PrintStatAST(std::string text, std::vector<std::unique_ptr<StatAST>> expr):
-            text(text), expr(std::move(expr)){}
-        Value *codegen()
-        {
-			Function *TheFunction = Builder.GetInsertBlock()->getParent();
-
-            std::vector<llvm::Value *> paramArrayRef;
-            Value *intFormat = Builder.CreateGlobalStringPtr(text.c_str());
-            paramArrayRef.push_back(intFormat);
-
-			for (int i = 0; i<expr.size(); i++)//auto tmp = expr.begin(); tmp != expr.end(); tmp++)
-			{
-				Value *tmpValue = expr[i]->codegen();
-				paramArrayRef.push_back(tmpValue);
-			}
+        PrintStatAST(ArrayRef<StringRef> texts, ArrayRef<StatAST *> expr):
+            StatAST(SK_Print), texts(texts), expr(expr){}
 
-			Builder.CreateCall(printFunc, paramArrayRef);
+        ArrayRef<StringRef> getTexts() const { return texts; }
+        ArrayRef<StatAST *> getExprs() const { return expr; }
+        static bool classof(const StatAST *S) { return S->getKind() == SK_Print; }
 
-			Value *num = Builder.getInt32(0);//print always return 0
-			return num;
+        Value *codegen(CodeGenContext &CG)
+        {
+            return EmitPrint(CG, texts, expr.size(),
+                [&](unsigned i) { return expr[i]->codegen(CG); });
         }
 	};
 
 	//IF Statement
 	class IfStatAST : public StatAST {
-		std::unique_ptr<StatAST> Cond;
-		std::unique_ptr<StatAST> Then, Else;
+		StatAST *Cond;
+		StatAST *Then, *Else;
 
 	public:
-		IfStatAST(std::unique_ptr<StatAST> Cond, std::unique_ptr<StatAST> Then,
-			std::unique_ptr<StatAST> Else)
-			: Cond(std::move(Cond)), Then(std::move(Then)), Else(std::move(Else)) {}
-
-		Value *codegen() {
-			Value *CondV = Cond->codegen();
-			if (!CondV)
-				return nullptr;
-
-			// Convert condition to a bool by comparing non-equal to 0.0.
-			CondV = Builder.CreateICmpNE(
-				CondV, Builder.getInt32(0), "ifcond");
-
-			Function *TheFunction = Builder.GetInsertBlock()->getParent();
-
-			// Create blocks for the then and else cases.  Insert the 'then' block at the
-			// end of the function.
-			BasicBlock *ThenBB = BasicBlock::Create(TheContext, "then", TheFunction);
-			BasicBlock *MergeBB = BasicBlock::Create(TheContext, "ifcont");
-			BasicBlock *ElseBB = nullptr;
-			if (Else != nullptr) {
-				ElseBB = BasicBlock::Create(TheContext, "else");
-				Builder.CreateCondBr(CondV, ThenBB, ElseBB);
-			}
-			else {
-				Builder.CreateCondBr(CondV, ThenBB, MergeBB);
-			}
-
-			// Emit then value.
-			Builder.SetInsertPoint(ThenBB);
-
-			Value *ThenV = Then->codegen();
-			if (!ThenV)
-				return nullptr;
-
-			Builder.CreateBr(MergeBB);
-			// Codegen of 'Then' can change the current block, update ThenBB for the PHI.
-			ThenBB = Builder.GetInsertBlock();
-
-			// Emit else block.
-			if (ElseBB != nullptr) {
-				TheFunction->getBasicBlockList().push_back(ElseBB);
-				Builder.SetInsertPoint(ElseBB);
-
-				Value *ElseV = Else->codegen();
-				if (!ElseV)
-					return nullptr;
-				Builder.CreateBr(MergeBB);
-
-				// Codegen of 'Else' can change the current block, update ElseBB for the PHI.
-				ElseBB = Builder.GetInsertBlock();
-			}
-
-			// Emit merge block.
-			TheFunction->getBasicBlockList().push_back(MergeBB);
-			Builder.SetInsertPoint(MergeBB);
-
-			return nullptr;
+		IfStatAST(StatAST *Cond, StatAST *Then, StatAST *Else)
+			: StatAST(SK_If), Cond(Cond), Then(Then), Else(Else) {}
+
+		StatAST *getCond() const { return Cond; }
+		StatAST *getThen() const { return Then; }
+		StatAST *getElse() const { return Else; }
+		static bool classof(const StatAST *S) { return S->getKind() == SK_If; }
+
+		Value *codegen(CodeGenContext &CG) {
+			return EmitIf(CG, [&]() { return Cond->codegen(CG); },
+				[&]() { return Then->codegen(CG); },
+				[&]() { return Else->codegen(CG); }, Else != nullptr);
 		}
 
 	};
 
 	class RetStatAST : public StatAST {
-		std::unique_ptr<StatAST> Val;
+		StatAST *Val;
+		TailRecKind TailRec = TR_None;
 
 		public:
-			RetStatAST(std::unique_ptr<StatAST> Val)
-				: Val(std::move(Val)) {}
+			RetStatAST(StatAST *Val)
+				: StatAST(SK_Ret), Val(Val) {}
 
-			Value *codegen() {
-				Function *TheFunction = Builder.GetInsertBlock()->getParent();
-				if (Value *RetVal = Val->codegen()) {
-					Builder.CreateRet(RetVal);
-					BasicBlock *afterRet = BasicBlock::Create(TheContext, "afterReturn", TheFunction);
-					Builder.SetInsertPoint(afterRet);
+			StatAST *getVal() const { return Val; }
+			TailRecKind getTailRec() const { return TailRec; }
+			void setTailRec(TailRecKind Kind) { TailRec = Kind; }	//TailRec.h 使用
+			static bool classof(const StatAST *S) { return S->getKind() == SK_Ret; }
 
-					return RetVal;
-				}
-			}
+			Value *codegen(CodeGenContext &CG);
 	};
 
 	class AssStatAST : public StatAST {
-		std::unique_ptr<VariableExprAST> Name;
-		std::unique_ptr<StatAST> Expression;
+		VariableExprAST *Name;
+		StatAST *Expression;
 
 	public:
-		AssStatAST(std::unique_ptr<VariableExprAST> Name, std::unique_ptr<StatAST> Expression)
-			: Name(std::move(Name)), Expression(std::move(Expression)) {}
+		AssStatAST(VariableExprAST *Name, StatAST *Expression)
+			: StatAST(SK_Assign), Name(Name), Expression(Expression) {}
 
-		Value *codegen() {
-			Value* EValue = Expression->codegen();
+		VariableExprAST *getName() const { return Name; }
+		StatAST *getExpr() const { return Expression; }
+		static bool classof(const StatAST *S) { return S->getKind() == SK_Assign; }
+
+		Value *codegen(CodeGenContext &CG) {
+			Value* EValue = Expression->codegen(CG);
 			if (!EValue)
 				return nullptr;
 
-			Value *Variable = NamedValues[Name->getName()];
-			if (!Variable)
-				return LogErrorV("Unknown variable name");
-
-			Builder.CreateStore(EValue, Variable);
-
-			return EValue;
+			return EmitAssign(CG, Name->getSym(), EValue);
 		}
 	};
 
-	//函数抽象语法树
-	class FunctionAST {
-		std::unique_ptr<PrototypeAST> Proto;
-		std::unique_ptr<StatAST> Body;
+	//数组元素 a[i]
+	class IndexExprAST : public StatAST {
+		unsigned Sym;
+		StatAST *Index;
 
 	public:
-		FunctionAST(std::unique_ptr<PrototypeAST> Proto,
-			std::unique_ptr<StatAST> Body)
-			: Proto(std::move(Proto)), Body(std::move(Body)) {}
-
-		Function * codegen() {
-			//可在当前模块中获取任何先前声明的函数的函数声明
-			auto &P = *Proto;
-			FunctionProtos[Proto->getName()] = std::move(Proto);
-			Function *TheFunction = getFunction(P.getName());
-			if (!TheFunction)
-				return nullptr;
+		IndexExprAST(unsigned Sym, StatAST *Index)
+			: StatAST(SK_Index), Sym(Sym), Index(Index) {}
 
-			// Create a new basic block to start insertion into.
-			BasicBlock *BB = BasicBlock::Create(TheContext, "entry", TheFunction);
-			Builder.SetInsertPoint(BB);
+		unsigned getSym() const { return Sym; }
+		StatAST *getIndex() const { return Index; }
+		static bool classof(const StatAST *S) { return S->getKind() == SK_Index; }
 
-			// Record the function arguments in the NamedValues map.
-			NamedValues.clear();
-			for (auto &Arg : TheFunction->args()) {
+		Value *codegen(CodeGenContext &CG) {
+			Value *Idx = Index->codegen(CG);
+			if (!Idx)
+				return nullptr;
+			return EmitIndex(CG, Sym, Idx);
+		}
+	};
 
-				// Create an alloca for this variable.
-				AllocaInst *Alloca = CreateEntryBlockAlloca(TheFunction, Arg.getName());
+	//数组元素赋值 a[i] := e,先求下标再求右边的值
+	class ArrayAssStatAST : public StatAST {
+		unsigned Sym;
+		StatAST *Index, *Expression;
 
-				// Store the initial value into the alloca.
-				Builder.CreateStore(&Arg, Alloca);
+	public:
+		ArrayAssStatAST(unsigned Sym, StatAST *Index, StatAST *Expression)
+			: StatAST(SK_ArrayAssign), Sym(Sym), Index(Index), Expression(Expression) {}
 
-				// Add arguments to variable symbol table.
-				NamedValues[Arg.getName()] = Alloca;
-			}
+		unsigned getSym() const { return Sym; }
+		StatAST *getIndex() const { return Index; }
+		StatAST *getExpr() const { return Expression; }
+		static bool classof(const StatAST *S) { return S->getKind() == SK_ArrayAssign; }
 
-			Body->codegen();
+		Value *codegen(CodeGenContext &CG) {
+			Value *Idx = Index->codegen(CG);
+			if (!Idx)
+				return nullptr;
+			Value *EValue = Expression->codegen(CG);
+			if (!EValue)
+				return nullptr;
+			return EmitArrayAssign(CG, Sym, Idx, EValue);
+		}
+	};
 
-			Builder.CreateRet(Builder.getInt32(0)); //如果函数没有返回语句，添加个RETURN 0
-			verifyFunction(*TheFunction);
+	//函数抽象语法树
+	class FunctionAST {
+		PrototypeAST *Proto;
+		StatAST *Body;
+		bool TailRec = false;	//函数体中有标记为尾递归的 RETURN
+		bool Memoized = false;	//纯的递归函数,结果放入缓存(Memoize.h)
+		bool Specialized = false;	//常量实参特化生成的副本(Specialize.h)
 
-			return TheFunction;
+	public:
+		FunctionAST(PrototypeAST *Proto, StatAST *Body)
+			: Proto(Proto), Body(Body) {}
+
+		PrototypeAST *getProto() const { return Proto; }
+		StatAST *getBody() const { return Body; }
+		void setBody(StatAST *NewBody) { Body = NewBody; }	//语法树化简(Simplify.h)使用
+		bool hasTailRec() const { return TailRec; }
+		void setTailRec(bool HasTailRec) { TailRec = HasTailRec; }	//TailRec.h 使用
+		bool isMemoized() const { return Memoized; }
+		void setMemoized(bool M) { Memoized = M; }	//Memoize.h 使用
+		bool isSpecialized() const { return Specialized; }
+		void setSpecialized(bool S) { Specialized = S; }	//Specialize.h 使用
+
+		Function * codegen(CodeGenContext &CG) {
+			return EmitFunction(CG, Proto, [&]() { return Body->codegen(CG); }, TailRec, Memoized,
+				Specialized);
 		}
 	};
 
 	//函数调用抽象语法树
 	class CallExprAST : public StatAST {
-		std::string Callee;
-		std::vector<std::unique_ptr<StatAST>> Args;
+		unsigned Callee;
+		ArrayRef<StatAST *> Args;
 	public:
-		CallExprAST(const std::string &Callee,
-			std::vector<std::unique_ptr<StatAST>> Args)
-			: Callee(Callee), Args(std::move(Args)) {}
-
-		Value * codegen() {
-			// Look up the name in the global module table.
-			Function *CalleeF = getFunction(Callee);
-			if (!CalleeF)
-				return LogErrorV("Unknown function referenced");
-
-			// If argument mismatch error.
-			if (CalleeF->arg_size() != Args.size())
-				return LogErrorV("Incorrect # arguments passed");
-
-			std::vector<Value *> ArgsV;
-			for (unsigned i = 0, e = Args.size(); i != e; ++i) {
-				ArgsV.push_back(Args[i]->codegen());
-				if (!ArgsV.back())
-					return nullptr;
-			}
+		CallExprAST(unsigned Callee, ArrayRef<StatAST *> Args)
+			: StatAST(SK_Call), Callee(Callee), Args(Args) {}
 
-			return Builder.CreateCall(CalleeF, ArgsV, "calltmp");
+		unsigned getCallee() const { return Callee; }
+		ArrayRef<StatAST *> getArgs() const { return Args; }
+		static bool classof(const StatAST *S) { return S->getKind() == SK_Call; }
+
+		Value * codegen(CodeGenContext &CG) {
+			return EmitCall(CG, Callee, Args.size(),
+				[&](unsigned i) { return Args[i]->codegen(CG); });
 		}
 	};
 
 
+	inline Value *RetStatAST::codegen(CodeGenContext &CG) {
+		if (TailRec != TR_None && CG.TailRecHeader) {
+			auto *B = dyn_cast<BinaryExprAST>(Val);
+			auto *Call = cast<CallExprAST>(!B ? Val : TailRec == TR_CallLeft ? B->getLHS() : B->getRHS());
+			StatAST *E = !B ? nullptr : TailRec == TR_CallLeft ? B->getRHS() : B->getLHS();
+			return EmitTailRec(CG, TailRec, B ? B->getOp() : 0, [&]() { return E->codegen(CG); },
+				Call->getArgs().size(), [&](unsigned i) { return Call->getArgs()[i]->codegen(CG); });
+		}
+		if (Value *RetVal = Val->codegen(CG))
+			return EmitRet(CG, RetVal);
+		return nullptr;
+	}
+
 	//程序的抽象语法树
 	class ProgramAST {
-		std::vector<std::unique_ptr<FunctionAST>> funcs;
+		ArrayRef<FunctionAST *> funcs;
 
 	public:
-		ProgramAST(std::vector<std::unique_ptr<FunctionAST>> funcs)
-			:funcs(std::move(funcs)) {}
+		ProgramAST(ArrayRef<FunctionAST *> funcs)
+			:funcs(funcs) {}
 	};
 
 	class WhileStatAST:public StatAST{
-		std::unique_ptr<StatAST> Expr, Stat;
+		StatAST *Expr, *Stat;
 	public:
-		WhileStatAST(std::unique_ptr<StatAST> Expr, std::unique_ptr<StatAST> Stat):
-			Expr(std::move(Expr)), Stat(std::move(Stat)){}
-
-		Value *codegen()
-		{
-			Function *TheFunction = Builder.GetInsertBlock()->getParent();
-			BasicBlock *LoopBB = BasicBlock::Create(TheContext, "loop", TheFunction);
-			BasicBlock *AfterBB = BasicBlock::Create(TheContext, "afterLoop", TheFunction);
+		WhileStatAST(StatAST *Expr, StatAST *Stat):
+			StatAST(SK_While), Expr(Expr), Stat(Stat){}
 
-			Value *EndCond = Expr->codegen();
-			if(!EndCond)
-				return nullptr;
-			EndCond = Builder.CreateICmpNE(EndCond, Builder.getInt32(0),
-					"loopCondIn");
-			Builder.CreateCondBr(EndCond, LoopBB, AfterBB);
-
-			Builder.SetInsertPoint(LoopBB);
-			Value *inLoopVal = Stat->codegen();
-			if(!inLoopVal)
-				return nullptr;
-			EndCond = Builder.CreateICmpNE(Expr->codegen(),
-				Builder.getInt32(0), "loopCondOut");
-			Builder.CreateCondBr(EndCond, LoopBB, AfterBB);
+		StatAST *getCond() const { return Expr; }
+		StatAST *getBody() const { return Stat; }
+		static bool classof(const StatAST *S) { return S->getKind() == SK_While; }
 
-			Builder.SetInsertPoint(AfterBB);
-
-			return Builder.getInt32(0);
+		Value *codegen(CodeGenContext &CG)
+		{
+			return EmitWhile(CG, [&]() { return Expr->codegen(CG); },
+				[&]() { return Stat->codegen(CG); });
 		}
 	};
 
 
-	//创建和初始化模块和传递管理器
-	static void InitializeModuleAndPassManager() {
+	//创建和初始化模块和传递管理器。
+	//OptLevel 为 0~3,与 clang 相同地由 PassManagerBuilder 组织优化流程:
+	//函数级的优化在每个函数生成后运行,内联、尾调用消除、循环优化等模块级的优化在整个模块生成后运行
+	static void InitializeModuleAndPassManager(CodeGenContext &CG, unsigned OptLevel) {
 
 		// Open a new module.
-		TheModule = Owner.get();//llvm::make_unique<Module>("VSL jit", TheContext);
-		TheModule->setDataLayout(TheJIT->getTargetMachine().createDataLayout());
+		CG.TM.reset(EngineBuilder().selectTarget());
+		CG.TheModule->setDataLayout(CG.TM->createDataLayout());
+		CG.TheModule->setTargetTriple(CG.TM->getTargetTriple().str());
+
+		CG.TheFPM.reset();
+		CG.TheMPM.reset();
+		if (OptLevel == 0)
+			return;
+
+		PassManagerBuilder PMB;
+		PMB.OptLevel = OptLevel;
+		PMB.SizeLevel = 0;
+		if (OptLevel > 1)
+			PMB.Inliner = createFunctionInliningPass(OptLevel, 0, false);
+		else
+			PMB.Inliner = createAlwaysInlinerLegacyPass();
+		PMB.LoopVectorize = OptLevel > 1;
+		PMB.SLPVectorize = OptLevel > 1;
+		CG.TM->adjustPassManager(PMB);
 
 		// Create a new pass manager attached to it.
-		TheFPM = llvm::make_unique<legacy::FunctionPassManager>(TheModule);
-
-		// Promote allocas to registers.
-		TheFPM->add(createPromoteMemoryToRegisterPass());
-		// Do simple "peephole" optimizations and bit-twiddling optzns.
-		TheFPM->add(createInstructionCombiningPass());
-		// Reassociate expressions.
-		TheFPM->add(createReassociatePass());
-		// Eliminate Common SubExpressions.
-		TheFPM->add(createGVNPass());
-		// Simplify the control flow graph (deleting unreachable blocks, etc).
-		TheFPM->add(createCFGSimplificationPass());
-
-		TheFPM->doInitialization();
+		CG.TheFPM = llvm::make_unique<legacy::FunctionPassManager>(CG.TheModule);
+		CG.TheFPM->add(createTargetTransformInfoWrapperPass(CG.TM->getTargetIRAnalysis()));
+		PMB.populateFunctionPassManager(*CG.TheFPM);
+		CG.TheFPM->doInitialization();
+
+		CG.TheMPM = llvm::make_unique<legacy::PassManager>();
+		CG.TheMPM->add(createTargetTransformInfoWrapperPass(CG.TM->getTargetIRAnalysis()));
+		PMB.populateModulePassManager(*CG.TheMPM);
+	}
 
+	//运行模块级优化,之后不再需要传递管理器
+	static void OptimizeModule(CodeGenContext &CG) {
+		if (CG.TheFPM)
+			CG.TheFPM->doFinalization();
+		if (CG.TheMPM)
+			CG.TheMPM->run(*CG.TheModule);
+		CG.TheFPM.reset();
+		CG.TheMPM.reset();
 	}
 
-	Function *getFunction(std::string Name) {
+	inline Function *CodeGenContext::getFunction(unsigned Sym) {
 		// First, see if the function has already been added to the current module.
-		if (auto *F = TheModule->getFunction(Name))
+		if (auto *F = TheModule->getFunction(getName(Sym)))
 			return F;
 
 		// If not, check whether we can codegen the declaration from some existing
 		// prototype.
-		auto FI = FunctionProtos.find(Name);
+		auto FI = FunctionProtos.find(Sym);
 		if (FI != FunctionProtos.end())
-			return FI->second->codegen();
+			return FI->second->codegen(*this);
+
+		// Functions generated by other threads are only declared in this module.
+		if (SharedProtos && Sym < SharedProtos->size()) {
+			auto &P = (*SharedProtos)[Sym];
+			if (P.second && P.first <= CurFunc)
+				return P.second->codegen(*this);
+		}
 
 		// If no existing prototype exists, return null.
 		return nullptr;
@@ -0,0 +1,178 @@
+#ifndef __BYTECODE_H__
+#define __BYTECODE_H__
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+//VSL 字节码映像的格式,由 BytecodeGen.h 生成,VM.h 解释执行,不依赖 LLVM。
+//映像中只有相对于文件开头和代码开头的偏移,没有指针,可以直接 mmap 后运行。
+//所有字段都是本机字节序(小端)的 32 位整数:
+//	VMImageHeader | VMFunction[NumFuncs] | 代码(uint32_t[CodeWords]) | PRINT 的文本
+//
+//寄存器式的指令:第一个字为 操作码 | A << 8,其余操作数各占一个字。
+//寄存器是当前函数栈帧中的下标:形参在最前面,然后是局部变量(数组占连续的若干个)和临时值。
+//调用时实参放在调用者栈帧顶部连续的寄存器中,被调用者的栈帧就从那里开始,不需要复制。
+//跳转目标是代码中的字下标
+
+static const char VMMagic[4] = { 'V', 'S', 'L', 'B' };
+static const uint32_t VMVersion = 1;
+
+struct VMImageHeader {
+	char Magic[4];
+	uint32_t Version;
+	uint32_t NumFuncs;
+	uint32_t MainFunc;	//main 在函数表中的下标
+	uint32_t FuncsOffset;	//以下偏移都相对于文件开头,以字节计
+	uint32_t CodeOffset;
+	uint32_t CodeWords;
+	uint32_t StringsOffset;
+	uint32_t StringsSize;
+};
+
+struct VMFunction {
+	uint32_t Entry;	//第一条指令的字下标
+	uint32_t NumArgs;
+	uint32_t FrameSize;	//栈帧中的寄存器数
+	uint32_t Name;	//函数名在文本区中的偏移和长度,只用于诊断
+	uint32_t NameLen;
+};
+
+//X(名字, 操作数字数):每条指令的字数为 1 + 操作数字数。
+//R[x] 为寄存器,K 为立即数,T 为跳转目标,F 为函数表下标
+#define VM_OPCODES(X) \
+	X(LOADK, 1)	/* R[A] = K */ \
+	X(MOV, 1)	/* R[A] = R[B] */ \
+	X(ADD, 2)	/* R[A] = R[B] + R[C] */ \
+	X(SUB, 2)	/* R[A] = R[B] - R[C] */ \
+	X(MUL, 2)	/* R[A] = R[B] * R[C] */ \
+	X(DIV, 2)	/* R[A] = R[B] / R[C] */ \
+	X(NEG, 1)	/* R[A] = -R[B] */ \
+	X(ADDI, 2)	/* R[A] = R[B] + K(C) */ \
+	X(MULI, 2)	/* R[A] = R[B] * K(C) */ \
+	X(INC, 1)	/* R[A] += K(B),即 i := i + 1 等 */ \
+	X(JMP, 1)	/* 跳到 T(B) */ \
+	X(JZ, 1)	/* R[A] == 0 时跳到 T(B) */ \
+	X(JNZ, 1)	/* R[A] != 0 时跳到 T(B) */ \
+	X(JEQ, 2)	/* R[A] == R[B] 时跳到 T(C),即 IF/WHILE a - b 不成立 */ \
+	X(JNE, 2)	/* R[A] != R[B] 时跳到 T(C) */ \
+	X(JEQI, 2)	/* R[A] == K(B) 时跳到 T(C) */ \
+	X(JNEI, 2)	/* R[A] != K(B) 时跳到 T(C) */ \
+	X(CALL, 2)	/* R[A] = F(B)(R[C], R[C+1], ...),被调用者的栈帧从 R[C] 开始 */ \
+	X(TAILCALL, 2)	/* RETURN F(B)(R[C], ...):实参移到 R[0] 起,复用当前栈帧 */ \
+	X(RET, 0)	/* 返回 R[A] */ \
+	X(ALOAD, 2)	/* R[A] = R[B + R[C]],数组从寄存器 B 开始 */ \
+	X(ASTORE, 2)	/* R[A + R[B]] = R[C] */ \
+	X(AZERO, 1)	/* R[A] 起的 K(B) 个寄存器清零 */ \
+	X(PRINTS, 1)	/* 输出文本区中偏移 K(B)、长度 A 的文本 */ \
+	X(PRINTI, 0)	/* 输出 R[A] */
+
+enum VMOpcode : uint8_t {
+#define VM_ENUM(Name, Ops) OP_##Name,
+	VM_OPCODES(VM_ENUM)
+#undef VM_ENUM
+	OP_NumOpcodes
+};
+
+//每个操作码的操作数字数
+static const uint8_t VMNumOperands[] = {
+#define VM_OPERANDS(Name, Ops) Ops,
+	VM_OPCODES(VM_OPERANDS)
+#undef VM_OPERANDS
+};
+
+static const uint32_t VMMaxRegister = (1u << 24) - 1;	//A 字段只有 24 位
+
+//检查映像的头部和函数表,返回头部,不合法时为空。每条指令由 VerifyVMCode 检查
+static inline const VMImageHeader *CheckVMImage(const char *Data, size_t Size) {
+	if (Size < sizeof(VMImageHeader) || (uintptr_t)Data % 4)
+		return nullptr;
+	auto *H = (const VMImageHeader *)Data;
+	if (memcmp(H->Magic, VMMagic, 4) || H->Version != VMVersion || H->MainFunc >= H->NumFuncs)
+		return nullptr;
+	if (H->FuncsOffset % 4 || H->CodeOffset % 4 ||
+		H->FuncsOffset > Size || H->NumFuncs > (Size - H->FuncsOffset) / sizeof(VMFunction) ||
+		H->CodeOffset > Size || H->CodeWords > (Size - H->CodeOffset) / 4 ||
+		H->StringsOffset > Size || H->StringsSize > Size - H->StringsOffset)
+		return nullptr;
+	auto *Funcs = (const VMFunction *)(Data + H->FuncsOffset);
+	for (uint32_t I = 0; I < H->NumFuncs; I++)
+		if (Funcs[I].Entry >= H->CodeWords || Funcs[I].NumArgs > Funcs[I].FrameSize)
+			return nullptr;
+	return H;
+}
+
+//在 CheckVMImage 之后逐条检查代码:操作码合法,指令不跨出所在的函数,寄存器在函数的栈帧之内,
+//调用的函数存在且实参在栈帧之内,跳转目标是同一函数中某条指令的开头,文本在文本区之内,
+//每个函数的最后一条指令是 RET、JMP 或 TAILCALL。通过后解释器运行时不必再检查这些。
+//各函数的代码按 Entry 的顺序连续存放,一个函数的代码到下一个函数的 Entry 为止
+static inline bool VerifyVMCode(const char *Data, const VMImageHeader *H) {
+	auto *Funcs = (const VMFunction *)(Data + H->FuncsOffset);
+	auto *Code = (const uint32_t *)(Data + H->CodeOffset);
+	std::vector<uint32_t> Order(H->NumFuncs);
+	for (uint32_t I = 0; I < H->NumFuncs; I++)
+		Order[I] = I;
+	std::sort(Order.begin(), Order.end(),
+		[&](uint32_t X, uint32_t Y) { return Funcs[X].Entry < Funcs[Y].Entry; });
+	if (Order.empty() || Funcs[Order[0]].Entry != 0)
+		return false;
+
+	struct Jump {
+		uint32_t Target, Begin, End;
+	};
+	std::vector<Jump> Jumps;
+	std::vector<bool> IsInst(H->CodeWords);
+	for (size_t K = 0; K < Order.size(); K++) {
+		const VMFunction &F = Funcs[Order[K]];
+		uint32_t Begin = F.Entry;
+		uint32_t End = K + 1 < Order.size() ? Funcs[Order[K + 1]].Entry : H->CodeWords;
+		if (End <= Begin)
+			return false;
+		auto Reg = [&](uint32_t R) { return R < F.FrameSize; };
+		auto Args = [&](uint32_t Callee, uint32_t Base) {
+			return Callee < H->NumFuncs && (uint64_t)Base + Funcs[Callee].NumArgs <= F.FrameSize;
+		};
+		auto Target = [&](uint32_t T) {
+			Jump J = { T, Begin, End };
+			Jumps.push_back(J);
+			return true;
+		};
+		uint8_t Op = 0;
+		for (uint32_t PC = Begin; PC < End; PC += 1 + VMNumOperands[Op]) {
+			const uint32_t *I = Code + PC;
+			Op = I[0] & 0xff;
+			uint32_t A = I[0] >> 8;
+			if (Op >= OP_NumOpcodes || VMNumOperands[Op] >= End - PC)
+				return false;
+			IsInst[PC] = true;
+			bool OK;
+			switch (Op) {
+			case OP_LOADK: case OP_INC: case OP_RET: case OP_PRINTI: OK = Reg(A); break;
+			case OP_MOV: case OP_NEG: case OP_ADDI: case OP_MULI: OK = Reg(A) && Reg(I[1]); break;
+			case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_ALOAD: case OP_ASTORE:
+				OK = Reg(A) && Reg(I[1]) && Reg(I[2]);
+				break;
+			case OP_JMP: OK = Target(I[1]); break;
+			case OP_JZ: case OP_JNZ: OK = Reg(A) && Target(I[1]); break;
+			case OP_JEQ: case OP_JNE: OK = Reg(A) && Reg(I[1]) && Target(I[2]); break;
+			case OP_JEQI: case OP_JNEI: OK = Reg(A) && Target(I[2]); break;
+			case OP_CALL: OK = Reg(A) && Args(I[1], I[2]); break;
+			case OP_TAILCALL: OK = Args(I[1], I[2]); break;
+			case OP_AZERO: OK = (uint64_t)A + I[1] <= F.FrameSize; break;
+			case OP_PRINTS: OK = (uint64_t)I[1] + A <= H->StringsSize; break;
+			default: OK = false;
+			}
+			if (!OK)
+				return false;
+		}
+		if (Op != OP_RET && Op != OP_JMP && Op != OP_TAILCALL)
+			return false;
+	}
+	for (const Jump &J : Jumps)
+		if (J.Target < J.Begin || J.Target >= J.End || !IsInst[J.Target])
+			return false;
+	return true;
+}
+
+#endif
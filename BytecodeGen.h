@@ -0,0 +1,434 @@
+#ifndef __BYTECODEGEN_H__
+#define __BYTECODEGEN_H__
+#include "AST.h"
+#include "Bytecode.h"
+#include <fstream>
+
+//把语法树翻译为 Bytecode.h 中的寄存器字节码(-bc),由 VM.h 解释执行,不经过 LLVM。
+//寄存器按栈的方式分配:形参,然后是各个块中声明的变量(离开块时释放),
+//最上面是语句中的临时值(每条语句之后释放)。变量直接作为操作数,不复制到临时寄存器,
+//只有表达式最后一条指令写入目标寄存器,所以 x := x + 1 只需一条 INC。
+//与 JIT 的代码生成相同,只能调用在前面定义的函数或函数自身
+struct BytecodeStats {
+	size_t Functions = 0;
+	size_t Instructions = 0;
+	size_t SuperInsts = 0;	//INC、ADDI/MULI、比较后跳转等合并的指令
+	size_t TailCalls = 0;
+	size_t ImageBytes = 0;
+};
+
+class BytecodeCompiler {
+	struct VarInfo {
+		uint32_t Reg;
+		uint32_t Size;	//数组的元素个数,标量为 0
+	};
+
+	StringInterner &Symbols;
+	std::vector<VMFunction> Funcs;
+	DenseMap<unsigned, uint32_t> FuncIndex;	//函数名的符号编号 -> 函数表下标
+	std::vector<uint32_t> Code;
+	std::string Strings;
+	StringMap<uint32_t> StringOffsets;	//相同的文本只保存一份
+	uint32_t MainFunc = UINT32_MAX;
+
+	//当前函数
+	uint32_t CurFunc = 0;
+	ScopedSymbolTable NamedValues;
+	std::vector<VarInfo> Vars;	//下标为变量编号,0 不用
+	uint32_t Top = 0;	//第一个空闲的寄存器
+	uint32_t FrameSize = 0;
+	bool Failed = false;
+
+public:
+	BytecodeStats Stats;
+
+	BytecodeCompiler(StringInterner &Symbols) : Symbols(Symbols) {}
+
+private:
+	bool error(const char *Str) {
+		LogError(Str);
+		Failed = true;
+		return false;
+	}
+
+	uint32_t newReg(uint32_t N = 1) {
+		uint32_t R = Top;
+		Top += N;
+		if (Top > VMMaxRegister)
+			error("Function frame is too large for bytecode");
+		FrameSize = std::max(FrameSize, Top);
+		return R;
+	}
+
+	void emit(VMOpcode Op, uint32_t A, std::initializer_list<uint32_t> Operands = {}) {
+		assert(Operands.size() == VMNumOperands[Op] && "wrong number of operands");
+		Code.push_back(Op | (A & VMMaxRegister) << 8);
+		Code.insert(Code.end(), Operands.begin(), Operands.end());
+		++Stats.Instructions;
+	}
+
+	//回填跳转目标:At 为跳转指令中目标所在的字
+	uint32_t here() const { return Code.size(); }
+	void patch(uint32_t At) { Code[At] = here(); }
+
+	uint32_t addString(StringRef S) {
+		auto R = StringOffsets.insert(std::make_pair(S, (uint32_t)Strings.size()));
+		if (R.second)
+			Strings.append(S.begin(), S.end());
+		return R.first->second;
+	}
+
+	const VarInfo *lookup(unsigned Sym) {
+		unsigned Var = NamedValues.lookup(Sym);
+		if (!Var) {
+			error("Unknown variable name");
+			return nullptr;
+		}
+		return &Vars[Var];
+	}
+
+	static bool isConst(StatAST *E, int32_t &K) {
+		if (auto *N = dyn_cast<NumberExprAST>(E)) {
+			K = N->getVal();
+			return true;
+		}
+		return false;
+	}
+
+	//结果所在的寄存器。Dest 为 UINT32_MAX 时由表达式选择(变量就是它自己的寄存器),
+	//否则结果写入 Dest
+	uint32_t expr(StatAST *E, uint32_t Dest = UINT32_MAX) {
+		uint32_t Mark = Top;
+		auto Target = [&]() {
+			Top = Mark;
+			return Dest != UINT32_MAX ? Dest : newReg();
+		};
+		switch (E->getKind()) {
+		case StatAST::SK_Number: {
+			uint32_t R = Target();
+			emit(OP_LOADK, R, { (uint32_t)cast<NumberExprAST>(E)->getVal() });
+			return R;
+		}
+		case StatAST::SK_Variable: {
+			const VarInfo *V = lookup(cast<VariableExprAST>(E)->getSym());
+			if (!V)
+				return 0;
+			if (V->Size) {
+				error("Array used without subscript");
+				return 0;
+			}
+			if (Dest == UINT32_MAX || Dest == V->Reg)
+				return V->Reg;
+			emit(OP_MOV, Dest, { V->Reg });
+			return Dest;
+		}
+		case StatAST::SK_Neg: {
+			uint32_t X = expr(cast<NegExprAST>(E)->getExpr());
+			uint32_t R = Target();
+			emit(OP_NEG, R, { X });
+			return R;
+		}
+		case StatAST::SK_Binary: {
+			auto *B = cast<BinaryExprAST>(E);
+			int32_t K;
+			//与常量的加、减、乘用带立即数的指令
+			if (B->getOp() != '/') {
+				StatAST *Other = nullptr;
+				if (isConst(B->getRHS(), K))
+					Other = B->getLHS();
+				else if (B->getOp() != '-' && isConst(B->getLHS(), K))
+					Other = B->getRHS();
+				if (Other) {
+					uint32_t X = expr(Other);
+					uint32_t R = Target();
+					uint32_t Imm = B->getOp() == '-' ? 0u - (uint32_t)K : (uint32_t)K;
+					emit(B->getOp() == '*' ? OP_MULI : OP_ADDI, R, { X, Imm });
+					++Stats.SuperInsts;
+					return R;
+				}
+			}
+			uint32_t L = expr(B->getLHS());
+			uint32_t Rhs = expr(B->getRHS());
+			uint32_t R = Target();
+			switch (B->getOp()) {
+			case '+': emit(OP_ADD, R, { L, Rhs }); break;
+			case '-': emit(OP_SUB, R, { L, Rhs }); break;
+			case '*': emit(OP_MUL, R, { L, Rhs }); break;
+			case '/': emit(OP_DIV, R, { L, Rhs }); break;
+			default: error("invalid binary operator");
+			}
+			return R;
+		}
+		case StatAST::SK_Index: {
+			auto *I = cast<IndexExprAST>(E);
+			const VarInfo *V = lookup(I->getSym());
+			if (!V)
+				return 0;
+			if (!V->Size) {
+				error("Subscripted variable is not an array");
+				return 0;
+			}
+			uint32_t Base = V->Reg;
+			uint32_t X = expr(I->getIndex());
+			uint32_t R = Target();
+			emit(OP_ALOAD, R, { Base, X });
+			return R;
+		}
+		case StatAST::SK_Call: {
+			uint32_t F, ArgBase;
+			if (!call(cast<CallExprAST>(E), F, ArgBase))
+				return 0;
+			uint32_t R = Target();
+			emit(OP_CALL, R, { F, ArgBase });
+			return R;
+		}
+		default:
+			error("unknown expression");
+			return 0;
+		}
+	}
+
+	//把实参依次放到栈顶连续的寄存器中,F 为被调用的函数
+	bool call(CallExprAST *Call, uint32_t &F, uint32_t &ArgBase) {
+		auto It = FuncIndex.find(Call->getCallee());
+		if (It == FuncIndex.end() || It->second > CurFunc)
+			return error("Unknown function referenced");
+		F = It->second;
+		if (Funcs[F].NumArgs != Call->getArgs().size())
+			return error("Incorrect # arguments passed");
+		ArgBase = Top;
+		for (unsigned I = 0; I < Call->getArgs().size(); I++) {
+			uint32_t R = newReg();
+			expr(Call->getArgs()[I], R);
+			Top = R + 1;
+		}
+		return true;
+	}
+
+	//条件 Cond 为 0(JumpIfTrue 为假)或不为 0(为真)时跳转,返回待回填的目标所在的字。
+	//a - b 和 a - K 直接比较两个操作数,不求出差
+	uint32_t branch(StatAST *Cond, bool JumpIfTrue) {
+		uint32_t Mark = Top;
+		auto *B = dyn_cast<BinaryExprAST>(Cond);
+		int32_t K;
+		if (B && B->getOp() == '-') {
+			uint32_t L = expr(B->getLHS());
+			if (isConst(B->getRHS(), K))
+				emit(JumpIfTrue ? OP_JNEI : OP_JEQI, L, { (uint32_t)K, 0 });
+			else
+				emit(JumpIfTrue ? OP_JNE : OP_JEQ, L, { expr(B->getRHS()), 0 });
+			++Stats.SuperInsts;
+		}
+		else
+			emit(JumpIfTrue ? OP_JNZ : OP_JZ, expr(Cond), { 0 });
+		Top = Mark;
+		return here() - 1;
+	}
+
+	void declare(DecAST *D) {
+		ArrayRef<unsigned> Names = D->getVarNames(), Sizes = D->getSizes();
+		for (unsigned I = 0; I < Names.size(); I++) {
+			VarInfo V;
+			V.Size = Sizes.empty() ? 0 : Sizes[I];
+			V.Reg = newReg(V.Size ? V.Size : 1);
+			if (V.Size)
+				emit(OP_AZERO, V.Reg, { V.Size });
+			else
+				emit(OP_LOADK, V.Reg, { 0 });
+			Vars.push_back(V);
+			NamedValues.bind(Names[I], Vars.size() - 1);
+		}
+	}
+
+	void stat(StatAST *S) {
+		uint32_t Mark = Top;
+		switch (S->getKind()) {
+		case StatAST::SK_Null:
+			break;
+		case StatAST::SK_Dec:
+			declare(cast<DecAST>(S));
+			return;	//变量到块结束时才释放
+		case StatAST::SK_Block: {
+			auto *B = cast<BlockStatAST>(S);
+			NamedValues.pushScope();
+			for (DecAST *D : B->getDecList())
+				declare(D);
+			for (StatAST *Sub : B->getStatList())
+				stat(Sub);
+			NamedValues.popScope();
+			break;
+		}
+		case StatAST::SK_Assign: {
+			auto *A = cast<AssStatAST>(S);
+			const VarInfo *V = lookup(A->getName()->getSym());
+			if (!V)
+				break;
+			if (V->Size) {
+				error("Array used without subscript");
+				break;
+			}
+			//x := x + K 和 x := x - K
+			auto *B = dyn_cast<BinaryExprAST>(A->getExpr());
+			auto *L = B ? dyn_cast<VariableExprAST>(B->getLHS()) : nullptr;
+			int32_t K;
+			if (L && (B->getOp() == '+' || B->getOp() == '-') && isConst(B->getRHS(), K) &&
+				NamedValues.lookup(L->getSym()) == NamedValues.lookup(A->getName()->getSym())) {
+				emit(OP_INC, V->Reg, { B->getOp() == '-' ? 0u - (uint32_t)K : (uint32_t)K });
+				++Stats.SuperInsts;
+				break;
+			}
+			expr(A->getExpr(), V->Reg);
+			break;
+		}
+		case StatAST::SK_ArrayAssign: {
+			auto *A = cast<ArrayAssStatAST>(S);
+			const VarInfo *V = lookup(A->getSym());
+			if (!V)
+				break;
+			if (!V->Size) {
+				error("Subscripted variable is not an array");
+				break;
+			}
+			//先求下标,在临时寄存器中时位于 Top 之下,求右边的值时不会被覆盖
+			uint32_t Base = V->Reg;
+			uint32_t X = expr(A->getIndex());
+			uint32_t Val = expr(A->getExpr());
+			emit(OP_ASTORE, Base, { X, Val });
+			break;
+		}
+		case StatAST::SK_Print: {
+			auto *P = cast<PrintStatAST>(S);
+			//先求出所有的值,其中调用的函数也可能输出
+			std::vector<uint32_t> Vals;
+			for (StatAST *E : P->getExprs()) {
+				uint32_t R = newReg();
+				Vals.push_back(expr(E, R));
+			}
+			ArrayRef<StringRef> Texts = P->getTexts();
+			for (unsigned I = 0; I < Texts.size(); I++) {
+				if (!Texts[I].empty())
+					emit(OP_PRINTS, Texts[I].size(), { addString(Texts[I]) });
+				if (I < Vals.size())
+					emit(OP_PRINTI, Vals[I]);
+			}
+			break;
+		}
+		case StatAST::SK_If: {
+			auto *I = cast<IfStatAST>(S);
+			uint32_t ToElse = branch(I->getCond(), false);
+			stat(I->getThen());
+			if (I->getElse()) {
+				emit(OP_JMP, 0, { 0 });
+				uint32_t ToEnd = here() - 1;
+				patch(ToElse);
+				stat(I->getElse());
+				patch(ToEnd);
+			}
+			else
+				patch(ToElse);
+			break;
+		}
+		case StatAST::SK_While: {
+			//条件放在循环体之后,每次迭代只有一条条件跳转
+			auto *W = cast<WhileStatAST>(S);
+			emit(OP_JMP, 0, { 0 });
+			uint32_t ToCond = here() - 1;
+			uint32_t Body = here();
+			stat(W->getBody());
+			patch(ToCond);
+			Code[branch(W->getCond(), true)] = Body;
+			break;
+		}
+		case StatAST::SK_Ret: {
+			StatAST *Val = cast<RetStatAST>(S)->getVal();
+			if (auto *Call = dyn_cast<CallExprAST>(Val)) {
+				uint32_t F, ArgBase;
+				if (call(Call, F, ArgBase)) {
+					emit(OP_TAILCALL, 0, { F, ArgBase });
+					++Stats.TailCalls;
+				}
+				break;
+			}
+			emit(OP_RET, expr(Val));
+			break;
+		}
+		default:
+			//单独的表达式作为语句
+			expr(S);
+			break;
+		}
+		Top = Mark;
+	}
+
+	void function(FunctionAST *FnAST, uint32_t Index) {
+		PrototypeAST *P = FnAST->getProto();
+		CurFunc = Index;
+		NamedValues.clear();
+		Vars.assign(1, VarInfo());
+		Top = FrameSize = 0;
+		for (unsigned Arg : P->getArgs()) {
+			VarInfo V = { newReg(), 0 };
+			Vars.push_back(V);
+			NamedValues.bind(Arg, Vars.size() - 1);
+		}
+		Funcs[Index].Entry = here();
+		stat(FnAST->getBody());
+		//如果函数没有返回语句,返回 0
+		uint32_t R = newReg();
+		emit(OP_LOADK, R, { 0 });
+		emit(OP_RET, R);
+		Funcs[Index].FrameSize = FrameSize;
+	}
+
+public:
+	//翻译整个程序,有错误时返回 false
+	bool compile(ArrayRef<FunctionAST *> Functions) {
+		for (FunctionAST *FnAST : Functions) {
+			PrototypeAST *P = FnAST->getProto();
+			if (!FuncIndex.insert(std::make_pair(P->getSym(), (uint32_t)Funcs.size())).second) {
+				error("Function cannot be redefined.");
+				continue;
+			}
+			StringRef Name = Symbols.getName(P->getSym());
+			if (Name == "main")
+				MainFunc = Funcs.size();
+			VMFunction F = { 0, (uint32_t)P->getArgs().size(), 0, addString(Name), (uint32_t)Name.size() };
+			Funcs.push_back(F);
+			function(FnAST, Funcs.size() - 1);
+		}
+		if (MainFunc == UINT32_MAX)
+			error("main is not defined");
+		Stats.Functions = Funcs.size();
+		return !Failed;
+	}
+
+	//映像:头部、函数表、代码、文本
+	std::string getImage() const {
+		VMImageHeader H;
+		memcpy(H.Magic, VMMagic, 4);
+		H.Version = VMVersion;
+		H.NumFuncs = Funcs.size();
+		H.MainFunc = MainFunc;
+		H.FuncsOffset = sizeof(VMImageHeader);
+		H.CodeOffset = H.FuncsOffset + Funcs.size() * sizeof(VMFunction);
+		H.CodeWords = Code.size();
+		H.StringsOffset = H.CodeOffset + Code.size() * 4;
+		H.StringsSize = Strings.size();
+
+		std::string Image((const char *)&H, sizeof(H));
+		Image.append((const char *)Funcs.data(), Funcs.size() * sizeof(VMFunction));
+		Image.append((const char *)Code.data(), Code.size() * 4);
+		Image += Strings;
+		return Image;
+	}
+
+	bool writeImage(const char *FileName) {
+		std::string Image = getImage();
+		Stats.ImageBytes = Image.size();
+		std::ofstream OS(FileName, std::ios::binary);
+		OS.write(Image.data(), Image.size());
+		return (bool)OS;
+	}
+};
+
+#endif
@@ -0,0 +1,769 @@
+#ifndef __COMPILERINSTANCE_H__
+#define __COMPILERINSTANCE_H__
+#include "AST.h"
+#include "BytecodeGen.h"
+#include "FlatAST.h"
+#include "JITCache.h"
+#include "Lexer.h"
+#include "Memoize.h"
+#include "Parser.h"
+#include "Simplify.h"
+#include "Specialize.h"
+#include "TailRec.h"
+#include "Tier.h"
+#include "VSLJIT.h"
+#include "VSLRuntime.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/ProfileData/InstrProf.h"
+#include "llvm/ProfileData/ProfileCommon.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+using namespace llvm;
+
+//编译选项
+struct CompilerOptions {
+	bool EmitIR = false;	//-r: 将 IR 输出到 IRCode.ll
+	bool EmitObj = false;	//-obj: 只生成 .o 文件,不运行代码
+	bool PrintStats = false;	//-stats: 输出编译过程的统计信息
+	bool UseFlatAST = false;	//-flat: 用下标式语法树生成代码
+	unsigned NumThreads = 1;	//语法分析和代码生成使用的线程数
+	unsigned OptLevel = 0;	//-O0~-O3: 优化级别
+	bool Simplify = true;	//-no-simplify 关闭: 生成代码前化简语法树
+	bool TailRec = true;	//-no-tailrec 关闭: 把尾递归变成循环
+	bool Specialize = true;	//-no-specialize 关闭: 为常量实参的调用生成特化的函数副本
+	int LoopUnroll = -1;	//-loop-unroll[=N]: 循环展开提示,见 CreateLoopMetadata
+	int LoopVectorize = -1;	//-loop-vectorize[=N]: 循环向量化提示
+	bool SSA = false;	//-ssa: 生成代码时直接构造 SSA,不经过 alloca 和 mem2reg
+	bool Memoize = false;	//-memoize[=N]: 缓存纯的递归函数的结果
+	unsigned MemoCacheSize = 4096;	//每个记忆化函数的缓存项数,向上取为 2 的幂
+	bool ProfileGenerate = false;	//-fprofile-generate[=file]: 插入计数器,main 返回后写出剖析文件
+	bool ProfileUse = false;	//-fprofile-use[=file]: 按剖析文件设置分支权重和函数入口计数
+	std::string ProfileFile = "default.vslprof";
+	bool LazyJIT = false;	//-lazy: 每个函数在第一次被调用时才生成机器码
+	unsigned TierThreshold = 0;	//-tier[=N]: 分层执行,函数的入口和回边计数达到 N 时生成优化的代码
+	bool EmitBytecode = false;	//-bc: 只生成字节码文件 output.vslbc(由 vslvm 运行),不经过 LLVM
+	bool UseCache = false;	//-cache[=dir]: 把 JIT 生成的目标文件缓存在磁盘上,源程序和选项相同时直接装入
+	std::string CacheDir;	//为空时为 DefaultCacheDir()
+	unsigned CacheSizeMB = 64;	//-cache-size=N: 缓存目录的大小上限(MB)
+};
+
+//与优化级别对应的机器码生成级别
+static CodeGenOpt::Level GetCodeGenOptLevel(unsigned OptLevel)
+{
+	switch (OptLevel) {
+	case 0: return CodeGenOpt::None;
+	case 1: return CodeGenOpt::Less;
+	case 2: return CodeGenOpt::Default;
+	default: return CodeGenOpt::Aggressive;
+	}
+}
+
+//JIT 中按名字找到 VSLRuntime.h 中的运行时函数
+static void RegisterRuntimeSymbols()
+{
+	static std::once_flag Once;
+	std::call_once(Once, []() {
+		sys::DynamicLibrary::AddSymbol("vsl_print_str", (void *)&vsl_print_str);
+		sys::DynamicLibrary::AddSymbol("vsl_print_int", (void *)&vsl_print_int);
+		sys::DynamicLibrary::AddSymbol("vsl_flush", (void *)&vsl_flush);
+	});
+}
+
+//一次编译的全部状态:源文件、符号表、语法树内存池和代码生成状态。
+//各个 CompilerInstance 之间没有共享的可变状态,同一进程中可以
+//先后或在多个线程上同时进行任意多次互相独立的编译
+//(进程级的 LLVM 目标初始化仍由调用者在开始前完成一次)。
+class CompilerInstance {
+public:
+	CompilerOptions Opts;
+	StringInterner Symbols;
+	std::unique_ptr<MemoryBuffer> SourceBuffer;	//映射到内存的输入文件
+	std::vector<std::unique_ptr<ASTContext>> ASTPools;	//本次编译的所有语法树内存池
+	std::vector<FunctionAST *> Functions;	//按源文件顺序的所有函数
+	CodeGenContext CG;
+	std::vector<std::unique_ptr<CodeGenContext>> WorkerCGs;	//并行生成代码时每个线程的上下文和模块
+	SimplifyStats SimpStats;
+	TailRecStats TRStats;
+	SpecializeStats SpecStats;
+	MemoizeStats MemoStats;
+	unsigned NumParseErrors = 0;	//本次编译中语法分析报告的错误数,代码生成的在 CG.NumErrors 中
+	double ParseMs = 0, CodegenMs = 0;
+	double JitMs = 0, RunMs = 0;	//生成机器码并找到 main 的时间,main 的运行时间
+	size_t NumJITFunctions = 0;	//加入 JIT 的模块中定义的函数数
+	unsigned TierOptLevel = 0;	//-tier 时优化代码的级别,基线层总是 -O0
+	std::vector<unsigned> TieredFunctions;	//-tier 时插入了计数器、经由桩调用的函数
+	std::unique_ptr<TierManager> Tier;	//须在 JIT 之后释放,其中的上下文是 JIT 中模块的上下文
+	size_t InstsBeforeOpt = 0, InstsAfterOpt = 0;	//优化前后的 IR 指令数
+	size_t NumPhis = 0, NumTrivialPhis = 0;	//-ssa 时插入和删去的 phi
+	StringMap<std::vector<uint64_t>> Profile;	//-fprofile-use 读入的剖析
+	std::unique_ptr<ProfileSummary> ProfSummary;
+	std::vector<std::pair<std::string, unsigned>> ProfiledFunctions;	//-fprofile-generate 的计数器数组
+	std::unique_ptr<JITObjectCache> Cache;	//-cache 时的目标文件缓存,须在 JIT 之后释放
+	//运行 main 的 ORC JIT,须先于 CG 释放;EngineName 为实际运行 main 的引擎,没有运行时为空
+	std::unique_ptr<orc::VSLJIT> JIT;
+	const char *EngineName = nullptr;
+
+	CompilerInstance(const CompilerOptions &Opts)
+		: Opts(Opts), CG(Symbols, "test") {
+		if (this->Opts.TierThreshold && (Opts.LazyJIT || Opts.ProfileGenerate || Opts.EmitObj ||
+			Opts.EmitBytecode)) {
+			errs() << "warning: -tier is ignored with -lazy, -fprofile-generate, -obj and -bc\n";
+			this->Opts.TierThreshold = 0;
+		}
+		//分层执行时程序以 -O0 生成,-O 指定的级别(默认 -O2)用于升级的函数
+		if (this->Opts.TierThreshold) {
+			TierOptLevel = Opts.OptLevel ? Opts.OptLevel : 2;
+			this->Opts.OptLevel = 0;
+		}
+		//缓存的是一次生成的整个程序的目标文件,不运行或另外生成代码时不使用
+		if (Opts.UseCache && (Opts.EmitIR || Opts.EmitObj || Opts.EmitBytecode || Opts.LazyJIT ||
+			this->Opts.TierThreshold || Opts.ProfileGenerate)) {
+			errs() << "warning: -cache is ignored with -r, -obj, -bc, -lazy, -tier and -fprofile-generate\n";
+			this->Opts.UseCache = false;
+		}
+		initCodeGen(CG, this->Opts.OptLevel);
+	}
+
+	//按编译选项和优化级别初始化一个代码生成上下文
+	void initCodeGen(CodeGenContext &C, unsigned OptLevel) {
+		InitializeModuleAndPassManager(C, OptLevel);
+		C.LoopUnroll = Opts.LoopUnroll;
+		C.LoopVectorize = Opts.LoopVectorize;
+		C.UseSSA = Opts.SSA;
+		C.MemoCacheSize = PowerOf2Ceil(std::max(Opts.MemoCacheSize, MemoProbes));
+		C.ProfileGenerate = Opts.ProfileGenerate;
+		C.TierThreshold = Opts.TierThreshold;
+		initProfile(C);
+	}
+
+	//已读入剖析时交给代码生成上下文,模块中记录剖析摘要
+	void initProfile(CodeGenContext &C) {
+		if (!ProfSummary)
+			return;
+		C.ProfileData = &Profile;
+		C.TheModule->setProfileSummary(ProfSummary->getMD(C.TheContext));
+	}
+
+	//剖析文件:以 # 开头的行是注释,其余每行为 "计数器数组名 个数 计数..."
+	bool writeProfile() {
+		std::ofstream OS(Opts.ProfileFile);
+		if (!OS)
+			return false;
+		OS << "# VSL profile: entry, then (executions, taken) of each IF and WHILE condition\n";
+		for (auto &P : ProfiledFunctions) {
+			auto *Counts = (const uint64_t *)getSymbolAddress(P.first);
+			if (!Counts)
+				continue;
+			//去掉数组名末尾的 ".prof",文件中记录函数名
+			OS << StringRef(P.first).drop_back(5).str() << ' ' << P.second;
+			for (unsigned I = 0; I < P.second; I++)
+				OS << ' ' << Counts[I];
+			OS << '\n';
+		}
+		return (bool)OS;
+	}
+
+	//读入剖析文件并建立整个程序的剖析摘要,优化时据此判断冷热
+	bool readProfile() {
+		std::ifstream IS(Opts.ProfileFile);
+		if (!IS)
+			return false;
+		InstrProfSummaryBuilder Builder(ProfileSummaryBuilder::DefaultCutoffs);
+		std::string Line;
+		while (std::getline(IS, Line)) {
+			if (Line.empty() || Line[0] == '#')
+				continue;
+			std::istringstream LS(Line);
+			std::string Name;
+			unsigned N = 0;
+			LS >> Name >> N;
+			InstrProfRecord R;
+			R.Counts.resize(N);
+			for (unsigned I = 0; I < N; I++)
+				LS >> R.Counts[I];
+			if (!LS || N == 0)
+				return false;
+			Builder.addRecord(R);
+			Profile[Name] = std::move(R.Counts);
+		}
+		ProfSummary = Builder.getSummary();
+		return true;
+	}
+
+	/*
+	*将输入文件映射到内存
+	*/
+	bool openSource(const char *FileName) {
+		//较大的文件由 MemoryBuffer 直接 mmap,不需要结尾的 '\0'
+		auto BufOrErr = MemoryBuffer::getFile(FileName, -1, false);
+		if (!BufOrErr)
+			return false;
+		SourceBuffer = std::move(*BufOrErr);
+		return SourceBuffer->getBufferSize() <= UINT32_MAX;
+	}
+
+	//直接编译内存中的源程序(复制一份)
+	void setSource(StringRef Text, StringRef Name = "<memory>") {
+		SourceBuffer = MemoryBuffer::getMemBufferCopy(Text, Name);
+	}
+
+	//并行前端:按顶层 FUNC 把源文件切分成若干块,
+	//每个线程独立完成一块的词法和语法分析,结果按源文件顺序合并
+	std::vector<FunctionAST *> ParseProgramParallel(unsigned Threads) {
+		const char *Start = SourceBuffer->getBufferStart();
+		const char *End = SourceBuffer->getBufferEnd();
+		std::vector<const char *> Bounds = FindFuncBoundaries(Start, End);
+
+		//每个线程分到若干块,按字节数大致均分,便于负载均衡
+		std::vector<const char *> Chunks;
+		Chunks.push_back(Start);
+		size_t Target = (End - Start) / (Threads * 4) + 1;
+		for (const char *B : Bounds)
+			if (B - Chunks.back() >= (ptrdiff_t)Target)
+				Chunks.push_back(B);
+		Chunks.push_back(End);
+
+		size_t NumChunks = Chunks.size() - 1;
+		std::vector<std::vector<FunctionAST *>> Results(NumChunks);
+		std::atomic<size_t> NextChunk(0);
+
+		//每个线程使用自己的内存池,预先创建以免线程间竞争 ASTPools
+		unsigned NumWorkers = std::min<size_t>(Threads, NumChunks);
+		size_t FirstPool = ASTPools.size();
+		for (unsigned I = 0; I < NumWorkers; I++)
+			ASTPools.push_back(llvm::make_unique<ASTContext>());
+		std::atomic<unsigned> NextPool(0);
+		std::vector<SimplifyStats> WorkerStats(NumWorkers);
+		std::vector<unsigned> WorkerErrors(NumWorkers);
+
+		//化简也在各线程中进行,新节点从该线程的内存池分配
+		auto Worker = [&]() {
+			llvm::StringMap<unsigned> LocalSymbols;
+			Lexer Lex(Symbols, Start, &LocalSymbols);
+			unsigned Pool = NextPool++;
+			ASTContext &AST = *ASTPools[FirstPool + Pool];
+			Parser P(Lex, AST);
+			for (size_t I; (I = NextChunk++) < NumChunks;) {
+				Lex.lexRange(Chunks[I], Chunks[I + 1]);
+				P.ParseFunctions(Results[I]);
+				if (Opts.Simplify)
+					SimplifyFunctions(AST, Results[I], WorkerStats[Pool]);
+			}
+			WorkerErrors[Pool] = P.NumErrors;
+		};
+
+		std::vector<std::thread> Workers;
+		for (unsigned I = 1; I < NumWorkers; I++)
+			Workers.emplace_back(Worker);
+		Worker();
+		for (auto &T : Workers)
+			T.join();
+		for (auto &S : WorkerStats)
+			SimpStats += S;
+		for (unsigned E : WorkerErrors)
+			NumParseErrors += E;
+
+		std::vector<FunctionAST *> Functions;
+		for (auto &R : Results)
+			Functions.insert(Functions.end(), R.begin(), R.end());
+		return Functions;
+	}
+
+	//program ::= function_list
+	void parse() {
+		ASTPools.push_back(llvm::make_unique<ASTContext>());
+		if (Opts.NumThreads > 1)
+			Functions = ParseProgramParallel(Opts.NumThreads);
+		else {
+			Lexer Lex(Symbols);
+			Lex.lexBuffer(SourceBuffer->getBufferStart(), SourceBuffer->getBufferEnd());
+			Parser P(Lex, *ASTPools.front());
+			P.ParseFunctions(Functions);
+			NumParseErrors += P.NumErrors;
+			if (Opts.Simplify)
+				SimplifyFunctions(*ASTPools.front(), Functions, SimpStats);
+		}
+		//以下各步需要整个程序,在合并各线程的结果之后进行。
+		//特化会复制函数体,尾递归标记在其后进行,每个副本有自己的标记
+		if (Opts.Specialize)
+			SpecializeFunctions(*ASTPools.front(), Symbols, Functions, SpecStats);
+		if (Opts.TailRec)
+			MarkTailRecursion(Functions, TRStats);
+		if (Opts.Memoize)
+			MarkMemoization(Functions, MemoStats);
+	}
+
+	void codegen() {
+		if (Opts.ProfileUse) {
+			if (readProfile())
+				initProfile(CG);
+			else
+				errs() << "warning: cannot read profile " << Opts.ProfileFile << ", ignored\n";
+		}
+
+		std::unique_ptr<FlatAST> Flat;
+		if (Opts.UseFlatAST) {
+			Flat = llvm::make_unique<FlatAST>();
+			Flat->reserve(ASTPools.front()->getNumAllocs());
+			for (FunctionAST *FnAST : Functions)
+				Flat->addFunction(FnAST);
+		}
+
+		if (Opts.NumThreads > 1 && Functions.size() > 1)
+			codegenParallel(Opts.NumThreads, Flat.get());
+		else if (Flat) {
+			FlatCodeGen FCG(CG, *Flat);
+			for (size_t I = 0; I < Flat->getNumFunctions(); I++)
+				FCG.emitFunction(I);
+		}
+		else {
+			for (FunctionAST *FnAST : Functions)
+				FnAST->codegen(CG);
+		}
+		OptimizeModule(CG);
+
+		InstsBeforeOpt = CG.InstsBeforeOpt;
+		InstsAfterOpt = CountInstructions(*CG.TheModule);
+		NumPhis = CG.SSA.NumPhis;
+		NumTrivialPhis = CG.SSA.NumTrivialPhis;
+		ProfiledFunctions = CG.ProfiledFunctions;
+		TieredFunctions = CG.TieredFunctions;
+		for (auto &W : WorkerCGs) {
+			InstsBeforeOpt += W->InstsBeforeOpt;
+			InstsAfterOpt += CountInstructions(*W->TheModule);
+			NumPhis += W->SSA.NumPhis;
+			NumTrivialPhis += W->SSA.NumTrivialPhis;
+			ProfiledFunctions.insert(ProfiledFunctions.end(), W->ProfiledFunctions.begin(),
+				W->ProfiledFunctions.end());
+			TieredFunctions.insert(TieredFunctions.end(), W->TieredFunctions.begin(),
+				W->TieredFunctions.end());
+		}
+
+		//输出 IR 或目标文件需要一个完整的模块,缓存中每个程序也只有一个目标文件
+		if (Opts.EmitIR || Opts.EmitObj || Opts.UseCache)
+			linkWorkerModules();
+		if (Opts.EmitIR)
+			emitIRFile("IRCode.ll");
+	}
+
+	//并行生成代码:函数按源文件顺序平均分成 Threads 段,每个线程在自己的
+	//LLVMContext/Module 中生成并优化一段,调用其他线程生成的函数时只生成声明。
+	//语法树、符号表和原型表在此期间只读。
+	//模块级优化也在各线程的模块上分别进行,所以不会跨段内联
+	void codegenParallel(unsigned Threads, const FlatAST *Flat) {
+		size_t N = Functions.size();
+		Threads = std::min<size_t>(Threads, N);
+
+		std::vector<std::pair<size_t, PrototypeAST *>> Protos(Symbols.size());
+		std::vector<bool> Skip(N);
+		for (size_t I = 0; I < N; I++) {
+			PrototypeAST *P = Functions[I]->getProto();
+			if (Protos[P->getSym()].second) {
+				CG.LogErrorV("Function cannot be redefined.");
+				Skip[I] = true;
+				continue;
+			}
+			Protos[P->getSym()] = std::make_pair(I, P);
+		}
+
+		//TargetMachine 不是线程安全的,每个线程的上下文在这里各自创建一个
+		WorkerCGs.clear();
+		for (unsigned W = 0; W < Threads; W++) {
+			WorkerCGs.push_back(llvm::make_unique<CodeGenContext>(Symbols,
+				(CG.TheModule->getName() + "." + Twine(W)).str()));
+			initCodeGen(*WorkerCGs.back(), Opts.OptLevel);
+		}
+
+		auto Worker = [&](unsigned W) {
+			CodeGenContext &WCG = *WorkerCGs[W];
+			WCG.SharedProtos = &Protos;
+			std::unique_ptr<FlatCodeGen> FCG;
+			if (Flat)
+				FCG = llvm::make_unique<FlatCodeGen>(WCG, *Flat);
+			for (size_t I = N * W / Threads, E = N * (W + 1) / Threads; I < E; I++) {
+				if (Skip[I])
+					continue;
+				WCG.CurFunc = I;
+				if (FCG)
+					FCG->emitFunction(I);
+				else
+					Functions[I]->codegen(WCG);
+			}
+			OptimizeModule(WCG);
+		};
+
+		std::vector<std::thread> Workers;
+		for (unsigned W = 1; W < Threads; W++)
+			Workers.emplace_back(Worker, W);
+		Worker(0);
+		for (auto &T : Workers)
+			T.join();
+		//各线程的上下文在合并模块时释放,错误数先记到主上下文中
+		for (auto &W : WorkerCGs)
+			CG.NumErrors += W->NumErrors;
+	}
+
+	//把各线程的模块按顺序合并到主模块;
+	//不同 LLVMContext 之间不能直接链接,经由 bitcode 转到主模块的上下文中
+	void linkWorkerModules() {
+		for (auto &W : WorkerCGs) {
+			SmallVector<char, 0> Buffer;
+			raw_svector_ostream OS(Buffer);
+			WriteBitcodeToFile(W->TheModule, OS);
+			W.reset();
+
+			auto M = parseBitcodeFile(MemoryBufferRef(StringRef(Buffer.data(), Buffer.size()),
+				"worker"), CG.TheContext);
+			if (!M) {
+				logAllUnhandledErrors(M.takeError(), errs(), "link: ");
+				continue;
+			}
+			if (Linker::linkModules(*CG.TheModule, std::move(*M)))
+				errs() << "link: cannot link worker module\n";
+		}
+		WorkerCGs.clear();
+	}
+
+	void emitIRFile(const char *FileName) {
+		std::error_code EC;
+		raw_fd_ostream IRFile(FileName, EC, sys::fs::F_None);
+		if (EC) {
+			errs() << "Could not open file: " << EC.message();
+			return;
+		}
+		CG.TheModule->print(IRFile, nullptr);
+		IRFile << "\n";
+	}
+
+	//JIT 中已生成代码的全局变量或函数的地址,找不到时为 0
+	uint64_t getSymbolAddress(const std::string &Name) {
+		if (!JIT)
+			return 0;
+		auto Sym = JIT->findSymbol(Name);
+		if (!Sym) {
+			consumeError(Sym.takeError());
+			return 0;
+		}
+		auto Addr = Sym.getAddress();
+		if (!Addr) {
+			consumeError(Addr.takeError());
+			return 0;
+		}
+		return *Addr;
+	}
+
+	//用 ORC JIT 生成机器码,通过 int (*)() 类型的函数指针直接调用 main。
+	//不经过 ExecutionEngine::runFunction 和 GenericValue,也不会退回到解释器
+	void run() {
+		//main 不在 JIT 中时 findSymbol 会找到宿主进程里的同名函数,先确认程序定义了 main
+		Function *F = CG.TheModule->getFunction("main");
+		bool HasMain = F && !F->isDeclaration();
+		for (auto &W : WorkerCGs)
+			if ((F = W->TheModule->getFunction("main")))
+				HasMain |= !F->isDeclaration();
+		if (!HasMain) {
+			errs() << "main is not defined\n";
+			return;
+		}
+		auto T0 = std::chrono::steady_clock::now();
+		RegisterRuntimeSymbols();
+		JIT = llvm::make_unique<orc::VSLJIT>(GetCodeGenOptLevel(Opts.OptLevel), Opts.LazyJIT, Cache.get());
+		if (Opts.TierThreshold)
+			startTiers();
+		//并行生成的各个模块分别加入,JIT 按名字解析模块之间的调用。
+		//-lazy 时这里只为每个函数生成间接跳转的桩,各模块的上下文要保留到 JIT 释放
+		NumJITFunctions = CountFunctions(*CG.TheModule);
+		JIT->addModule(std::move(CG.Owner));
+		for (auto &W : WorkerCGs) {
+			NumJITFunctions += CountFunctions(*W->TheModule);
+			JIT->addModule(std::move(W->Owner));
+		}
+		if (Tier) {
+			for (unsigned Sym : TieredFunctions) {
+				std::string Name = Symbols.getName(Sym).str();
+				JIT->updateStub(Name, getSymbolAddress(Name + ".tier0"));
+			}
+			//基线层的模块都已生成机器码,之后加入的是优化的代码
+			JIT->setOptLevel(GetCodeGenOptLevel(TierOptLevel));
+		}
+		if (!runMain(T0, JIT->isLazy() ? "ORC JIT (lazy)" : Tier ? "ORC JIT (tiered)" : "ORC JIT"))
+			return;
+		if (Opts.ProfileGenerate && !writeProfile())
+			errs() << "Could not write profile " << Opts.ProfileFile << "\n";
+	}
+
+	//找到 JIT 中 main 的地址并调用,T0 为开始生成机器码的时间
+	bool runMain(std::chrono::steady_clock::time_point T0, const char *Engine) {
+		auto *Main = (int (*)())getSymbolAddress("main");
+		auto T1 = std::chrono::steady_clock::now();
+		JitMs = std::chrono::duration<double, std::milli>(T1 - T0).count();
+		if (!Main) {
+			errs() << "JIT: cannot find the address of main\n";
+			return false;
+		}
+		EngineName = Engine;
+		if (Tier)
+			Tier->start();
+		Main();
+		if (Tier)
+			Tier->stop();
+		vsl_flush();
+		RunMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - T1).count();
+		return true;
+	}
+
+	//缓存的键中的选项:所有影响生成的代码的编译选项,以及 -fprofile-use 的剖析文件的内容
+	std::string cacheOptions() {
+		std::string Str;
+		raw_string_ostream OS(Str);
+		OS << "O" << Opts.OptLevel << " simplify=" << Opts.Simplify << " tailrec=" << Opts.TailRec
+			<< " specialize=" << Opts.Specialize << " unroll=" << Opts.LoopUnroll
+			<< " vectorize=" << Opts.LoopVectorize << " ssa=" << Opts.SSA << " flat=" << Opts.UseFlatAST
+			<< " memoize=" << Opts.Memoize << "/" << Opts.MemoCacheSize << " threads=" << Opts.NumThreads;
+		if (Opts.ProfileUse) {
+			OS << " profile=";
+			if (auto Buf = MemoryBuffer::getFile(Opts.ProfileFile))
+				OS << (*Buf)->getBuffer();
+		}
+		return OS.str();
+	}
+
+	//-cache:查找缓存,命中时把目标文件加入 JIT 并运行 main,不做分析和代码生成。
+	//未命中(或目标文件不能使用)时返回 false,由正常的编译过程生成并写入缓存
+	bool runFromCache() {
+		std::string Dir = Opts.CacheDir.empty() ? DefaultCacheDir() : Opts.CacheDir;
+		Cache = llvm::make_unique<JITObjectCache>(Dir, uint64_t(Opts.CacheSizeMB) << 20,
+			JITObjectCache::computeKey(SourceBuffer->getBuffer(), cacheOptions()));
+		auto Obj = Cache->lookup();
+		if (!Obj)
+			return false;
+		auto T0 = std::chrono::steady_clock::now();
+		RegisterRuntimeSymbols();
+		JIT = llvm::make_unique<orc::VSLJIT>(GetCodeGenOptLevel(Opts.OptLevel));
+		if (!JIT->addObject(std::move(Obj))) {
+			errs() << "warning: cached object " << Cache->getKey() << " is invalid, recompiling\n";
+			Cache->invalidate();
+			JIT.reset();
+			return false;
+		}
+		runMain(T0, "ORC JIT (cached object)");
+		return true;
+	}
+
+	void printCacheStats() {
+		auto T = Cache->getTotals();
+		auto Usage = Cache->getUsage();
+		if (Cache->Hit)
+			fprintf(stderr, "cache: hit %s in %s, parse and codegen skipped\n",
+				Cache->getKey().str().c_str(), Cache->getDir().str().c_str());
+		else
+			fprintf(stderr, "cache: miss %s in %s, stored %llu bytes, %llu evicted\n",
+				Cache->getKey().str().c_str(), Cache->getDir().str().c_str(),
+				(unsigned long long)Cache->StoredBytes, (unsigned long long)Cache->Evicted);
+		fprintf(stderr, "cache: %llu hits, %llu misses, %llu evictions in total; %zu objects, %llu of %llu bytes\n",
+			(unsigned long long)T.Hits, (unsigned long long)T.Misses, (unsigned long long)T.Evictions,
+			Usage.first, (unsigned long long)Usage.second, (unsigned long long)Cache->getMaxBytes());
+	}
+
+	//分层执行:插入了计数器的函数改为经由桩调用,建立升级的管理器。在模块加入 JIT 之前调用
+	void startTiers() {
+		std::vector<Module *> Modules(1, CG.TheModule);
+		for (auto &W : WorkerCGs)
+			Modules.push_back(W->TheModule);
+		for (unsigned Sym : TieredFunctions)
+			for (Module *M : Modules)
+				MoveToTier0(*M, Symbols.getName(Sym));
+
+		Tier = llvm::make_unique<TierManager>(*JIT, Symbols, Functions, [this](CodeGenContext &C) {
+			initCodeGen(C, TierOptLevel);
+			C.TierThreshold = 0;
+		});
+		JIT->addSymbol("vsl_tier_up", (JITTargetAddress)&TierManager::tierUp);
+		JIT->addSymbol("vsl.tier.manager", (JITTargetAddress)Tier.get());
+		//桩在基线层链接时就要存在,地址在基线层生成机器码后才知道
+		for (unsigned Sym : TieredFunctions)
+			JIT->createStub(Symbols.getName(Sym).str(), 0);
+	}
+
+	//main 返回后输出各个函数升级的时间
+	void printTierReport() {
+		auto &Records = Tier->getRecords();
+		fprintf(stderr, "tier: %zu of %zu functions hot (threshold %u), optimized at -O%u\n",
+			Records.size(), TieredFunctions.size(), Opts.TierThreshold, TierOptLevel);
+		for (auto &R : Records) {
+			std::string Name = Symbols.getName(R.Sym).str();
+			if (R.InstalledMs >= 0)
+				fprintf(stderr, "tier: %s hot at %.2f ms, optimized code installed at %.2f ms (compiled in %.2f ms)\n",
+					Name.c_str(), R.HotMs, R.InstalledMs, R.CompileMs);
+			else
+				fprintf(stderr, "tier: %s hot at %.2f ms, not optimized before main returned\n",
+					Name.c_str(), R.HotMs);
+		}
+	}
+
+	//运行结束后输出各个记忆化函数的缓存命中次数
+	void printMemoCounters() {
+		for (FunctionAST *F : Functions) {
+			if (!F->isMemoized())
+				continue;
+			std::string Name = Symbols.getName(F->getProto()->getSym()).str();
+			auto *Hits = (const uint64_t *)getSymbolAddress(Name + ".memo.hits");
+			auto *Misses = (const uint64_t *)getSymbolAddress(Name + ".memo.misses");
+			if (!Hits || !Misses)
+				continue;
+			uint64_t Calls = *Hits + *Misses;
+			fprintf(stderr, "memoize: %s: %llu hits, %llu misses (%.1f%% hit rate)\n", Name.c_str(),
+				(unsigned long long)*Hits, (unsigned long long)*Misses,
+				Calls ? 100.0 * *Hits / Calls : 0.0);
+		}
+	}
+
+	//生成目标文件,需要调用者已初始化所有目标
+	bool emitObjectFile(const char *Filename) {
+		auto TargetTriple = sys::getDefaultTargetTriple();
+		CG.TheModule->setTargetTriple(TargetTriple);
+
+		std::string Error;
+		auto Target = TargetRegistry::lookupTarget(TargetTriple, Error);
+
+		// Print an error and exit if we couldn't find the requested target.
+		// This generally occurs if we've forgotten to initialise the
+		// TargetRegistry or we have a bogus target triple.
+		if (!Target)
+		{
+			errs() << Error;
+			return false;
+		}
+
+		auto CPU = "generic";
+		auto Features = "";
+
+		TargetOptions opt;
+		auto RM = Optional<Reloc::Model>();
+		std::unique_ptr<TargetMachine> TheTargetMachine(
+			Target->createTargetMachine(TargetTriple, CPU, Features, opt, RM, None,
+				GetCodeGenOptLevel(Opts.OptLevel)));
+
+		CG.TheModule->setDataLayout(TheTargetMachine->createDataLayout());
+
+		std::error_code EC;
+		raw_fd_ostream dest(Filename, EC, sys::fs::F_None);
+
+		if (EC)
+		{
+			errs() << "Could not open file: " << EC.message();
+			return false;
+		}
+
+		legacy::PassManager pass;
+		auto FileType = TargetMachine::CGFT_ObjectFile;
+
+		if (TheTargetMachine->addPassesToEmitFile(pass, dest, FileType))
+		{
+			errs() << "TheTargetMachine can't emit a file of this type";
+			return false;
+		}
+
+		pass.run(*CG.TheModule);
+		dest.flush();
+
+		outs() << "Wrote " << Filename << "\n";
+		return true;
+	}
+
+	//把语法树翻译为字节码并写入 FileName
+	bool emitBytecodeFile(const char *FileName, BytecodeStats &Stats) {
+		BytecodeCompiler BC(Symbols);
+		bool OK = BC.compile(Functions);
+		if (OK && !BC.writeImage(FileName)) {
+			errs() << "Could not write " << FileName << "\n";
+			OK = false;
+		}
+		Stats = BC.Stats;
+		if (OK)
+			outs() << "Wrote " << FileName << "\n";
+		return OK;
+	}
+
+	//本次编译报告的错误数(各编译分别计数,不受同时进行的其他编译影响)
+	unsigned getNumErrors() const { return NumParseErrors + CG.NumErrors; }
+
+	//完整的编译过程:分析、生成代码,然后运行 main 或生成目标文件
+	int compile() {
+		if (Opts.UseCache && runFromCache()) {
+			if (Opts.PrintStats) {
+				if (EngineName)
+					fprintf(stderr, "engine: %s, main called natively (jit %.1f ms, run %.1f ms)\n",
+						EngineName, JitMs, RunMs);
+				printCacheStats();
+			}
+			return 0;
+		}
+		auto T0 = std::chrono::steady_clock::now();
+		parse();
+		auto T1 = std::chrono::steady_clock::now();
+		if (Opts.EmitBytecode) {
+			BytecodeStats BS;
+			bool OK = emitBytecodeFile("output.vslbc", BS);
+			if (Opts.PrintStats)
+				fprintf(stderr, "bytecode: %zu functions, %zu instructions (%zu superinstructions, %zu tail calls), %zu bytes\n",
+					BS.Functions, BS.Instructions, BS.SuperInsts, BS.TailCalls, BS.ImageBytes);
+			return OK ? 0 : 1;
+		}
+		codegen();
+		auto T2 = std::chrono::steady_clock::now();
+		ParseMs = std::chrono::duration<double, std::milli>(T1 - T0).count();
+		CodegenMs = std::chrono::duration<double, std::milli>(T2 - T1).count();
+		//有错误的程序不写入缓存,下次运行时仍然报告错误
+		if (Cache && getNumErrors())
+			Cache.reset();
+
+		if (!Opts.EmitObj)
+			run();
+		if (Opts.PrintStats) {
+			PrintASTStats(ASTPools);
+			fprintf(stderr, "time: parse %.1f ms, codegen %.1f ms (%zu functions, %u threads)\n",
+				ParseMs, CodegenMs, Functions.size(), Opts.NumThreads);
+			if (EngineName)
+				fprintf(stderr, "engine: %s, main called natively (jit %.1f ms, run %.1f ms)\n",
+					EngineName, JitMs, RunMs);
+			if (Tier)
+				printTierReport();
+			if (Cache)
+				printCacheStats();
+			if (JIT && JIT->isLazy())
+				fprintf(stderr, "lazy: %u of %zu functions compiled\n",
+					JIT->getNumCompiledFunctions(), NumJITFunctions);
+			fprintf(stderr, "simplify: %zu expressions folded, %zu branches pruned, %zu dead statements dropped\n",
+				SimpStats.FoldedExprs, SimpStats.PrunedBranches, SimpStats.DroppedStats);
+			fprintf(stderr, "specialize: %zu call sites redirected to %zu clones (%zu nodes)\n",
+				SpecStats.CallSites, SpecStats.Clones, SpecStats.ClonedNodes);
+			fprintf(stderr, "tailrec: %zu self-calls in %zu functions turned into loops\n",
+				TRStats.Calls, TRStats.Functions);
+			if (Opts.SSA)
+				fprintf(stderr, "ssa: %zu phis inserted, %zu trivial ones removed\n",
+					NumPhis, NumTrivialPhis);
+			if (Opts.Memoize) {
+				fprintf(stderr, "memoize: %zu pure functions, %zu recursive ones memoized (%u cache entries each)\n",
+					MemoStats.PureFunctions, MemoStats.Memoized, CG.MemoCacheSize);
+				if (JIT)
+					printMemoCounters();
+			}
+			fprintf(stderr, "IR: %zu instructions before optimization, %zu after (-O%u)\n",
+				InstsBeforeOpt, InstsAfterOpt, Opts.OptLevel);
+		}
+		if (Opts.EmitObj && !emitObjectFile("output.o"))
+			return 1;
+		return 0;
+	}
+};
+
+#endif
@@ -0,0 +1,319 @@
+#ifndef __FLATAST_H__
+#define __FLATAST_H__
+#include "AST.h"
+
+//下标式(扁平)语法树:所有节点按先序编号存放在若干平行数组中,
+//节点之间用下标而不是指针相连,父节点的编号总是小于子节点。
+//代码生成和各种分析都写成对节点种类的 switch,很多分析可以直接顺序扫描数组。
+class FlatAST
+{
+public:
+	typedef uint32_t NodeId;
+
+	//每个节点的字段,含义随种类不同:
+	//  Number: Val 为数值
+	//  Variable: Val 为变量的符号编号
+	//  Neg: 子节点为操作数
+	//  Binary: Val 为运算符,子节点为左右操作数
+	//  Call: Val 为函数的符号编号,子节点为实参
+	//  Dec: [Begin, Begin + Count) 是 Names 中的变量名;有数组时 Val 为 ArraySizes 中
+	//       对应的 Count 个元素个数的起始下标,否则为 -1
+	//  Block: Val 为变量声明的个数,子节点为先声明后语句
+	//  Print: Val 为 Texts 中的下标,从这里开始的 Count + 1 段文本分别在各表达式之前和最后输出,
+	//         子节点为输出的表达式
+	//  If: 子节点为条件、THEN 和可选的 ELSE
+	//  Ret: Val 为尾递归形式(StatAST::TailRecKind),子节点为返回值
+	//  Assign: Val 为变量的符号编号,子节点为右边的表达式
+	//  While: 子节点为条件和循环体
+	//  Index: Val 为数组的符号编号,子节点为下标
+	//  ArrayAssign: Val 为数组的符号编号,子节点为下标和右边的表达式
+	//其余节点的 [Begin, Begin + Count) 是 Children 中的子节点编号
+	std::vector<uint8_t> Kinds;
+	std::vector<int32_t> Vals;
+	std::vector<uint32_t> Begins;
+	std::vector<uint32_t> Counts;
+	std::vector<NodeId> Children;
+	std::vector<unsigned> Names;
+	std::vector<unsigned> ArraySizes;
+	std::vector<StringRef> Texts;
+
+	//第 I 个函数的原型、函数体、是否有尾递归、是否记忆化和是否为特化的副本
+	std::vector<PrototypeAST *> Protos;
+	std::vector<NodeId> Bodies;
+	std::vector<bool> TailRecs;
+	std::vector<bool> Memoized;
+	std::vector<bool> Specialized;
+
+	size_t size() const { return Kinds.size(); }
+	size_t getNumFunctions() const { return Protos.size(); }
+
+	StatAST::StatKind getKind(NodeId N) const { return (StatAST::StatKind)Kinds[N]; }
+	int32_t getVal(NodeId N) const { return Vals[N]; }
+
+	ArrayRef<NodeId> getChildren(NodeId N) const
+	{
+		return ArrayRef<NodeId>(Children).slice(Begins[N], Counts[N]);
+	}
+
+	NodeId getChild(NodeId N, unsigned I) const { return Children[Begins[N] + I]; }
+
+	ArrayRef<unsigned> getNames(NodeId N) const
+	{
+		return ArrayRef<unsigned>(Names).slice(Begins[N], Counts[N]);
+	}
+
+	ArrayRef<unsigned> getSizes(NodeId N) const
+	{
+		if (Vals[N] < 0)
+			return ArrayRef<unsigned>();
+		return ArrayRef<unsigned>(ArraySizes).slice(Vals[N], Counts[N]);
+	}
+
+	void reserve(size_t NumNodes)
+	{
+		Kinds.reserve(NumNodes);
+		Vals.reserve(NumNodes);
+		Begins.reserve(NumNodes);
+		Counts.reserve(NumNodes);
+		Children.reserve(NumNodes);
+	}
+
+	//把指针树表示的函数追加进来
+	void addFunction(FunctionAST *F)
+	{
+		Protos.push_back(F->getProto());
+		Bodies.push_back(flatten(F->getBody()));
+		TailRecs.push_back(F->hasTailRec());
+		Memoized.push_back(F->isMemoized());
+		Specialized.push_back(F->isSpecialized());
+	}
+
+private:
+	NodeId newNode(StatAST::StatKind Kind, int32_t Val)
+	{
+		Kinds.push_back(Kind);
+		Vals.push_back(Val);
+		Begins.push_back(0);
+		Counts.push_back(0);
+		return Kinds.size() - 1;
+	}
+
+	//先为父节点编号,子节点编号收集齐后再连续存入 Children
+	void setChildren(NodeId N, ArrayRef<StatAST *> Stats)
+	{
+		SmallVector<NodeId, 8> Ids;
+		for (StatAST *S : Stats)
+			Ids.push_back(flatten(S));
+		Begins[N] = Children.size();
+		Counts[N] = Ids.size();
+		Children.insert(Children.end(), Ids.begin(), Ids.end());
+	}
+
+	NodeId flatten(StatAST *S)
+	{
+		switch (S->getKind()) {
+		case StatAST::SK_Number:
+			return newNode(StatAST::SK_Number, cast<NumberExprAST>(S)->getVal());
+		case StatAST::SK_Variable:
+			return newNode(StatAST::SK_Variable, cast<VariableExprAST>(S)->getSym());
+		case StatAST::SK_Neg: {
+			NodeId N = newNode(StatAST::SK_Neg, 0);
+			StatAST *Ops[] = { cast<NegExprAST>(S)->getExpr() };
+			setChildren(N, Ops);
+			return N;
+		}
+		case StatAST::SK_Binary: {
+			auto *B = cast<BinaryExprAST>(S);
+			NodeId N = newNode(StatAST::SK_Binary, B->getOp());
+			StatAST *Ops[] = { B->getLHS(), B->getRHS() };
+			setChildren(N, Ops);
+			return N;
+		}
+		case StatAST::SK_Call: {
+			auto *C = cast<CallExprAST>(S);
+			NodeId N = newNode(StatAST::SK_Call, C->getCallee());
+			setChildren(N, C->getArgs());
+			return N;
+		}
+		case StatAST::SK_Null:
+			return newNode(StatAST::SK_Null, 0);
+		case StatAST::SK_Dec: {
+			ArrayRef<unsigned> VarNames = cast<DecAST>(S)->getVarNames();
+			ArrayRef<unsigned> Sizes = cast<DecAST>(S)->getSizes();
+			NodeId N = newNode(StatAST::SK_Dec, Sizes.empty() ? -1 : (int32_t)ArraySizes.size());
+			Begins[N] = Names.size();
+			Counts[N] = VarNames.size();
+			Names.insert(Names.end(), VarNames.begin(), VarNames.end());
+			ArraySizes.insert(ArraySizes.end(), Sizes.begin(), Sizes.end());
+			return N;
+		}
+		case StatAST::SK_Block: {
+			auto *B = cast<BlockStatAST>(S);
+			NodeId N = newNode(StatAST::SK_Block, B->getDecList().size());
+			SmallVector<StatAST *, 8> Stats(B->getDecList().begin(), B->getDecList().end());
+			Stats.append(B->getStatList().begin(), B->getStatList().end());
+			setChildren(N, Stats);
+			return N;
+		}
+		case StatAST::SK_Print: {
+			auto *P = cast<PrintStatAST>(S);
+			NodeId N = newNode(StatAST::SK_Print, Texts.size());
+			Texts.insert(Texts.end(), P->getTexts().begin(), P->getTexts().end());
+			setChildren(N, P->getExprs());
+			return N;
+		}
+		case StatAST::SK_If: {
+			auto *I = cast<IfStatAST>(S);
+			NodeId N = newNode(StatAST::SK_If, 0);
+			StatAST *Ops[] = { I->getCond(), I->getThen(), I->getElse() };
+			setChildren(N, makeArrayRef(Ops, I->getElse() ? 3 : 2));
+			return N;
+		}
+		case StatAST::SK_Ret: {
+			NodeId N = newNode(StatAST::SK_Ret, cast<RetStatAST>(S)->getTailRec());
+			StatAST *Ops[] = { cast<RetStatAST>(S)->getVal() };
+			setChildren(N, Ops);
+			return N;
+		}
+		case StatAST::SK_Assign: {
+			auto *A = cast<AssStatAST>(S);
+			NodeId N = newNode(StatAST::SK_Assign, A->getName()->getSym());
+			StatAST *Ops[] = { A->getExpr() };
+			setChildren(N, Ops);
+			return N;
+		}
+		case StatAST::SK_While: {
+			auto *W = cast<WhileStatAST>(S);
+			NodeId N = newNode(StatAST::SK_While, 0);
+			StatAST *Ops[] = { W->getCond(), W->getBody() };
+			setChildren(N, Ops);
+			return N;
+		}
+		case StatAST::SK_Index: {
+			auto *I = cast<IndexExprAST>(S);
+			NodeId N = newNode(StatAST::SK_Index, I->getSym());
+			StatAST *Ops[] = { I->getIndex() };
+			setChildren(N, Ops);
+			return N;
+		}
+		case StatAST::SK_ArrayAssign: {
+			auto *A = cast<ArrayAssStatAST>(S);
+			NodeId N = newNode(StatAST::SK_ArrayAssign, A->getSym());
+			StatAST *Ops[] = { A->getIndex(), A->getExpr() };
+			setChildren(N, Ops);
+			return N;
+		}
+		}
+		llvm_unreachable("unknown statement kind");
+	}
+};
+
+//下标式语法树的代码生成,与各节点的 codegen() 共用 AST.h 中的 Emit* 函数
+class FlatCodeGen
+{
+	CodeGenContext &CG;
+	const FlatAST &AST;
+
+public:
+	FlatCodeGen(CodeGenContext &CG, const FlatAST &AST) : CG(CG), AST(AST) {}
+
+	Value *emit(FlatAST::NodeId N)
+	{
+		switch (AST.getKind(N)) {
+		case StatAST::SK_Number:
+			return ConstantInt::get(CG.TheContext, APInt(32, AST.getVal(N), true));
+		case StatAST::SK_Variable:
+			return EmitVariable(CG, AST.getVal(N));
+		case StatAST::SK_Neg: {
+			Value *V = emit(AST.getChild(N, 0));
+			if (!V)
+				return nullptr;
+			return CG.Builder.CreateNeg(V);
+		}
+		case StatAST::SK_Binary: {
+			Value *L = emit(AST.getChild(N, 0));
+			Value *R = emit(AST.getChild(N, 1));
+			if (!L || !R)
+				return nullptr;
+			return EmitBinary(CG, AST.getVal(N), L, R);
+		}
+		case StatAST::SK_Call:
+			return EmitCall(CG, AST.getVal(N), AST.Counts[N],
+				[&](unsigned I) { return emit(AST.getChild(N, I)); });
+		case StatAST::SK_Null:
+			return CG.Builder.getInt32(0);
+		case StatAST::SK_Dec:
+			EmitDec(CG, AST.getNames(N), AST.getSizes(N));
+			return nullptr;
+		case StatAST::SK_Block:
+			CG.NamedValues.pushScope();
+			for (FlatAST::NodeId C : AST.getChildren(N))
+				emit(C);
+			CG.NamedValues.popScope();
+			return CG.Builder.getInt32(0);
+		case StatAST::SK_Print:
+			return EmitPrint(CG, ArrayRef<StringRef>(AST.Texts).slice(AST.getVal(N), AST.Counts[N] + 1),
+				AST.Counts[N],
+				[&](unsigned I) { return emit(AST.getChild(N, I)); });
+		case StatAST::SK_If:
+			return EmitIf(CG, [&]() { return emit(AST.getChild(N, 0)); },
+				[&]() { return emit(AST.getChild(N, 1)); },
+				[&]() { return emit(AST.getChild(N, 2)); }, AST.Counts[N] == 3);
+		case StatAST::SK_Ret:
+			if (AST.getVal(N) != StatAST::TR_None && CG.TailRecHeader)
+				return emitTailRec(N);
+			if (Value *RetVal = emit(AST.getChild(N, 0)))
+				return EmitRet(CG, RetVal);
+			return nullptr;
+		case StatAST::SK_Assign: {
+			Value *EValue = emit(AST.getChild(N, 0));
+			if (!EValue)
+				return nullptr;
+			return EmitAssign(CG, AST.getVal(N), EValue);
+		}
+		case StatAST::SK_While:
+			return EmitWhile(CG, [&]() { return emit(AST.getChild(N, 0)); },
+				[&]() { return emit(AST.getChild(N, 1)); });
+		case StatAST::SK_Index: {
+			Value *Idx = emit(AST.getChild(N, 0));
+			if (!Idx)
+				return nullptr;
+			return EmitIndex(CG, AST.getVal(N), Idx);
+		}
+		case StatAST::SK_ArrayAssign: {
+			Value *Idx = emit(AST.getChild(N, 0));
+			if (!Idx)
+				return nullptr;
+			Value *EValue = emit(AST.getChild(N, 1));
+			if (!EValue)
+				return nullptr;
+			return EmitArrayAssign(CG, AST.getVal(N), Idx, EValue);
+		}
+		}
+		llvm_unreachable("unknown statement kind");
+	}
+
+	//RETURN f(...), RETURN f(...) op e 或 RETURN e op f(...)
+	Value *emitTailRec(FlatAST::NodeId N)
+	{
+		auto Kind = (StatAST::TailRecKind)AST.getVal(N);
+		FlatAST::NodeId Val = AST.getChild(N, 0), Call = Val, E = 0;
+		char Op = 0;
+		if (Kind != StatAST::TR_Call) {
+			Op = AST.getVal(Val);
+			Call = AST.getChild(Val, Kind == StatAST::TR_CallLeft ? 0 : 1);
+			E = AST.getChild(Val, Kind == StatAST::TR_CallLeft ? 1 : 0);
+		}
+		return EmitTailRec(CG, Kind, Op, [&]() { return emit(E); }, AST.Counts[Call],
+			[&](unsigned I) { return emit(AST.getChild(Call, I)); });
+	}
+
+	Function *emitFunction(size_t I)
+	{
+		FlatAST::NodeId Body = AST.Bodies[I];
+		return EmitFunction(CG, AST.Protos[I], [&]() { return emit(Body); }, AST.TailRecs[I],
+			AST.Memoized[I], AST.Specialized[I]);
+	}
+};
+
+#endif
@@ -0,0 +1,225 @@
+#ifndef __INCREMENTAL_H__
+#define __INCREMENTAL_H__
+#include "Parser.h"
+#include "llvm/ADT/Hashing.h"
+
+//增量前端:供编辑器/LSP 使用。
+//源文件按顶层 FUNC 切分为若干单元,每个单元保存自己的文本、单词数组和语法树;
+//编辑只修改受影响单元的文本,并只重新分析这些单元,报告哪些函数发生了变化。
+class IncrementalFrontend
+{
+	struct Unit
+	{
+		size_t Begin;	//在整个源文件中的起始位置
+		size_t Hash;	//单元文本的哈希,用于判断函数是否真的改变
+		std::string Text;
+		std::vector<TokenRec> Toks;	//偏移相对于 Text
+		std::unique_ptr<ASTContext> AST;	//重新分析时整个释放
+		std::vector<FunctionAST *> Functions;
+	};
+
+	std::vector<Unit> Units;
+	size_t Size = 0;	//整个源文件的长度
+	StringInterner Symbols;	//所有单元共用的符号表
+
+	//包含位置 Pos 的单元
+	size_t unitAt(size_t Pos) const
+	{
+		size_t Lo = 0, Hi = Units.size();
+		while(Hi - Lo > 1)
+		{
+			size_t Mid = (Lo + Hi) / 2;
+			if(Units[Mid].Begin <= Pos)
+				Lo = Mid;
+			else
+				Hi = Mid;
+		}
+		return Lo;
+	}
+
+	static bool startsWithFunc(const std::string &S)
+	{
+		return S.compare(0, 4, "FUNC") == 0 && (S.size() == 4 || !isIdentChar(S[4]));
+	}
+
+	void parseUnit(Unit &U)
+	{
+		U.Hash = llvm::hash_value(U.Text);
+		U.Functions.clear();
+		U.AST = llvm::make_unique<ASTContext>();
+		Lexer Lex(Symbols);
+		Lex.lexBuffer(U.Text.data(), U.Text.data() + U.Text.size());
+		Parser P(Lex, *U.AST);
+		P.ParseFunctions(U.Functions);
+		U.Toks.swap(Lex.Tokens);
+	}
+
+	//把 Region 按 Starts 切分为新的单元并分析,Begin 为 Region 在源文件中的位置
+	std::vector<Unit> buildUnits(const std::string &Region,
+		const std::vector<size_t> &Starts, size_t Begin)
+	{
+		std::vector<Unit> NewUnits(Starts.size());
+		for(size_t I = 0; I < Starts.size(); I++)
+		{
+			size_t End = I + 1 < Starts.size() ? Starts[I + 1] : Region.size();
+			NewUnits[I].Begin = Begin + Starts[I];
+			NewUnits[I].Text = Region.substr(Starts[I], End - Starts[I]);
+			parseUnit(NewUnits[I]);
+		}
+		return NewUnits;
+	}
+
+	//Region 中除开头以外的所有 FUNC 位置;扫描越过 StopAt 时返回 false
+	static bool findStarts(const std::string &Region, size_t From, size_t StopAt,
+		std::vector<size_t> &Starts, size_t &Resume)
+	{
+		std::vector<const char *> Bounds;
+		const char *B = Region.data();
+		const char *P = ScanFuncBoundaries(B + From, B + Region.size(), B + StopAt, Bounds);
+		for(const char *Bound : Bounds)
+			if(Bound != B)
+				Starts.push_back(Bound - B);
+		Resume = P - B;
+		return Resume == StopAt;
+	}
+
+	static unsigned unitName(const Unit &U)
+	{
+		if(U.Functions.empty() || !U.Functions.front()->getProto())
+			return ~0u;
+		return U.Functions.front()->getProto()->getSym();
+	}
+
+public:
+	//一次编辑涉及的函数(符号编号)
+	struct EditResult
+	{
+		std::vector<unsigned> Changed;
+		std::vector<unsigned> Added;
+		std::vector<unsigned> Removed;
+		size_t UnitsReparsed = 0;
+	};
+
+	//完整分析整个源文件
+	void reset(llvm::StringRef Source)
+	{
+		std::string Region = Source.str();
+		std::vector<size_t> Starts(1, 0);
+		size_t Resume;
+		findStarts(Region, 0, Region.size(), Starts, Resume);
+		Units = buildUnits(Region, Starts, 0);
+		Size = Region.size();
+	}
+
+	//将 [Offset, Offset + Removed) 替换为 Inserted,只重新分析受影响的单元
+	EditResult applyEdit(size_t Offset, size_t Removed, llvm::StringRef Inserted)
+	{
+		EditResult Result;
+		assert(Offset + Removed <= Size && "edit out of range");
+
+		//紧挨在编辑位置前后的字符也算作受影响,以便发现被拼接或拆开的单词
+		size_t First = unitAt(Offset ? Offset - 1 : 0);
+		size_t Last = unitAt(Offset + Removed);
+
+		std::string Region;
+		for(size_t I = First; I <= Last; I++)
+			Region += Units[I].Text;
+		Region.replace(Offset - Units[First].Begin, Removed, Inserted.data(), Inserted.size());
+
+		//区域开头的 FUNC 被改掉时,这段文字属于前一个函数
+		while(First > 0 && !startsWithFunc(Region))
+		{
+			First--;
+			Region.insert(0, Units[First].Text);
+		}
+
+		//重新预扫描受影响的区域;若扫描越过区域结尾
+		//(例如删掉了字符串的右引号),把下一个单元也并入
+		std::vector<size_t> Starts(1, 0);
+		size_t From = 0, StopAt = Region.size();
+		while(Last + 1 < Units.size())
+		{
+			Region += Units[Last + 1].Text;
+			if(findStarts(Region, From, StopAt, Starts, From))
+			{
+				Region.resize(StopAt);
+				break;
+			}
+			Last++;
+			StopAt = Region.size();
+		}
+		if(Last + 1 == Units.size())
+			findStarts(Region, From, Region.size(), Starts, From);
+
+		std::vector<Unit> NewUnits = buildUnits(Region, Starts, Units[First].Begin);
+		Result.UnitsReparsed = NewUnits.size();
+
+		ptrdiff_t Delta = (ptrdiff_t)Inserted.size() - (ptrdiff_t)Removed;
+		for(size_t I = Last + 1; I < Units.size(); I++)
+			Units[I].Begin += Delta;
+		Size += Delta;
+
+		//按函数名比较新旧单元
+		std::map<unsigned, size_t> OldHashes;
+		for(size_t I = First; I <= Last; I++)
+			if(unitName(Units[I]) != ~0u)
+				OldHashes[unitName(Units[I])] = Units[I].Hash;
+		for(const Unit &U : NewUnits)
+		{
+			unsigned Name = unitName(U);
+			if(Name == ~0u)
+				continue;
+			auto It = OldHashes.find(Name);
+			if(It == OldHashes.end())
+				Result.Added.push_back(Name);
+			else
+			{
+				if(It->second != U.Hash)
+					Result.Changed.push_back(Name);
+				OldHashes.erase(It);
+			}
+		}
+		for(auto &Old : OldHashes)
+			Result.Removed.push_back(Old.first);
+
+		//函数个数不变时(最常见的情况)原地替换,避免移动后面所有的单元
+		if(NewUnits.size() == Last - First + 1)
+		{
+			std::move(NewUnits.begin(), NewUnits.end(), Units.begin() + First);
+			return Result;
+		}
+		Units.erase(Units.begin() + First, Units.begin() + Last + 1);
+		Units.insert(Units.begin() + First, std::make_move_iterator(NewUnits.begin()),
+			std::make_move_iterator(NewUnits.end()));
+		return Result;
+	}
+
+	size_t getSize() const { return Size; }
+	const StringInterner &getSymbols() const { return Symbols; }
+
+	char getChar(size_t Pos) const
+	{
+		const Unit &U = Units[unitAt(Pos)];
+		return U.Text[Pos - U.Begin];
+	}
+
+	std::string getText() const
+	{
+		std::string Text;
+		Text.reserve(Size);
+		for(const Unit &U : Units)
+			Text += U.Text;
+		return Text;
+	}
+
+	//按源文件顺序返回所有函数的语法树
+	std::vector<FunctionAST *> getFunctions() const
+	{
+		std::vector<FunctionAST *> Functions;
+		for(const Unit &U : Units)
+			Functions.insert(Functions.end(), U.Functions.begin(), U.Functions.end());
+		return Functions;
+	}
+};
+
+#endif
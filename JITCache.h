@@ -0,0 +1,237 @@
+#ifndef __JITCACHE_H__
+#define __JITCACHE_H__
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+//JIT 目标文件的磁盘缓存(-cache):键为源程序、编译器版本、目标和影响生成代码的选项的 MD5,
+//每个键一个 <键>.o 文件。命中时 CompilerInstance 不做分析和代码生成,直接把目标文件加入 JIT;
+//未命中时 JIT 的 SimpleCompiler 生成机器码后通过 notifyObjectCompiled 写入缓存。
+//写入先到临时文件再改名,多个进程同时运行时不会读到不完整的文件。
+//命中时更新文件的修改时间,目录超过大小上限时按修改时间删去最久没有用到的文件(LRU)。
+//累计的命中、未命中和删除次数记在目录中的 stats 文件里,只用于统计,并发更新时可能少计
+
+//编译器版本:编译器本身重新构建后旧的缓存都不再命中
+static const char VSLCompilerVersion[] = "VSL 1.0, LLVM " LLVM_VERSION_STRING ", built " __DATE__ " " __TIME__;
+
+//默认的缓存目录:$XDG_CACHE_HOME/vsl 或 ~/.cache/vsl,都没有时为当前目录下的 .vslcache
+static std::string DefaultCacheDir() {
+	SmallString<128> Dir;
+	if (const char *XDG = getenv("XDG_CACHE_HOME"))
+		Dir = XDG;
+	else if (sys::path::home_directory(Dir))
+		sys::path::append(Dir, ".cache");
+	else
+		return ".vslcache";
+	sys::path::append(Dir, "vsl");
+	return Dir.str().str();
+}
+
+class JITObjectCache : public ObjectCache {
+public:
+	struct Totals {
+		uint64_t Hits = 0, Misses = 0, Evictions = 0;
+	};
+
+private:
+	std::string Dir;
+	uint64_t MaxBytes;
+	std::string Key;
+	bool Stored = false;
+
+	std::string pathOf(StringRef Name) const {
+		SmallString<128> P(Dir);
+		sys::path::append(P, Name);
+		return P.str().str();
+	}
+
+	std::string objectPath() const { return pathOf(Key + ".o"); }
+
+	//读出累计的次数,调用 Update 修改后写回。
+	//与目标文件一样经由每个进程各自的临时文件改名,stats 总是某一次完整的写入
+	template <typename F> void updateTotals(F Update) {
+		Totals T = getTotals();
+		Update(T);
+		SmallString<128> Tmp;
+		int FD;
+		if (sys::fs::createUniqueFile(pathOf("stats-%%%%%%.tmp"), FD, Tmp))
+			return;
+		{
+			raw_fd_ostream OS(FD, true);
+			OS << T.Hits << ' ' << T.Misses << ' ' << T.Evictions << '\n';
+			OS.flush();
+			if (OS.has_error()) {
+				OS.clear_error();
+				sys::fs::remove(Tmp);
+				return;
+			}
+		}
+		if (sys::fs::rename(Tmp, pathOf("stats")))
+			sys::fs::remove(Tmp);
+	}
+
+	//目录中的缓存文件超过 MaxBytes 时,从最久没有用到的开始删除,Keep 总是保留
+	void evict(StringRef Keep) {
+		struct Entry {
+			sys::TimePoint<> MTime;
+			uint64_t Size;
+			std::string Path;
+		};
+		std::vector<Entry> Entries;
+		uint64_t Total = 0;
+		std::error_code EC;
+		for (sys::fs::directory_iterator I(Dir, EC), E; I != E && !EC; I.increment(EC)) {
+			if (sys::path::extension(I->path()) != ".o")
+				continue;
+			sys::fs::file_status St;
+			if (sys::fs::status(I->path(), St))
+				continue;
+			Entries.push_back(Entry{ St.getLastModificationTime(), St.getSize(), I->path() });
+			Total += St.getSize();
+		}
+		if (Total <= MaxBytes)
+			return;
+		std::sort(Entries.begin(), Entries.end(),
+			[](const Entry &A, const Entry &B) { return A.MTime < B.MTime; });
+		uint64_t Removed = 0;
+		for (auto &E : Entries) {
+			if (Total <= MaxBytes)
+				break;
+			if (E.Path == Keep || sys::fs::remove(E.Path))
+				continue;
+			Total -= E.Size;
+			++Removed;
+		}
+		if (Removed)
+			updateTotals([&](Totals &T) { T.Evictions += Removed; });
+		Evicted += Removed;
+	}
+
+public:
+	bool Hit = false;	//本次运行的结果
+	uint64_t StoredBytes = 0;	//未命中时写入的目标文件大小
+	uint64_t Evicted = 0;	//本次运行删除的文件数
+
+	JITObjectCache(StringRef Dir, uint64_t MaxBytes, StringRef Key)
+		: Dir(Dir), MaxBytes(MaxBytes), Key(Key) {}
+
+	StringRef getKey() const { return Key; }
+	StringRef getDir() const { return Dir; }
+
+	//缓存的键:源程序、编译器版本、目标三元组、CPU 和 Options(调用者把影响生成代码的选项写成一个字符串)
+	static std::string computeKey(StringRef Source, StringRef Options) {
+		MD5 Hash;
+		Hash.update(Source);
+		Hash.update(StringRef("\0", 1));
+		Hash.update(VSLCompilerVersion);
+		Hash.update(StringRef("\0", 1));
+		Hash.update(sys::getProcessTriple());
+		Hash.update(StringRef("\0", 1));
+		Hash.update(sys::getHostCPUName());
+		Hash.update(StringRef("\0", 1));
+		Hash.update(Options);
+		MD5::MD5Result Result;
+		Hash.final(Result);
+		SmallString<32> Str;
+		MD5::stringifyResult(Result, Str);
+		return Str.str().str();
+	}
+
+	//查找本次的键,命中时返回目标文件并更新它的修改时间
+	std::unique_ptr<MemoryBuffer> lookup() {
+		std::string Path = objectPath();
+		auto Buf = MemoryBuffer::getFile(Path, -1, false);
+		if (!Buf) {
+			Hit = false;
+			sys::fs::create_directories(Dir);
+			updateTotals([](Totals &T) { ++T.Misses; });
+			return nullptr;
+		}
+		int FD;
+		if (!sys::fs::openFileForRead(Path, FD)) {
+			sys::fs::setLastModificationAndAccessTime(FD, std::chrono::system_clock::now());
+			sys::Process::SafelyCloseFileDescriptor(FD);
+		}
+		Hit = true;
+		updateTotals([](Totals &T) { ++T.Hits; });
+		return std::move(*Buf);
+	}
+
+	//目标文件不能使用(如已损坏)时删去,改为重新编译
+	void invalidate() {
+		sys::fs::remove(objectPath());
+		Hit = false;
+	}
+
+	//命中的情况在分析之前由 lookup 处理,JIT 编译时总是未命中
+	std::unique_ptr<MemoryBuffer> getObject(const Module *M) override { return nullptr; }
+
+	//只缓存第一个模块:使用缓存时各线程生成的模块已合并为一个
+	void notifyObjectCompiled(const Module *M, MemoryBufferRef Obj) override {
+		if (Stored)
+			return;
+		Stored = true;
+		SmallString<128> Tmp;
+		int FD;
+		if (sys::fs::createUniqueFile(pathOf(Key + "-%%%%%%.tmp"), FD, Tmp))
+			return;
+		{
+			raw_fd_ostream OS(FD, true);
+			OS << Obj.getBuffer();
+			OS.flush();
+			if (OS.has_error()) {
+				OS.clear_error();
+				sys::fs::remove(Tmp);
+				return;
+			}
+		}
+		if (sys::fs::rename(Tmp, objectPath())) {
+			sys::fs::remove(Tmp);
+			return;
+		}
+		StoredBytes = Obj.getBufferSize();
+		evict(objectPath());
+	}
+
+	Totals getTotals() const {
+		Totals T;
+		std::ifstream IS(pathOf("stats"));
+		IS >> T.Hits >> T.Misses >> T.Evictions;
+		return IS ? T : Totals();
+	}
+
+	//目录中缓存文件的个数和总大小
+	std::pair<size_t, uint64_t> getUsage() const {
+		size_t Files = 0;
+		uint64_t Bytes = 0;
+		std::error_code EC;
+		for (sys::fs::directory_iterator I(Dir, EC), E; I != E && !EC; I.increment(EC)) {
+			sys::fs::file_status St;
+			if (sys::path::extension(I->path()) == ".o" && !sys::fs::status(I->path(), St)) {
+				++Files;
+				Bytes += St.getSize();
+			}
+		}
+		return std::make_pair(Files, Bytes);
+	}
+
+	uint64_t getMaxBytes() const { return MaxBytes; }
+};
+
+#endif
@@ -1,13 +1,20 @@
 #ifndef __LEXER_H__
 #define __LEXER_H__
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "Scan.h"
 #include <cctype>
 #include <cstdio>
 #include <string>
 #include <cstdlib>
+#include <cstdint>
+#include <cstring>
 #include <algorithm>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 enum Token
@@ -32,145 +39,315 @@ enum Token
 	VAR = -18,
 };
 
-static std::string IdentifierStr;
-static int NumberVal;
-static FILE *inputFile;
+//单词记录:只保存单词在源缓冲区中的偏移和长度,不拷贝字符串
+struct TokenRec
+{
+	int Kind;			//单词类型
+	unsigned Offset;	//单词在源缓冲区中的偏移(TEXT 为引号内的内容)
+	unsigned Length;	//单词长度
+	int Val;			//INTEGER 的值或 VARIABLE 的符号编号
+};
+
+static const ScanKernels &DefaultScan = selectScanKernels();	//连续字符扫描函数
+
+//字符串驻留表:每个不同的标识符对应一个整数符号编号,
+//语法树和代码生成中的各种表都以符号编号为键
+class StringInterner
+{
+	llvm::StringMap<unsigned> Ids;
+	std::vector<llvm::StringRef> Names;	//指向 Ids 中保存的键
+	std::mutex Mutex;
+
+public:
+	unsigned intern(llvm::StringRef Str)
+	{
+		auto Result = Ids.try_emplace(Str, (unsigned)Names.size());
+		if(Result.second)
+			Names.push_back(Result.first->getKey());
+		return Result.first->second;
+	}
+
+	//多线程词法分析时使用;并行期间不能调用 getName
+	unsigned internLocked(llvm::StringRef Str)
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+		return intern(Str);
+	}
+
+	llvm::StringRef getName(unsigned Sym) const { return Names[Sym]; }
+	size_t size() const { return Names.size(); }
+};
+
+//关键字完全哈希表:由首字符和长度直接定位槽位,再比较一次即可确定
+struct KeywordEntry
+{
+	const char *Name;
+	unsigned Len;
+	int Kind;
+};
+
+static constexpr unsigned keywordHash(unsigned char First, unsigned Len)
+{
+	return (First * 3u + Len) & 31u;
+}
+
+static constexpr KeywordEntry KeywordTable[32] = {
+	{"THEN", 4, THEN}, {"", 0, 0}, {"", 0, 0}, {"", 0, 0},
+	{"", 0, 0}, {"VAR", 3, VAR}, {"", 0, 0}, {"", 0, 0},
+	{"", 0, 0}, {"", 0, 0}, {"WHILE", 5, WHILE}, {"", 0, 0},
+	{"", 0, 0}, {"", 0, 0}, {"DO", 2, DO}, {"", 0, 0},
+	{"DONE", 4, DONE}, {"CONTINUE", 8, CONTINUE}, {"", 0, 0}, {"ELSE", 4, ELSE},
+	{"FI", 2, FI}, {"PRINT", 5, PRINT}, {"FUNC", 4, FUNC}, {"", 0, 0},
+	{"", 0, 0}, {"", 0, 0}, {"", 0, 0}, {"", 0, 0},
+	{"RETURN", 6, RETURN}, {"IF", 2, IF}, {"", 0, 0}, {"", 0, 0},
+};
+
+//编译期检查每个关键字都位于自己的哈希槽中
+static constexpr bool checkKeywordTable(unsigned I)
+{
+	return I == 32 || ((KeywordTable[I].Len == 0 ||
+		keywordHash(KeywordTable[I].Name[0], KeywordTable[I].Len) == I) &&
+		checkKeywordTable(I + 1));
+}
+static_assert(checkKeywordTable(0), "keyword hash is not perfect");
 
 /*
-*返回输入单词类型
+*返回标识符对应的关键字类型,非关键字返回 VARIABLE
 */
-static int gettok()
+static int getIdentifierKind(llvm::StringRef Id)
 {
-	static int LastChar = ' ';
+	const KeywordEntry &K = KeywordTable[keywordHash(Id[0], Id.size())];
+	if(K.Len == Id.size() && memcmp(K.Name, Id.data(), K.Len) == 0)
+		return K.Kind;
 
-	//过滤空格
-	while(isspace(LastChar))
-		LastChar = fgetc(inputFile);
+	return VARIABLE;	//非预留关键字，而是标识符
+}
 
-	//解析标识符:{lc_letter}({lc_letter}|{digit})*
-	if(isalpha(LastChar))
+//词法分析器:把源缓冲区中的一段扫描为单词数组。
+//每次编译(并行分析时每个线程)使用自己的 Lexer,彼此之间没有共享的可变状态
+class Lexer
+{
+	const char *BufferStart;	//所有单词的偏移都相对于此位置
+	const char *BufferEnd = nullptr;
+	const char *CurPtr = nullptr;	//当前扫描位置
+	StringInterner &Symbols;
+	llvm::StringMap<unsigned> *SymbolCache;	//并行分析时线程自己的符号缓存,命中时不需要加锁
+
+	unsigned internIdentifier(llvm::StringRef Id)
 	{
-		IdentifierStr = "";
-		IdentifierStr += LastChar;
-		while (isalnum((LastChar = fgetc(inputFile))))
-			IdentifierStr += LastChar;
-
-		if(IdentifierStr == "FUNC")
-			return FUNC;
-		if(IdentifierStr == "PRINT")
-			return PRINT;
-		if(IdentifierStr == "RETURN")
-			return RETURN;
-		if(IdentifierStr == "CONTINUE")
-			return CONTINUE;
-		if(IdentifierStr == "IF")
-			return IF;
-		if(IdentifierStr == "THEN")
-			return THEN;
-		if(IdentifierStr == "ELSE")
-			return ELSE;
-		if(IdentifierStr == "FI")
-			return FI;
-		if(IdentifierStr == "WHILE")
-			return WHILE;
-		if(IdentifierStr == "DO")
-			return DO;
-		if(IdentifierStr == "DONE")
-			return DONE;
-		if(IdentifierStr == "VAR")
-			return VAR;
-
-		return VARIABLE;	//非预留关键字，而是标识符
+		if(!SymbolCache)
+			return Symbols.intern(Id);
+
+		auto Result = SymbolCache->try_emplace(Id, 0);
+		if(Result.second)
+			Result.first->second = Symbols.internLocked(Id);
+		return Result.first->second;
 	}
 
-	//解析整数:{digit}+
-	if(isdigit(LastChar))
+	/*
+	*从 CurPtr 处扫描一个单词填入 Tok,返回单词类型
+	*/
+	int gettok(TokenRec &Tok)
 	{
-		std::string NumStr;
-		do{
-			NumStr += LastChar;
-			LastChar = fgetc(inputFile);
-		}while(isdigit(LastChar));
+		while(true)
+		{
+			//过滤空格
+			CurPtr = Scan->SkipSpace(CurPtr, BufferEnd);
+
+			Tok.Offset = CurPtr - BufferStart;
+			Tok.Length = 0;
+			Tok.Val = 0;
+
+			//文档结束标志
+			if(CurPtr == BufferEnd)
+				return Tok.Kind = TOK_EOF;
+
+			//解析注释:"//".*
+			if(*CurPtr == '/' && CurPtr + 1 != BufferEnd && CurPtr[1] == '/')
+			{
+				CurPtr = Scan->SkipLine(CurPtr, BufferEnd);
+				continue;	//返回下一个输入类型
+			}
+			break;
+		}
+
+		const char *TokStart = CurPtr;
+		int LastChar = (unsigned char)*CurPtr++;
+
+		//解析标识符:{lc_letter}({lc_letter}|{digit})*
+		if(isalpha(LastChar))
+		{
+			CurPtr = Scan->SkipIdent(CurPtr, BufferEnd);
+			Tok.Length = CurPtr - TokStart;
+			llvm::StringRef Id(TokStart, Tok.Length);
+			Tok.Kind = getIdentifierKind(Id);
+			if(Tok.Kind == VARIABLE)
+				Tok.Val = internIdentifier(Id);
+			return Tok.Kind;
+		}
+
+		//解析整数:{digit}+
+		if(isdigit(LastChar))
+		{
+			unsigned Val = LastChar - '0';
+			while(CurPtr != BufferEnd && isdigit((unsigned char)*CurPtr))
+				Val = Val * 10 + (*CurPtr++ - '0');
+			Tok.Length = CurPtr - TokStart;
+			Tok.Val = (int)Val;
+			return Tok.Kind = INTEGER;
+		}
 
-		NumberVal = atoi(NumStr.c_str());
+		Tok.Length = 1;
+
+		//赋值符号
+		if(LastChar == ':' && CurPtr != BufferEnd && *CurPtr == '=')
+		{
+			++CurPtr;
+			Tok.Length = 2;
+			return Tok.Kind = ASSIGN_SYMBOL;
+		}
+
+		//TEXT:只记录引号内的原始内容,转义在语法分析时处理
+		if(LastChar == '\"')
+		{
+			Tok.Offset = CurPtr - BufferStart;
+			while((CurPtr = Scan->SkipText(CurPtr, BufferEnd)) != BufferEnd && *CurPtr == '\\')
+			{
+				++CurPtr;	//跳过转义字符
+				if(CurPtr != BufferEnd)
+					++CurPtr;
+			}
+			Tok.Length = CurPtr - BufferStart - Tok.Offset;
+			if(CurPtr != BufferEnd)
+				++CurPtr;	//eat '"'
+			return Tok.Kind = TEXT;
+		}
+
+		if(LastChar == '\\' && CurPtr != BufferEnd)
+		{
+			int tmp;
+			if(*CurPtr == 'n')
+				tmp = '\n';
+			else if(*CurPtr == 't')
+				tmp = '\t';
+			else if(*CurPtr == 'r')
+				tmp = '\r';
+			else
+				return Tok.Kind = '\\';
+			++CurPtr;
+			Tok.Length = 2;
 
-		return INTEGER;
+			return Tok.Kind = tmp;
+		}
+
+		//以上情况均不满足，直接返回当前字符
+		return Tok.Kind = LastChar;
 	}
 
-	//解析注释:"//".*
-	if(LastChar == '/')
-		if ((LastChar = fgetc(inputFile)) == '/')
+public:
+	const ScanKernels *Scan = &DefaultScan;	//连续字符扫描函数
+	std::vector<TokenRec> Tokens;	//一次扫描得到的单词数组
+
+	Lexer(StringInterner &Symbols, const char *BufferStart = nullptr,
+		llvm::StringMap<unsigned> *SymbolCache = nullptr)
+		: BufferStart(BufferStart), Symbols(Symbols), SymbolCache(SymbolCache) {}
+
+	/*
+	*扫描 BufferStart 之后的一段 [Begin, End),生成单词数组,以 TOK_EOF 结尾
+	*/
+	void lexRange(const char *Begin, const char *End)
+	{
+		CurPtr = Begin;
+		BufferEnd = End;
+
+		Tokens.clear();
+		Tokens.reserve((End - Begin) / 4 + 1);
+		TokenRec Tok;
+		do
 		{
-            do
-				LastChar = fgetc(inputFile);
-			while(LastChar != EOF && LastChar != '\n' && LastChar != '\r');
-
-            //若未到达结尾，返回下一个输入类型
-            if(LastChar != EOF)
-                return gettok();
-        }else{
-            return '/';
-        }
-
-	//赋值符号
-	if (LastChar == ':' && (LastChar = fgetc(inputFile)) == '=')
+			gettok(Tok);
+			Tokens.push_back(Tok);
+		}while(Tok.Kind != TOK_EOF);
+	}
+
+	/*
+	*一次扫描 [Start, End) 生成整个单词数组
+	*/
+	void lexBuffer(const char *Start, const char *End)
 	{
-		LastChar = fgetc(inputFile); //获取下一个字符
-		return ASSIGN_SYMBOL;
+		BufferStart = Start;
+		lexRange(Start, End);
 	}
 
-	//TEXT
-	if(LastChar == '\"')
+	//单词的原始文本
+	llvm::StringRef getTokenText(const TokenRec &Tok) const
 	{
-        IdentifierStr = "";
-		LastChar = fgetc(inputFile);
-		do
+		return llvm::StringRef(BufferStart + Tok.Offset, Tok.Length);
+	}
+};
+
+/*
+*快速预扫描:从 Start 开始记录每个 FUNC 关键字的位置,直到到达或越过 StopAt 为止。
+*函数只能在顶层定义,因此这些位置把源文件切分成互不依赖的部分。
+*返回停止位置:恰好等于 StopAt 说明 StopAt 处不在注释、字符串或标识符中间。
+*/
+static const char *ScanFuncBoundaries(const char *Start, const char *End,
+	const char *StopAt, std::vector<const char *> &Bounds)
+{
+	const char *P = Start;
+	while(P < StopAt)
+	{
+		if(isIdentChar(*P))
+		{
+			const char *WordEnd = DefaultScan.SkipIdent(P, End);
+			if(WordEnd - P == 4 && memcmp(P, "FUNC", 4) == 0)
+				Bounds.push_back(P);
+			P = WordEnd;
+		}
+		else if(*P == '/' && P + 1 != End && P[1] == '/')
+			P = DefaultScan.SkipLine(P, End);
+		else if(*P == '"')
 		{
-            if(LastChar == '\\')
-            {
-				LastChar = fgetc(inputFile);
-				if(LastChar == 'n')
-                    LastChar = '\n';
-                else if(LastChar == 't')
-                    LastChar = '\t';
-                else if(LastChar == 'r')
-                    LastChar = '\r';
-                else
-                    IdentifierStr += '\\';
-            }
-			IdentifierStr += LastChar;
-			LastChar = fgetc(inputFile);
-		}while(LastChar != '\"');
-		LastChar = fgetc(inputFile);
-		return TEXT;
+			//跳过字符串内容,其中的 FUNC 不是关键字
+			++P;
+			while((P = DefaultScan.SkipText(P, End)) != End && *P == '\\')
+				P = P + 1 != End ? P + 2 : End;
+			if(P != End)
+				++P;
+		}
+		else
+			P = DefaultScan.SkipSpace(P + 1, End);
 	}
+	return P;
+}
+
+static std::vector<const char *> FindFuncBoundaries(const char *Start, const char *End)
+{
+	std::vector<const char *> Bounds;
+	ScanFuncBoundaries(Start, End, End, Bounds);
+	return Bounds;
+}
 
-	if(LastChar == '\\')
-    {
-        int tmp;
-		LastChar = fgetc(inputFile);
-		if(LastChar == 'n')
-            tmp = '\n';
-        else if(LastChar == 't')
-            tmp = '\t';
-        else if(LastChar == 'r')
-            tmp = '\r';
-        else
-            return '\\';
-		LastChar = fgetc(inputFile);
-
-		return tmp;
-    }
-
-	//文档结束标志
-	if(LastChar == EOF)
-		return TOK_EOF;
-
-	//以上情况均不满足，直接返回当前字符
-	int tmpChar = LastChar;
-	LastChar = fgetc(inputFile);
-
-	return tmpChar;
+//将 TEXT 的原始内容按转义规则追加到 Out 中
+static void appendText(std::string &Out, llvm::StringRef Raw)
+{
+	for(size_t i = 0, e = Raw.size(); i != e; ++i)
+	{
+		char C = Raw[i];
+		if(C == '\\' && i + 1 != e)
+		{
+			C = Raw[++i];
+			if(C == 'n')
+				C = '\n';
+			else if(C == 't')
+				C = '\t';
+			else if(C == 'r')
+				C = '\r';
+			else
+				Out += '\\';
+		}
+		Out += C;
+	}
 }
 
 #endif
@@ -0,0 +1,133 @@
+#ifndef __MEMOIZE_H__
+#define __MEMOIZE_H__
+#include "AST.h"
+
+//纯函数分析和记忆化的统计信息
+struct MemoizeStats {
+	size_t PureFunctions = 0;	//证明为纯函数的函数
+	size_t Memoized = 0;	//其中加上结果缓存的递归函数
+};
+
+//副作用分析:VSL 的变量都是局部的,参数和返回值都是 int,函数唯一的副作用是 PRINT。
+//函数体中没有 PRINT、只调用纯函数的函数是纯函数,相同实参总是得到相同结果。
+//函数只能调用自身和在它之前定义的函数,所以按源文件顺序一遍即可确定,
+//对自身的调用不影响纯度;调用未定义的函数或在之后定义的函数时代码生成会报错,按非纯处理。
+//纯函数中调用自身、有 1~MaxMemoArgs 个参数的函数标记为记忆化,
+//代码生成时见 AST.h 中的 EmitMemoWrapper
+class EffectAnalysis {
+	struct FuncInfo {
+		FunctionAST *F;
+		bool Prints = false;
+		bool CallsUnknown = false;	//调用了未定义的函数或实参个数不符
+		bool CallsImpure = false;
+		bool Recursive = false;	//调用自身
+		bool Pure = false;
+	};
+	std::vector<FuncInfo> Funcs;
+	DenseMap<unsigned, unsigned> Index;	//函数名的符号编号 -> 下标
+
+	//Self 为 FI 在 Funcs 中的下标
+	void collect(FuncInfo &FI, unsigned Self, StatAST *S) {
+		if (!S)
+			return;
+		switch (S->getKind()) {
+		case StatAST::SK_Neg:
+			collect(FI, Self, cast<NegExprAST>(S)->getExpr());
+			break;
+		case StatAST::SK_Binary:
+			collect(FI, Self, cast<BinaryExprAST>(S)->getLHS());
+			collect(FI, Self, cast<BinaryExprAST>(S)->getRHS());
+			break;
+		case StatAST::SK_Call: {
+			auto *C = cast<CallExprAST>(S);
+			auto It = Index.find(C->getCallee());
+			if (It == Index.end() || It->second > Self ||
+				Funcs[It->second].F->getProto()->getArgs().size() != C->getArgs().size())
+				FI.CallsUnknown = true;
+			else if (It->second == Self)
+				FI.Recursive = true;
+			else if (!Funcs[It->second].Pure)
+				FI.CallsImpure = true;
+			for (StatAST *A : C->getArgs())
+				collect(FI, Self, A);
+			break;
+		}
+		case StatAST::SK_Block:
+			for (StatAST *C : cast<BlockStatAST>(S)->getStatList())
+				collect(FI, Self, C);
+			break;
+		case StatAST::SK_Print:
+			FI.Prints = true;
+			break;
+		case StatAST::SK_If:
+			collect(FI, Self, cast<IfStatAST>(S)->getCond());
+			collect(FI, Self, cast<IfStatAST>(S)->getThen());
+			collect(FI, Self, cast<IfStatAST>(S)->getElse());
+			break;
+		case StatAST::SK_While:
+			collect(FI, Self, cast<WhileStatAST>(S)->getCond());
+			collect(FI, Self, cast<WhileStatAST>(S)->getBody());
+			break;
+		case StatAST::SK_Ret:
+			collect(FI, Self, cast<RetStatAST>(S)->getVal());
+			break;
+		case StatAST::SK_Assign:
+			collect(FI, Self, cast<AssStatAST>(S)->getExpr());
+			break;
+		//数组都是局部的,写数组元素不是副作用
+		case StatAST::SK_Index:
+			collect(FI, Self, cast<IndexExprAST>(S)->getIndex());
+			break;
+		case StatAST::SK_ArrayAssign:
+			collect(FI, Self, cast<ArrayAssStatAST>(S)->getIndex());
+			collect(FI, Self, cast<ArrayAssStatAST>(S)->getExpr());
+			break;
+		default:
+			break;
+		}
+	}
+
+public:
+	static const unsigned MaxMemoArgs = 4;	//缓存项中实参个数的上限
+
+	EffectAnalysis(ArrayRef<FunctionAST *> Functions) {
+		for (FunctionAST *F : Functions) {
+			if (!F)
+				continue;
+			//重定义的函数在代码生成时报错,这里两个定义都不算纯函数
+			auto Ins = Index.insert(std::make_pair(F->getProto()->getSym(), (unsigned)Funcs.size()));
+			Funcs.emplace_back();
+			Funcs.back().F = F;
+			if (!Ins.second) {
+				Funcs[Ins.first->second].CallsUnknown = true;
+				Funcs.back().CallsUnknown = true;
+			}
+		}
+		for (unsigned I = 0; I < Funcs.size(); I++) {
+			FuncInfo &FI = Funcs[I];
+			collect(FI, I, FI.F->getBody());
+			FI.Pure = !FI.Prints && !FI.CallsUnknown && !FI.CallsImpure;
+		}
+	}
+
+	//标记要记忆化的函数
+	void markMemoized(MemoizeStats &Stats) {
+		for (FuncInfo &FI : Funcs) {
+			if (!FI.Pure)
+				continue;
+			++Stats.PureFunctions;
+			size_t NumArgs = FI.F->getProto()->getArgs().size();
+			if (FI.Recursive && NumArgs > 0 && NumArgs <= MaxMemoArgs) {
+				FI.F->setMemoized(true);
+				++Stats.Memoized;
+			}
+		}
+	}
+};
+
+//分析 Functions 中所有函数(需要整个程序),标记纯的递归函数
+static void MarkMemoization(ArrayRef<FunctionAST *> Functions, MemoizeStats &Stats) {
+	EffectAnalysis(Functions).markMemoized(Stats);
+}
+
+#endif
@@ -6,504 +6,540 @@
 #include "llvm/IR/Verifier.h"
 using namespace llvm;
 
-static int CurTok;
-static std::map<char, int> BinopPrecedence;
-static int getNextToken() { return CurTok = gettok(); }
-
-static std::unique_ptr<StatAST> ParseExpression();
-std::unique_ptr<StatAST> LogError(const char *Str);
-static std::unique_ptr<StatAST> ParseNumberExpr();
-static std::unique_ptr<StatAST> ParseParenExpr();
-static std::unique_ptr<DecAST> ParseDec();
-std::unique_ptr<StatAST> LogError(const char *Str);
-std::unique_ptr<PrototypeAST> LogErrorP(const char *Str);
-std::unique_ptr<StatAST> LogErrorS(const char *Str);
-std::unique_ptr<DecAST> LogErrorD(const char *Str);
-static std::unique_ptr<StatAST> ParseStatement();
-
-//解析如下格式的表达式：
-// identifer || identifier(expression list)
-static std::unique_ptr<StatAST> ParseIdentifierExpr() {
-	std::string IdName = IdentifierStr;
-
-	getNextToken();
-
-	//解析成变量表达式
-	if (CurTok != '(')
-		return llvm::make_unique<VariableExprAST>(IdName);
-
-	// 解析成函数调用表达式
-	getNextToken();
-	std::vector<std::unique_ptr<StatAST>> Args;
-	if (CurTok != ')') {
-		while (true) {
-			if (auto Arg = ParseExpression())
-				Args.push_back(std::move(Arg));
-			else
-				return nullptr;
+//二元运算符优先级
+static const std::map<char, int> BinopPrecedence = {
+	{'+', 10}, {'-', 10}, {'*', 40}, {'/', 40},
+};
 
-			if (CurTok == ')')
-				break;
+//错误信息打印
+StatAST *LogError(const char *Str) {
+	fprintf(stderr, "Error: %s\n", Str);
+	return nullptr;
+}
 
-			if (CurTok != ',')
-				return LogErrorS("Expected ')' or ',' in argument list");
+//语法分析器:读取 Lexer 生成的单词数组,在 AST 内存池中建立语法树。
+//分析状态都在对象内部,多个 Parser 可以在不同线程上同时工作
+class Parser {
+	Lexer &Lex;
+	ASTContext &AST;	//分配语法树节点使用的内存池
+
+	int CurTok;
+	size_t TokIdx = 0;	//Tokens 中下一个单词的下标
+	StringRef IdentifierStr;	//指向源缓冲区,不拷贝
+	unsigned IdentifierSym;	//当前标识符的符号编号
+	int NumberVal;
+
+	//报告错误并计数,返回 nullptr
+	StatAST *LogError(const char *Str) {
+		++NumErrors;
+		return ::LogError(Str);
+	}
+	PrototypeAST *LogErrorP(const char *Str) {
+		LogError(Str);
+		return nullptr;
+	}
+	StatAST *LogErrorS(const char *Str) {
+		return LogError(Str);
+	}
+	DecAST *LogErrorD(const char *Str) {
+		LogError(Str);
+		return nullptr;
+	}
+
+	//从单词数组中取下一个单词,停留在结尾的 TOK_EOF 上
+	int getNextToken() {
+		const TokenRec &Tok = Lex.Tokens[TokIdx];
+		if (Tok.Kind != TOK_EOF)
+			++TokIdx;
+		IdentifierStr = Lex.getTokenText(Tok);
+		IdentifierSym = Tok.Val;
+		NumberVal = Tok.Val;
+		return CurTok = Tok.Kind;
+	}
+
+	//解析如下格式的表达式：
+	// identifer || identifier(expression list) || identifier[expression]
+	StatAST *ParseIdentifierExpr() {
+		unsigned IdSym = IdentifierSym;
+
+		getNextToken();
+
+		//解析成数组元素
+		if (CurTok == '[') {
 			getNextToken();
+			auto Index = ParseExpression();
+			if (!Index)
+				return nullptr;
+			if (CurTok != ']')
+				return LogErrorS("expected ']' after array index");
+			getNextToken();
+			return AST.create<IndexExprAST>(IdSym, Index);
 		}
-	}
 
-	getNextToken();
+		//解析成变量表达式
+		if (CurTok != '(')
+			return AST.create<VariableExprAST>(IdSym);
 
-	return llvm::make_unique<CallExprAST>(IdName, std::move(Args));
-}
+		// 解析成函数调用表达式
+		getNextToken();
+		SmallVector<StatAST *, 8> Args;
+		if (CurTok != ')') {
+			while (true) {
+				if (auto Arg = ParseExpression())
+					Args.push_back(Arg);
+				else
+					return nullptr;
+
+				if (CurTok == ')')
+					break;
+
+				if (CurTok != ',')
+					return LogErrorS("Expected ')' or ',' in argument list");
+				getNextToken();
+			}
+		}
 
-//解析取反表达式
-static std::unique_ptr<StatAST> ParseNegExpr() {
-	getNextToken();
-	std::unique_ptr<StatAST> Exp = ParseExpression();
-	if (!Exp)
-		return nullptr;
+		getNextToken();
 
-	return llvm::make_unique<NegExprAST>(std::move(Exp));
-}
+		return AST.create<CallExprAST>(IdSym, AST.copyArray<StatAST *>(Args));
+	}
 
-//解析成 标识符表达式、整数表达式、括号表达式中的一种
-static std::unique_ptr<StatAST> ParsePrimary() {
-	switch (CurTok) {
-	default:
-		return LogError("unknown token when expecting an expression");
-	case VARIABLE:
-		return ParseIdentifierExpr();
-	case INTEGER:
-		return ParseNumberExpr();
-	case '(':
-		return ParseParenExpr();
-	case '-':
-		return ParseNegExpr();
+	//解析取反表达式
+	StatAST *ParseNegExpr() {
+		getNextToken();
+		StatAST *Exp = ParseExpression();
+		if (!Exp)
+			return nullptr;
+
+		return AST.create<NegExprAST>(Exp);
 	}
-}
 
-//GetTokPrecedence - Get the precedence of the pending binary operator token.
-static int GetTokPrecedence() {
-  if (!isascii(CurTok))
-    return -1;
+	//解析成 标识符表达式、整数表达式、括号表达式中的一种
+	StatAST *ParsePrimary() {
+		switch (CurTok) {
+		default:
+			return LogError("unknown token when expecting an expression");
+		case VARIABLE:
+			return ParseIdentifierExpr();
+		case INTEGER:
+			return ParseNumberExpr();
+		case '(':
+			return ParseParenExpr();
+		case '-':
+			return ParseNegExpr();
+		}
+	}
 
-  // Make sure it's a declared binop.
-  int TokPrec = BinopPrecedence[CurTok];
-  if (TokPrec <= 0)
-    return -1;
-  return TokPrec;
-}
+	//GetTokPrecedence - Get the precedence of the pending binary operator token.
+	int GetTokPrecedence() {
+	  if (!isascii(CurTok))
+	    return -1;
 
-//解析二元表达式
-//参数 ：
-//ExprPrec 左部运算符优先级
-//LHS 左部操作数
-// 递归得到可以结合的右部，循环得到一个整体二元表达式
-static std::unique_ptr<StatAST> ParseBinOpRHS(int ExprPrec,
-	std::unique_ptr<StatAST> LHS) {
+	  // Make sure it's a declared binop.
+	  auto It = BinopPrecedence.find(CurTok);
+	  if (It == BinopPrecedence.end() || It->second <= 0)
+	    return -1;
+	  return It->second;
+	}
 
-	while (true) {
-		int TokPrec = GetTokPrecedence();
+	//解析二元表达式
+	//参数 ：
+	//ExprPrec 左部运算符优先级
+	//LHS 左部操作数
+	// 递归得到可以结合的右部，循环得到一个整体二元表达式
+	StatAST *ParseBinOpRHS(int ExprPrec,
+		StatAST *LHS) {
 
-		// 当右部没有运算符或右部运算符优先级小于左部运算符优先级时 退出循环和递归
-		if (TokPrec < ExprPrec)
-			return LHS;
+		while (true) {
+			int TokPrec = GetTokPrecedence();
 
-		if(CurTok == '}')
-			return LHS;
+			// 当右部没有运算符或右部运算符优先级小于左部运算符优先级时 退出循环和递归
+			if (TokPrec < ExprPrec)
+				return LHS;
 
-		// 保存左部运算符
-		int BinOp = CurTok;
-		getNextToken();
+			if(CurTok == '}')
+				return LHS;
 
-		// 得到右部表达式
-		auto RHS = ParsePrimary();
-		if (!RHS)
-			return nullptr;
+			// 保存左部运算符
+			int BinOp = CurTok;
+			getNextToken();
 
-		// 如果该右部表达式不与该左部表达式结合 那么递归得到右部表达式
-		int NextPrec = GetTokPrecedence();
-		if (TokPrec < NextPrec) {
-			RHS = ParseBinOpRHS(TokPrec + 1, std::move(RHS));
+			// 得到右部表达式
+			auto RHS = ParsePrimary();
 			if (!RHS)
 				return nullptr;
-		}
-
-		// 将左右部结合成新的左部
-		LHS = llvm::make_unique<BinaryExprAST>(BinOp, std::move(LHS),
-			std::move(RHS));
-	}
-}
 
-// 解析得到表达式
-static std::unique_ptr<StatAST> ParseExpression() {
-	auto LHS = ParsePrimary();
-	if (!LHS)
-		return nullptr;
+			// 如果该右部表达式不与该左部表达式结合 那么递归得到右部表达式
+			int NextPrec = GetTokPrecedence();
+			if (TokPrec < NextPrec) {
+				RHS = ParseBinOpRHS(TokPrec + 1, RHS);
+				if (!RHS)
+					return nullptr;
+			}
 
-	return ParseBinOpRHS(0, std::move(LHS));
-}
-
-// numberexpr ::= number
-static std::unique_ptr<StatAST> ParseNumberExpr() {
-	auto Result = llvm::make_unique<NumberExprAST>(NumberVal);
-	//略过数字获取下一个输入
-	getNextToken();
-	return std::move(Result);
-}
+			// 将左右部结合成新的左部
+			LHS = AST.create<BinaryExprAST>(BinOp, LHS, RHS);
+		}
+	}
 
-//declaration::=VAR variable_list
-static std::unique_ptr<DecAST> ParseDec() {
-	//eat 'VAR'
-	getNextToken();
+	// 解析得到表达式
+	StatAST *ParseExpression() {
+		auto LHS = ParsePrimary();
+		if (!LHS)
+			return nullptr;
 
-	std::vector<std::string> varNames;
-	//保证至少有一个变量的名字
-	if (CurTok != VARIABLE) {
-		return LogErrorD("expected identifier after VAR");
+		return ParseBinOpRHS(0, LHS);
 	}
 
-	while (true)
-	{
-		varNames.push_back(IdentifierStr);
-		//eat VARIABLE
+	// numberexpr ::= number
+	StatAST *ParseNumberExpr() {
+		auto Result = AST.create<NumberExprAST>(NumberVal);
+		//略过数字获取下一个输入
 		getNextToken();
-		if (CurTok != ',')
-			break;
+		return Result;
+	}
+
+	//declaration::=VAR variable_list
+	//variable_list 中的 VARIABLE '[' INTEGER ']' 声明数组
+	DecAST *ParseDec() {
+		//eat 'VAR'
 		getNextToken();
+
+		SmallVector<unsigned, 8> varNames;
+		SmallVector<unsigned, 8> sizes;	//每个变量的元素个数,标量为 0
+		bool hasArray = false;
+		//保证至少有一个变量的名字
 		if (CurTok != VARIABLE) {
-			return LogErrorD("expected identifier list after VAR");
+			return LogErrorD("expected identifier after VAR");
 		}
-	}
 
-	auto Body = nullptr;
+		while (true)
+		{
+			varNames.push_back(IdentifierSym);
+			sizes.push_back(0);
+			//eat VARIABLE
+			getNextToken();
+			if (CurTok == '[') {
+				getNextToken();
+				if (CurTok != INTEGER || NumberVal <= 0)
+					return LogErrorD("array size must be a positive integer");
+				sizes.back() = NumberVal;
+				hasArray = true;
+				getNextToken();
+				if (CurTok != ']')
+					return LogErrorD("expected ']' after array size");
+				getNextToken();
+			}
+			if (CurTok != ',')
+				break;
+			getNextToken();
+			if (CurTok != VARIABLE) {
+				return LogErrorD("expected identifier list after VAR");
+			}
+		}
 
-	return llvm::make_unique<DecAST>(std::move(varNames), std::move(Body));
-}
+		auto Body = nullptr;
 
-//null_statement::=CONTINUE
-static std::unique_ptr<StatAST> ParseNullStat() {
-	getNextToken();
-	return llvm::make_unique<NullStatAST>();
-}
+		return AST.create<DecAST>(AST.copyArray<unsigned>(varNames), Body,
+			hasArray ? AST.copyArray<unsigned>(sizes) : ArrayRef<unsigned>());
+	}
 
-//block::='{' declaration_list statement_list '}'
-static std::unique_ptr<StatAST> ParseBlock() {
-	//存储变量声明语句及其他语句
-	std::vector<std::unique_ptr<DecAST>> DecList;
-	std::vector<std::unique_ptr<StatAST>> StatList;
-	getNextToken();   //eat '{'
-	if (CurTok == VAR) {
-		auto varDec = ParseDec();
-		DecList.push_back(std::move(varDec));
+	//null_statement::=CONTINUE
+	StatAST *ParseNullStat() {
+		getNextToken();
+		return AST.create<NullStatAST>();
 	}
-	while (CurTok != '}') {
+
+	//block::='{' declaration_list statement_list '}'
+	//有语句出错时继续分析到 '}' 再返回 nullptr,语法树中不留下空语句;
+	//缺少 '}' 时在 TOK_EOF 处报错返回(编辑器中未配对的括号很常见)
+	StatAST *ParseBlock() {
+		//存储变量声明语句及其他语句
+		SmallVector<DecAST *, 2> DecList;
+		SmallVector<StatAST *, 16> StatList;
+		bool Failed = false;
+		getNextToken();   //eat '{'
 		if (CurTok == VAR) {
-			LogErrorS("Can't declare VAR here!");
-		}
-		else if (CurTok == '{') {
-			ParseBlock();
-		}
-		else if (CurTok == CONTINUE) {
-			getNextToken();
+			if (auto varDec = ParseDec())
+				DecList.push_back(varDec);
+			else
+				Failed = true;
 		}
-		else {
-			auto statResult = ParseStatement();
-			StatList.push_back(std::move(statResult));
+		while (CurTok != '}') {
+			if (CurTok == TOK_EOF)
+				return LogErrorS("expected '}' at end of block");
+			if (CurTok == VAR) {
+				LogErrorS("Can't declare VAR here!");
+				ParseDec();	//跳过这条声明继续分析
+				Failed = true;
+				continue;
+			}
+			if (CurTok == CONTINUE) {
+				getNextToken();
+				continue;
+			}
+			auto statResult = CurTok == '{' ? ParseBlock() : ParseStatement();
+			if (statResult)
+				StatList.push_back(statResult);
+			else if (CurTok == TOK_EOF)
+				return nullptr;	//错误已经报告过
+			else
+				Failed = true;
 		}
-	}
-	getNextToken();  //eat '}'
+		getNextToken();  //eat '}'
+		if (Failed)
+			return nullptr;
 
-	return llvm::make_unique<BlockStatAST>(std::move(DecList), std::move(StatList));
-}
+		return AST.create<BlockStatAST>(AST.copyArray<DecAST *>(DecList),
+			AST.copyArray<StatAST *>(StatList));
+	}
 
-//prototype ::= VARIABLE '(' parameter_list ')'
-static std::unique_ptr<PrototypeAST> ParsePrototype() {
-	if (CurTok != VARIABLE)
-		return LogErrorP("Expected function name in prototype");
+	//prototype ::= VARIABLE '(' parameter_list ')'
+	PrototypeAST *ParsePrototype() {
+		if (CurTok != VARIABLE)
+			return LogErrorP("Expected function name in prototype");
 
-	std::string FnName = IdentifierStr;
-	getNextToken();
+		unsigned FnSym = IdentifierSym;
+		getNextToken();
 
-	if (CurTok != '(')
-		return LogErrorP("Expected '(' in prototype");
+		if (CurTok != '(')
+			return LogErrorP("Expected '(' in prototype");
 
-	std::vector<std::string> ArgNames;
-	getNextToken();
-	while (CurTok == VARIABLE)
-	{
-		ArgNames.push_back(IdentifierStr);
+		SmallVector<unsigned, 8> ArgNames;
 		getNextToken();
-		if (CurTok == ',')
+		while (CurTok == VARIABLE)
+		{
+			ArgNames.push_back(IdentifierSym);
 			getNextToken();
-	}
-	if (CurTok != ')')
-		return LogErrorP("Expected ')' in prototype");
-
-	// success.
-	getNextToken(); // eat ')'.
-
-	return llvm::make_unique<PrototypeAST>(FnName, std::move(ArgNames));
-}
-
-//function ::= FUNC VARIABLE '(' parameter_lst ')' statement
-static std::unique_ptr<FunctionAST> ParseFunc()
-{
-	getNextToken(); // eat FUNC.
-	auto Proto = ParsePrototype();
-	if (!Proto)
-		return nullptr;
+			if (CurTok == ',')
+				getNextToken();
+		}
+		if (CurTok != ')')
+			return LogErrorP("Expected ')' in prototype");
 
-	auto E = ParseStatement();
-	if (!E)
-		return nullptr;
+		// success.
+		getNextToken(); // eat ')'.
 
-	return llvm::make_unique<FunctionAST>(std::move(Proto), std::move(E));
-}
+		return AST.create<PrototypeAST>(FnSym, AST.copyArray<unsigned>(ArgNames));
+	}
 
-//解析括号中的表达式
-static std::unique_ptr<StatAST> ParseParenExpr() {
-	// 过滤'('
-	getNextToken();
-	auto V = ParseExpression();
-	if (!V)
-		return nullptr;
+	//function ::= FUNC VARIABLE '(' parameter_lst ')' statement
+	FunctionAST *ParseFunc()
+	{
+		getNextToken(); // eat FUNC.
+		auto Proto = ParsePrototype();
+		if (!Proto)
+			return nullptr;
 
-	if (CurTok != ')')
-		return LogError("expected ')'");
-	// 过滤')'
-	getNextToken();
-	return V;
-}
+		auto E = ParseStatement();
+		if (!E)
+			return nullptr;
 
-//解析 IF Statement
-static std::unique_ptr<StatAST> ParseIfStat() {
-	getNextToken(); // eat the IF.
+		return AST.create<FunctionAST>(Proto, E);
+	}
 
-					// condition.
-	auto Cond = ParseExpression();
-	if (!Cond)
-		return nullptr;
+	//解析括号中的表达式
+	StatAST *ParseParenExpr() {
+		// 过滤'('
+		getNextToken();
+		auto V = ParseExpression();
+		if (!V)
+			return nullptr;
 
-	if (CurTok != THEN)
-		return LogErrorS("expected THEN");
-	getNextToken(); // eat the THEN
+		if (CurTok != ')')
+			return LogError("expected ')'");
+		// 过滤')'
+		getNextToken();
+		return V;
+	}
 
-	auto Then = ParseStatement();
-	if (!Then)
-		return nullptr;
+	//解析 IF Statement
+	StatAST *ParseIfStat() {
+		getNextToken(); // eat the IF.
 
-	std::unique_ptr<StatAST> Else = nullptr;
-	if (CurTok == ELSE) {
-        getNextToken();
-		Else = ParseStatement();
-		if (!Else)
+						// condition.
+		auto Cond = ParseExpression();
+		if (!Cond)
 			return nullptr;
-	}
-	else if(CurTok != FI)
-		return LogErrorS("expected FI or ELSE");
 
-	getNextToken();
+		if (CurTok != THEN)
+			return LogErrorS("expected THEN");
+		getNextToken(); // eat the THEN
 
-	return llvm::make_unique<IfStatAST>(std::move(Cond), std::move(Then),
-		std::move(Else));
-}
+		auto Then = ParseStatement();
+		if (!Then)
+			return nullptr;
 
-//PRINT,能输出变量和函数调用的值
-static std::unique_ptr<StatAST> ParsePrintStat()
-{
-    std::string text = "";
-	std::vector<std::unique_ptr<StatAST>> expr;
-	getNextToken();//eat PRINT
-
-    while(CurTok == VARIABLE || CurTok == TEXT || CurTok == '('
-            || CurTok == '-' || CurTok == INTEGER)
-    {
-        if(CurTok == TEXT)
-        {
-            text += IdentifierStr;
-            getNextToken();
-        }
-        else
-        {
-            text += " %d ";
-			expr.push_back(std::move(ParseExpression()));
+		StatAST *Else = nullptr;
+		if (CurTok == ELSE) {
+	        getNextToken();
+			Else = ParseStatement();
+			if (!Else)
+				return nullptr;
 		}
+		else if(CurTok != FI)
+			return LogErrorS("expected FI or ELSE");
 
-        if(CurTok != ',')
-            break;
-        getNextToken(); //eat ','
-    }
+		getNextToken();
 
-    return llvm::make_unique<PrintStatAST>(text, std::move(expr));
-}
+		return AST.create<IfStatAST>(Cond, Then, Else);
+	}
 
-//解析 RETURN Statement
-static std::unique_ptr<StatAST> ParseRetStat() {
-	getNextToken();
-	auto Val = ParseExpression();
-	if (!Val)
-		return nullptr;
+	//PRINT,能输出变量和函数调用的值
+	//相邻的文本合并为一段,每个表达式之前和最后一个表达式之后各有一段(可能为空)
+	StatAST *ParsePrintStat()
+	{
+	    std::string text = "";
+		SmallVector<StringRef, 8> texts;
+		SmallVector<StatAST *, 8> expr;
+		getNextToken();//eat PRINT
+
+	    while(CurTok == VARIABLE || CurTok == TEXT || CurTok == '('
+	            || CurTok == '-' || CurTok == INTEGER)
+	    {
+	        if(CurTok == TEXT)
+	        {
+	            appendText(text, IdentifierStr);
+	            getNextToken();
+	        }
+	        else
+	        {
+	            texts.push_back(AST.copyString(text));
+	            text.clear();
+				auto E = ParseExpression();
+				if (!E)
+					return nullptr;
+				expr.push_back(E);
+			}
+
+	        if(CurTok != ',')
+	            break;
+	        getNextToken(); //eat ','
+	    }
+	    texts.push_back(AST.copyString(text));
+
+	    return AST.create<PrintStatAST>(AST.copyArray<StringRef>(texts),
+	        AST.copyArray<StatAST *>(expr));
+	}
 
-	return llvm::make_unique<RetStatAST>(std::move(Val));
-}
+	//解析 RETURN Statement
+	StatAST *ParseRetStat() {
+		getNextToken();
+		auto Val = ParseExpression();
+		if (!Val)
+			return nullptr;
 
-//解析 赋值语句
-static std::unique_ptr<StatAST> ParseAssStat() {
-	auto a = ParseIdentifierExpr();
-	VariableExprAST* Name = (VariableExprAST*)a.get();
-	auto NameV = llvm::make_unique<VariableExprAST>(Name->getName());
-	if (!Name)
-		return nullptr;
-	if (CurTok != ASSIGN_SYMBOL)
-		return LogErrorS("need := in assignment statment");
-	getNextToken();
+		return AST.create<RetStatAST>(Val);
+	}
 
-	auto Expression = ParseExpression();
-	if (!Expression)
-		return nullptr;
+	//解析 赋值语句
+	StatAST *ParseAssStat() {
+		auto a = ParseIdentifierExpr();
+		if (!a)
+			return nullptr;
+		if (CurTok != ASSIGN_SYMBOL)
+			return LogErrorS("need := in assignment statment");
+		if (!isa<VariableExprAST>(a) && !isa<IndexExprAST>(a))
+			return LogErrorS("expected variable or array element on the left of :=");
+		getNextToken();
 
-	return llvm::make_unique<AssStatAST>(std::move(NameV), std::move(Expression));
-}
+		auto Expression = ParseExpression();
+		if (!Expression)
+			return nullptr;
 
-//解析while语句
-static std::unique_ptr<StatAST> ParseWhileStat()
-{
-	getNextToken();//eat WHILE
+		if (auto *Elem = dyn_cast<IndexExprAST>(a))
+			return AST.create<ArrayAssStatAST>(Elem->getSym(), Elem->getIndex(), Expression);
+		return AST.create<AssStatAST>(cast<VariableExprAST>(a), Expression);
+	}
 
-	auto E = ParseExpression();
-	if(!E)
-		return nullptr;
+	//解析while语句
+	StatAST *ParseWhileStat()
+	{
+		getNextToken();//eat WHILE
 
-	if(CurTok != DO)
-		return LogErrorS("expect DO in WHILE statement");
-	getNextToken();//eat DO
+		auto E = ParseExpression();
+		if(!E)
+			return nullptr;
 
-	auto S = ParseStatement();
-	if(!S)
-	return nullptr;
+		if(CurTok != DO)
+			return LogErrorS("expect DO in WHILE statement");
+		getNextToken();//eat DO
 
-	if(CurTok != DONE)
-		return LogErrorS("expect DONE in WHILE statement");
-	getNextToken();//eat DONE
+		auto S = ParseStatement();
+		if(!S)
+		return nullptr;
 
-	return llvm::make_unique<WhileStatAST>(std::move(E), std::move(S));
-}
+		if(CurTok != DONE)
+			return LogErrorS("expect DONE in WHILE statement");
+		getNextToken();//eat DONE
 
-static std::unique_ptr<StatAST> ParseStatement()
-{
-	switch (CurTok) {
-		case IF:
-			return ParseIfStat();
-			break;
-        case PRINT:
-            return ParsePrintStat();
-		case RETURN:
-			return ParseRetStat();
-		case VAR:
-			return ParseDec();
-			break;
-		case '{':
-			return ParseBlock();
-			break;
-		case CONTINUE:
-			return ParseNullStat();
-		case WHILE:
-			return ParseWhileStat();
-			break;
-		default:
-			auto E = ParseAssStat();
-			return E;
+		return AST.create<WhileStatAST>(E, S);
 	}
-}
 
-//解析程序结构
-static std::unique_ptr<ProgramAST> ParseProgramAST() {
-	//接受程序中函数的语法树
-	std::vector<std::unique_ptr<FunctionAST>> Functions;
+	StatAST *ParseStatement()
+	{
+		switch (CurTok) {
+			case IF:
+				return ParseIfStat();
+				break;
+	        case PRINT:
+	            return ParsePrintStat();
+			case RETURN:
+				return ParseRetStat();
+			case VAR:
+				return ParseDec();
+				break;
+			case '{':
+				return ParseBlock();
+				break;
+			case CONTINUE:
+				return ParseNullStat();
+			case WHILE:
+				return ParseWhileStat();
+				break;
+			default:
+				auto E = ParseAssStat();
+				return E;
+		}
+	}
 
-	//循环解析程序中所有函数
-	while (CurTok != TOK_EOF) {
-		auto Func=ParseFunc();
-		Functions.push_back(std::move(Func));
+	//ParseFunc 总会吃掉开头的 FUNC,失败后停在下一个 FUNC 上时不能再跳过它
+	void skipToNextFunc() {
+		while (CurTok != FUNC && CurTok != TOK_EOF)
+			getNextToken();
 	}
 
-	return llvm::make_unique<ProgramAST>(std::move(Functions));
-}
+	//解析程序结构
+	ProgramAST *ParseProgramAST() {
+		//接受程序中函数的语法树
+		std::vector<FunctionAST *> Functions;
 
-//错误信息打印
-std::unique_ptr<StatAST> LogError(const char *Str) {
-	fprintf(stderr, "Error: %s\n", Str);
-	return nullptr;
-}
-std::unique_ptr<PrototypeAST> LogErrorP(const char *Str) {
-	LogError(Str);
-	return nullptr;
-}
-std::unique_ptr<StatAST> LogErrorS(const char *Str) {
-	fprintf(stderr, "Error: %s\n", Str);
-	return nullptr;
-}
-std::unique_ptr<DecAST> LogErrorD(const char *Str) {
-	fprintf(stderr, "Error: %s\n", Str);
-	return nullptr;
-}
+		//循环解析程序中所有函数
+		while (CurTok != TOK_EOF) {
+			if (auto Func = ParseFunc())
+				Functions.push_back(Func);
+			else
+				skipToNextFunc();
+		}
 
-// Top-Level parsing
-static void HandleFuncDefinition() {
-	if (auto FnAST = ParseFunc()) {
-		FnAST->codegen();
-	}
-	else {
-		// Skip token for error recovery.
-		getNextToken();
+		return AST.create<ProgramAST>(AST.copyArray<FunctionAST *>(Functions));
 	}
-}
-
-//声明printf函数
-static void DeclarePrintfFunc()
-{
-	std::vector<llvm::Type *> printf_arg_types;
-	printf_arg_types.push_back(Builder.getInt8Ty()->getPointerTo());
-	FunctionType *printType = FunctionType::get(
-		IntegerType::getInt32Ty(TheContext), printf_arg_types, true);
-	printFunc = llvm::Function::Create(printType, llvm::Function::ExternalLinkage,
-									   llvm::Twine("printf"), TheModule);
-	printFunc->setCallingConv(llvm::CallingConv::C);
-
-	std::vector<std::string> ArgNames;
-	FunctionProtos["printf"] = std::move(llvm::make_unique<PrototypeAST>("printf", std::move(ArgNames)));
-}
 
-//program ::= function_list
-static void MainLoop() {
-	DeclarePrintfFunc();
-	while(CurTok != TOK_EOF)
-		HandleFuncDefinition();
+public:
+	unsigned NumErrors = 0;	//本分析器报告的错误数
 
-	if (emitIR)
-	{
-		std::string IRstr;
-		FILE *IRFile = fopen("IRCode.ll", "w");
-		raw_string_ostream *rawStr = new raw_string_ostream(IRstr);
-		TheModule->print(*rawStr, nullptr);
-		fprintf(IRFile, "%s\n", rawStr->str().c_str());
-	}
+	Parser(Lexer &Lex, ASTContext &AST) : Lex(Lex), AST(AST) {}
 
-	if(!emitObj)
-	{
-		Function *main = getFunction("main");
-		if (!main)
-			printf("main is null");
-		std::string errStr;
-		ExecutionEngine *EE = EngineBuilder(std::move(Owner)).setErrorStr(&errStr).create();
-		if (!EE)
-		{
-			errs() << "Failed to construct ExecutionEngine: " << errStr << "\n";
-			return;
+	//分析单词数组中的所有函数,出错的函数被丢弃,从下一个 FUNC 继续
+	void ParseFunctions(std::vector<FunctionAST *> &Functions) {
+		TokIdx = 0;
+		getNextToken();
+		while (CurTok != TOK_EOF) {
+			if (auto FnAST = ParseFunc())
+				Functions.push_back(FnAST);
+			else
+				skipToNextFunc();
 		}
-		std::vector<GenericValue> noarg;
-		GenericValue gv = EE->runFunction(main, noarg);
 	}
-}
+};
 #endif
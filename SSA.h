@@ -0,0 +1,142 @@
+#ifndef __SSA_H__
+#define __SSA_H__
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/ValueHandle.h"
+
+using namespace llvm;
+
+//生成代码时直接构造 SSA(Braun 等,"Simple and Efficient Construction of Static Single
+//Assignment Form",CC 2013):记录每个基本块中每个变量的当前值,读变量时沿前驱查找,
+//需要时插入 phi。还可能有新前驱的块是"未封闭"的,其中的 phi 先不填操作数,
+//块封闭(所有前驱都已生成)时再补上;只有一个不同操作数的 phi 随即删除。
+//变量用从 1 开始的编号表示,类型都是 i32
+class SSABuilder {
+	Type *Ty;
+	//块 -> (变量 -> 当前值),删除平凡 phi 时 RAUW 会自动更新这里的值
+	DenseMap<BasicBlock *, DenseMap<unsigned, WeakTrackingVH>> CurrentDef;
+	DenseMap<BasicBlock *, SmallVector<std::pair<unsigned, PHINode *>, 4>> IncompletePhis;
+	SmallPtrSet<BasicBlock *, 32> Sealed;
+	std::vector<StringRef> VarNames;	//下标为变量编号,用于给 phi 命名
+
+	PHINode *newPhi(unsigned Var, BasicBlock *BB) {
+		++NumPhis;
+		if (BB->empty())
+			return PHINode::Create(Ty, 0, VarNames[Var], BB);
+		return PHINode::Create(Ty, 0, VarNames[Var], &BB->front());
+	}
+
+	Value *readVariableRecursive(unsigned Var, BasicBlock *BB) {
+		Value *Val;
+		if (!Sealed.count(BB)) {
+			PHINode *Phi = newPhi(Var, BB);
+			IncompletePhis[BB].push_back(std::make_pair(Var, Phi));
+			Val = Phi;
+		}
+		else if (BasicBlock *Pred = BB->getSinglePredecessor()) {
+			Val = readVariable(Var, Pred);
+		}
+		else if (pred_begin(BB) == pred_end(BB)) {
+			//不可达的块(如 RETURN 之后)
+			Val = UndefValue::get(Ty);
+		}
+		else {
+			//先记下 phi 以打断循环中的递归
+			PHINode *Phi = newPhi(Var, BB);
+			writeVariable(Var, BB, Phi);
+			Val = addPhiOperands(Var, Phi);
+		}
+		writeVariable(Var, BB, Val);
+		return Val;
+	}
+
+	Value *addPhiOperands(unsigned Var, PHINode *Phi) {
+		BasicBlock *BB = Phi->getParent();
+		for (auto PI = pred_begin(BB), PE = pred_end(BB); PI != PE; ++PI)
+			Phi->addIncoming(readVariable(Var, *PI), *PI);
+		return tryRemoveTrivialPhi(Phi);
+	}
+
+	//所有操作数(除自身和未定义值外)都相同的 phi 用该值代替;没有这样的操作数时值未定义。
+	//未定义值来自不可达的前驱(如 RETURN 之后的块)
+	Value *tryRemoveTrivialPhi(PHINode *Phi) {
+		Value *Same = nullptr;
+		for (Value *Op : Phi->incoming_values()) {
+			if (Op == Same || Op == Phi || isa<UndefValue>(Op))
+				continue;
+			if (Same)
+				return Phi;
+			Same = Op;
+		}
+		if (!Same)
+			Same = UndefValue::get(Ty);
+
+		SmallVector<WeakVH, 8> Users;
+		for (User *U : Phi->users())
+			if (U != Phi && isa<PHINode>(U))
+				Users.push_back(U);
+
+		WeakTrackingVH Result(Same);
+		Phi->replaceAllUsesWith(Same);
+		Phi->eraseFromParent();
+		++NumTrivialPhis;
+
+		//使用它的 phi 可能也变成了平凡的
+		for (WeakVH &U : Users)
+			if (auto *P = dyn_cast_or_null<PHINode>(U))
+				tryRemoveTrivialPhi(P);
+		return Result;
+	}
+
+public:
+	size_t NumPhis = 0;	//插入的 phi
+	size_t NumTrivialPhis = 0;	//其中删去的平凡 phi
+
+	SSABuilder(LLVMContext &C) : Ty(Type::getInt32Ty(C)) {}
+
+	//开始新的函数
+	void reset() {
+		CurrentDef.clear();
+		IncompletePhis.clear();
+		Sealed.clear();
+		VarNames.assign(1, StringRef());
+	}
+
+	unsigned newVariable(StringRef Name) {
+		VarNames.push_back(Name);
+		return VarNames.size() - 1;
+	}
+
+	void writeVariable(unsigned Var, BasicBlock *BB, Value *V) {
+		CurrentDef[BB][Var] = V;
+	}
+
+	Value *readVariable(unsigned Var, BasicBlock *BB) {
+		auto BI = CurrentDef.find(BB);
+		if (BI != CurrentDef.end()) {
+			auto VI = BI->second.find(Var);
+			if (VI != BI->second.end() && VI->second)
+				return VI->second;
+		}
+		return readVariableRecursive(Var, BB);
+	}
+
+	//BB 的所有前驱都已生成
+	void sealBlock(BasicBlock *BB) {
+		auto It = IncompletePhis.find(BB);
+		if (It != IncompletePhis.end()) {
+			auto Phis = std::move(It->second);
+			IncompletePhis.erase(It);
+			for (auto &P : Phis)
+				addPhiOperands(P.first, P.second);
+		}
+		Sealed.insert(BB);
+	}
+};
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef __SCAN_H__
+#define __SCAN_H__
+#include "llvm/Support/MathExtras.h"
+#include <cstdint>
+
+//词法分析中的连续字符扫描:空白、标识符、注释和字符串内容。
+//每个函数返回 [P, End) 中第一个不属于该类字符的位置,
+//SSE2/AVX2 版本每次判断 16/32 个字节,剩余部分用标量版本处理。
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VSL_SCAN_SSE2 1
+#endif
+
+#if defined(VSL_SCAN_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define VSL_SCAN_AVX2 1
+#define VSL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+struct ScanKernels
+{
+	const char *Name;
+	const char *(*SkipSpace)(const char *P, const char *End);	//空白
+	const char *(*SkipIdent)(const char *P, const char *End);	//字母和数字
+	const char *(*SkipLine)(const char *P, const char *End);	//到 '\n' 或 '\r' 为止
+	const char *(*SkipText)(const char *P, const char *End);	//到 '"' 或 '\\' 为止
+};
+
+//标量版本
+static inline bool isSpaceChar(unsigned char C)
+{
+	return C == ' ' || (C >= '\t' && C <= '\r');
+}
+
+static inline bool isIdentChar(unsigned char C)
+{
+	return (unsigned char)(C - '0') < 10 || (unsigned char)((C | 0x20) - 'a') < 26;
+}
+
+static const char *skipSpaceScalar(const char *P, const char *End)
+{
+	while(P != End && isSpaceChar(*P))
+		++P;
+	return P;
+}
+
+static const char *skipIdentScalar(const char *P, const char *End)
+{
+	while(P != End && isIdentChar(*P))
+		++P;
+	return P;
+}
+
+static const char *skipLineScalar(const char *P, const char *End)
+{
+	while(P != End && *P != '\n' && *P != '\r')
+		++P;
+	return P;
+}
+
+static const char *skipTextScalar(const char *P, const char *End)
+{
+	while(P != End && *P != '"' && *P != '\\')
+		++P;
+	return P;
+}
+
+static const ScanKernels ScalarScan = {
+	"scalar", skipSpaceScalar, skipIdentScalar, skipLineScalar, skipTextScalar
+};
+
+#ifdef VSL_SCAN_SSE2
+//SSE2 只有有符号比较,先平移 0x80 再比较,得到 Lo <= C <= Hi
+static inline __m128i inRange16(__m128i V, unsigned char Lo, unsigned char Hi)
+{
+	__m128i X = _mm_add_epi8(V, _mm_set1_epi8((char)(0x80 - Lo)));
+	return _mm_cmplt_epi8(X, _mm_set1_epi8((char)(0x80 + Hi - Lo + 1)));
+}
+
+//各函数返回"停止字符"的位掩码
+static inline unsigned stopSpace16(__m128i V)
+{
+	__m128i M = _mm_or_si128(_mm_cmpeq_epi8(V, _mm_set1_epi8(' ')),
+		inRange16(V, '\t', '\r'));
+	return ~_mm_movemask_epi8(M) & 0xFFFF;
+}
+
+static inline unsigned stopIdent16(__m128i V)
+{
+	__m128i M = _mm_or_si128(inRange16(V, '0', '9'),
+		inRange16(_mm_or_si128(V, _mm_set1_epi8(0x20)), 'a', 'z'));
+	return ~_mm_movemask_epi8(M) & 0xFFFF;
+}
+
+static inline unsigned stopLine16(__m128i V)
+{
+	return _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(V, _mm_set1_epi8('\n')),
+		_mm_cmpeq_epi8(V, _mm_set1_epi8('\r'))));
+}
+
+static inline unsigned stopText16(__m128i V)
+{
+	return _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(V, _mm_set1_epi8('"')),
+		_mm_cmpeq_epi8(V, _mm_set1_epi8('\\'))));
+}
+
+#define VSL_SCAN_LOOP16(STOP, TAIL)											\
+	for(; End - P >= 16; P += 16)											\
+	{																		\
+		unsigned Mask = STOP(_mm_loadu_si128((const __m128i *)P));			\
+		if(Mask)															\
+			return P + llvm::countTrailingZeros(Mask);						\
+	}																		\
+	return TAIL(P, End);
+
+static const char *skipSpaceSSE2(const char *P, const char *End) { VSL_SCAN_LOOP16(stopSpace16, skipSpaceScalar) }
+static const char *skipIdentSSE2(const char *P, const char *End) { VSL_SCAN_LOOP16(stopIdent16, skipIdentScalar) }
+static const char *skipLineSSE2(const char *P, const char *End) { VSL_SCAN_LOOP16(stopLine16, skipLineScalar) }
+static const char *skipTextSSE2(const char *P, const char *End) { VSL_SCAN_LOOP16(stopText16, skipTextScalar) }
+
+static const ScanKernels SSE2Scan = {
+	"sse2", skipSpaceSSE2, skipIdentSSE2, skipLineSSE2, skipTextSSE2
+};
+#endif
+
+#ifdef VSL_SCAN_AVX2
+VSL_TARGET_AVX2 static inline __m256i inRange32(__m256i V, unsigned char Lo, unsigned char Hi)
+{
+	__m256i X = _mm256_add_epi8(V, _mm256_set1_epi8((char)(0x80 - Lo)));
+	return _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(0x80 + Hi - Lo + 1)), X);
+}
+
+VSL_TARGET_AVX2 static inline unsigned stopSpace32(__m256i V)
+{
+	__m256i M = _mm256_or_si256(_mm256_cmpeq_epi8(V, _mm256_set1_epi8(' ')),
+		inRange32(V, '\t', '\r'));
+	return ~(unsigned)_mm256_movemask_epi8(M);
+}
+
+VSL_TARGET_AVX2 static inline unsigned stopIdent32(__m256i V)
+{
+	__m256i M = _mm256_or_si256(inRange32(V, '0', '9'),
+		inRange32(_mm256_or_si256(V, _mm256_set1_epi8(0x20)), 'a', 'z'));
+	return ~(unsigned)_mm256_movemask_epi8(M);
+}
+
+VSL_TARGET_AVX2 static inline unsigned stopLine32(__m256i V)
+{
+	return (unsigned)_mm256_movemask_epi8(_mm256_or_si256(
+		_mm256_cmpeq_epi8(V, _mm256_set1_epi8('\n')),
+		_mm256_cmpeq_epi8(V, _mm256_set1_epi8('\r'))));
+}
+
+VSL_TARGET_AVX2 static inline unsigned stopText32(__m256i V)
+{
+	return (unsigned)_mm256_movemask_epi8(_mm256_or_si256(
+		_mm256_cmpeq_epi8(V, _mm256_set1_epi8('"')),
+		_mm256_cmpeq_epi8(V, _mm256_set1_epi8('\\'))));
+}
+
+//不足 32 字节的部分交给 SSE2 版本
+#define VSL_SCAN_LOOP32(STOP, TAIL)											\
+	for(; End - P >= 32; P += 32)											\
+	{																		\
+		unsigned Mask = STOP(_mm256_loadu_si256((const __m256i *)P));		\
+		if(Mask)															\
+			return P + llvm::countTrailingZeros(Mask);						\
+	}																		\
+	return TAIL(P, End);
+
+VSL_TARGET_AVX2 static const char *skipSpaceAVX2(const char *P, const char *End) { VSL_SCAN_LOOP32(stopSpace32, skipSpaceSSE2) }
+VSL_TARGET_AVX2 static const char *skipIdentAVX2(const char *P, const char *End) { VSL_SCAN_LOOP32(stopIdent32, skipIdentSSE2) }
+VSL_TARGET_AVX2 static const char *skipLineAVX2(const char *P, const char *End) { VSL_SCAN_LOOP32(stopLine32, skipLineSSE2) }
+VSL_TARGET_AVX2 static const char *skipTextAVX2(const char *P, const char *End) { VSL_SCAN_LOOP32(stopText32, skipTextSSE2) }
+
+static const ScanKernels AVX2Scan = {
+	"avx2", skipSpaceAVX2, skipIdentAVX2, skipLineAVX2, skipTextAVX2
+};
+#endif
+
+//运行时根据 CPU 支持的指令集选择扫描函数
+static const ScanKernels &selectScanKernels()
+{
+#ifdef VSL_SCAN_AVX2
+	if(__builtin_cpu_supports("avx2"))
+		return AVX2Scan;
+#endif
+#ifdef VSL_SCAN_SSE2
+	return SSE2Scan;
+#else
+	return ScalarScan;
+#endif
+}
+
+#endif
@@ -0,0 +1,273 @@
+#ifndef __SIMPLIFY_H__
+#define __SIMPLIFY_H__
+#include "AST.h"
+
+//化简的统计信息
+struct SimplifyStats {
+	size_t FoldedExprs = 0;	//折叠为常数或化简掉的运算
+	size_t PrunedBranches = 0;	//条件为常数而删去的 IF/WHILE 分支
+	size_t DroppedStats = 0;	//RETURN 之后删去的语句
+
+	SimplifyStats &operator+=(const SimplifyStats &O) {
+		FoldedExprs += O.FoldedExprs;
+		PrunedBranches += O.PrunedBranches;
+		DroppedStats += O.DroppedStats;
+		return *this;
+	}
+};
+
+//语法树化简:在语法分析之后、代码生成之前运行。
+//折叠常量表达式,删去条件为常数的 IF/WHILE 中不会执行的分支,删去 RETURN 之后的语句,
+//使交给 LLVM 的 IR 更少。节点是只读的,有变化的节点重新从函数所在的内存池分配,
+//没有变化的子树原样共享。
+//块中的声明只在块内可见,但不在块中的 VAR 语句(如 IF c THEN VAR x FI)声明的变量
+//在外层块后面的语句中仍然可见,所以直接含有这种声明的语句总是保留
+class ASTSimplifier {
+	ASTContext &Ctx;
+	SimplifyStats &Stats;
+
+	static bool hasDecls(StatAST *S) {
+		if (!S)
+			return false;
+		switch (S->getKind()) {
+		case StatAST::SK_Dec:
+			return true;
+		case StatAST::SK_If:
+			return hasDecls(cast<IfStatAST>(S)->getThen()) ||
+				hasDecls(cast<IfStatAST>(S)->getElse());
+		case StatAST::SK_While:
+			return hasDecls(cast<WhileStatAST>(S)->getBody());
+		default:
+			return false;
+		}
+	}
+
+	//按 32 位补码计算;除以 0 和溢出的除法留到运行时
+	static bool foldBinary(char Op, int32_t L, int32_t R, int32_t &Result) {
+		switch (Op) {
+		case '+':
+			Result = (int32_t)((uint32_t)L + (uint32_t)R);
+			return true;
+		case '-':
+			Result = (int32_t)((uint32_t)L - (uint32_t)R);
+			return true;
+		case '*':
+			Result = (int32_t)((uint32_t)L * (uint32_t)R);
+			return true;
+		case '/':
+			if (R == 0 || (L == INT32_MIN && R == -1))
+				return false;
+			Result = L / R;
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	static bool isConstant(StatAST *E, int32_t Val) {
+		auto *N = dyn_cast_or_null<NumberExprAST>(E);
+		return N && N->getVal() == Val;
+	}
+
+	StatAST *simplifyBinary(BinaryExprAST *B) {
+		StatAST *L = simplifyExpr(B->getLHS());
+		StatAST *R = simplifyExpr(B->getRHS());
+		if (!L || !R)
+			return B;
+		char Op = B->getOp();
+
+		auto *LN = dyn_cast<NumberExprAST>(L);
+		auto *RN = dyn_cast<NumberExprAST>(R);
+		int32_t Val;
+		if (LN && RN && foldBinary(Op, LN->getVal(), RN->getVal(), Val)) {
+			++Stats.FoldedExprs;
+			return Ctx.create<NumberExprAST>(Val);
+		}
+
+		//x+0, 0+x, x-0, x*1, 1*x, x/1:另一个操作数仍然只求值一次
+		if (((Op == '+' || Op == '-') && isConstant(R, 0)) ||
+			((Op == '*' || Op == '/') && isConstant(R, 1))) {
+			++Stats.FoldedExprs;
+			return L;
+		}
+		if ((Op == '+' && isConstant(L, 0)) || (Op == '*' && isConstant(L, 1))) {
+			++Stats.FoldedExprs;
+			return R;
+		}
+
+		if (L == B->getLHS() && R == B->getRHS())
+			return B;
+		return Ctx.create<BinaryExprAST>(Op, L, R);
+	}
+
+	//化简语句列表,Returns 表示列表中一定会执行 RETURN
+	ArrayRef<StatAST *> simplifyList(ArrayRef<StatAST *> List, bool &Returns) {
+		SmallVector<StatAST *, 16> NewList;
+		bool Changed = false;
+		Returns = false;
+		for (StatAST *S : List) {
+			if (Returns && !hasDecls(S)) {
+				++Stats.DroppedStats;
+				Changed = true;
+				continue;
+			}
+			StatAST *N = Returns ? S : simplifyStat(S, Returns);
+			//被删去的分支化简为空语句,不再放进列表
+			if (N != S && N && isa<NullStatAST>(N)) {
+				Changed = true;
+				continue;
+			}
+			Changed |= N != S;
+			NewList.push_back(N);
+		}
+		if (!Changed)
+			return List;
+		return Ctx.copyArray<StatAST *>(NewList);
+	}
+
+public:
+	ASTSimplifier(ASTContext &Ctx, SimplifyStats &Stats) : Ctx(Ctx), Stats(Stats) {}
+
+	StatAST *simplifyExpr(StatAST *E) {
+		if (!E)
+			return nullptr;
+		switch (E->getKind()) {
+		case StatAST::SK_Neg: {
+			StatAST *Op = simplifyExpr(cast<NegExprAST>(E)->getExpr());
+			if (auto *N = dyn_cast_or_null<NumberExprAST>(Op)) {
+				++Stats.FoldedExprs;
+				return Ctx.create<NumberExprAST>((int32_t)(0u - (uint32_t)N->getVal()));
+			}
+			if (Op == cast<NegExprAST>(E)->getExpr())
+				return E;
+			return Ctx.create<NegExprAST>(Op);
+		}
+		case StatAST::SK_Binary:
+			return simplifyBinary(cast<BinaryExprAST>(E));
+		case StatAST::SK_Call: {
+			auto *C = cast<CallExprAST>(E);
+			SmallVector<StatAST *, 8> Args;
+			bool Changed = false;
+			for (StatAST *A : C->getArgs()) {
+				Args.push_back(simplifyExpr(A));
+				Changed |= Args.back() != A;
+			}
+			if (!Changed)
+				return E;
+			return Ctx.create<CallExprAST>(C->getCallee(), Ctx.copyArray<StatAST *>(Args));
+		}
+		case StatAST::SK_Index: {
+			auto *I = cast<IndexExprAST>(E);
+			StatAST *Idx = simplifyExpr(I->getIndex());
+			if (Idx == I->getIndex())
+				return E;
+			return Ctx.create<IndexExprAST>(I->getSym(), Idx);
+		}
+		default:
+			return E;
+		}
+	}
+
+	//Returns 表示这条语句一定会执行 RETURN,其后的语句不可达
+	StatAST *simplifyStat(StatAST *S, bool &Returns) {
+		Returns = false;
+		if (!S)
+			return nullptr;
+		switch (S->getKind()) {
+		case StatAST::SK_Block: {
+			auto *B = cast<BlockStatAST>(S);
+			ArrayRef<StatAST *> List = simplifyList(B->getStatList(), Returns);
+			if (List.data() == B->getStatList().data())
+				return S;
+			return Ctx.create<BlockStatAST>(B->getDecList(), List);
+		}
+		case StatAST::SK_Print: {
+			auto *P = cast<PrintStatAST>(S);
+			SmallVector<StatAST *, 8> Exprs;
+			bool Changed = false;
+			for (StatAST *E : P->getExprs()) {
+				Exprs.push_back(simplifyExpr(E));
+				Changed |= Exprs.back() != E;
+			}
+			if (!Changed)
+				return S;
+			return Ctx.create<PrintStatAST>(P->getTexts(), Ctx.copyArray<StatAST *>(Exprs));
+		}
+		case StatAST::SK_If: {
+			auto *I = cast<IfStatAST>(S);
+			StatAST *Cond = simplifyExpr(I->getCond());
+			if (auto *N = dyn_cast_or_null<NumberExprAST>(Cond)) {
+				StatAST *Taken = N->getVal() ? I->getThen() : I->getElse();
+				StatAST *Skipped = N->getVal() ? I->getElse() : I->getThen();
+				if (!hasDecls(Skipped)) {
+					++Stats.PrunedBranches;
+					if (!Taken)
+						return Ctx.create<NullStatAST>();
+					return simplifyStat(Taken, Returns);
+				}
+			}
+			bool ThenReturns, ElseReturns = false;
+			StatAST *Then = simplifyStat(I->getThen(), ThenReturns);
+			StatAST *Else = simplifyStat(I->getElse(), ElseReturns);
+			Returns = ThenReturns && ElseReturns;
+			if (Cond == I->getCond() && Then == I->getThen() && Else == I->getElse())
+				return S;
+			return Ctx.create<IfStatAST>(Cond, Then, Else);
+		}
+		case StatAST::SK_While: {
+			auto *W = cast<WhileStatAST>(S);
+			StatAST *Cond = simplifyExpr(W->getCond());
+			if (isConstant(Cond, 0) && !hasDecls(W->getBody())) {
+				++Stats.PrunedBranches;
+				return Ctx.create<NullStatAST>();
+			}
+			//循环体可能一次也不执行,其中的 RETURN 不影响后面的语句
+			bool BodyReturns;
+			StatAST *Body = simplifyStat(W->getBody(), BodyReturns);
+			if (Cond == W->getCond() && Body == W->getBody())
+				return S;
+			return Ctx.create<WhileStatAST>(Cond, Body);
+		}
+		case StatAST::SK_Ret: {
+			auto *R = cast<RetStatAST>(S);
+			Returns = true;
+			StatAST *Val = simplifyExpr(R->getVal());
+			if (Val == R->getVal())
+				return S;
+			return Ctx.create<RetStatAST>(Val);
+		}
+		case StatAST::SK_Assign: {
+			auto *A = cast<AssStatAST>(S);
+			StatAST *E = simplifyExpr(A->getExpr());
+			if (E == A->getExpr())
+				return S;
+			return Ctx.create<AssStatAST>(A->getName(), E);
+		}
+		case StatAST::SK_ArrayAssign: {
+			auto *A = cast<ArrayAssStatAST>(S);
+			StatAST *Idx = simplifyExpr(A->getIndex()), *E = simplifyExpr(A->getExpr());
+			if (Idx == A->getIndex() && E == A->getExpr())
+				return S;
+			return Ctx.create<ArrayAssStatAST>(A->getSym(), Idx, E);
+		}
+		default:
+			return simplifyExpr(S);
+		}
+	}
+
+	void simplifyFunction(FunctionAST *F) {
+		bool Returns;
+		F->setBody(simplifyStat(F->getBody(), Returns));
+	}
+};
+
+//化简 Functions 中的所有函数,新节点从 Ctx 分配
+static void SimplifyFunctions(ASTContext &Ctx, ArrayRef<FunctionAST *> Functions,
+	SimplifyStats &Stats) {
+	ASTSimplifier S(Ctx, Stats);
+	for (FunctionAST *F : Functions)
+		if (F)
+			S.simplifyFunction(F);
+}
+
+#endif
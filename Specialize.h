@@ -0,0 +1,503 @@
+#ifndef __SPECIALIZE_H__
+#define __SPECIALIZE_H__
+#include "AST.h"
+#include "Simplify.h"
+#include "llvm/ADT/SmallSet.h"
+
+//函数特化的统计信息
+struct SpecializeStats {
+	size_t Clones = 0;	//生成的特化函数
+	size_t CallSites = 0;	//改为调用特化函数的调用
+	size_t ClonedNodes = 0;	//特化函数的语法树节点数
+};
+
+//常量实参的函数特化:实参中有整数常量的调用 f(..., 10, ...) 改为调用 f 的副本 f.<实参>,
+//副本中对应的形参替换为常量后再化简,只保留其余的形参。
+//例如 f(n, 10) 的副本名为 "f._,10",只有形参 n。名字中有 '.',不会与源程序中的函数重名。
+//只替换函数体中没有被赋值、也没有被 VAR 重新声明的形参,其他位置的实参照常传递。
+//副本中的调用同样处理,所以 f(n - 1, k) 在 f._,10 中变为对自身的调用。
+//
+//函数只能调用在它之前定义的函数(以及自身),副本放在被特化的函数之后:
+//源程序中的函数调用的副本排在同一函数已有副本之后,副本中新产生的副本插在该副本之前,
+//只有排在调用者之前的副本(或调用者自身)才能被调用,否则保持原来的调用;
+//所以源程序中的函数对自身的调用(如 ack 中的 ack(m - 1, 1))不特化,副本中的才特化。
+//为避免代码膨胀,只特化不超过 MaxCalleeNodes 个节点的函数,每个函数至多 MaxClones 个副本,
+//所有副本的节点总数不超过程序的一半加 MinBudget
+class FunctionSpecializer {
+	struct Clone;
+
+	//源程序中的一个函数
+	struct FuncInfo {
+		FunctionAST *F;
+		unsigned Index;	//在源程序中的序号
+		size_t Nodes = 0;
+		std::vector<bool> CanSubst;	//每个形参能否替换为常量
+		std::vector<Clone *> Clones;	//按在程序中的顺序
+		std::map<std::vector<std::pair<bool, int>>, Clone *> ByArgs;	//(是否常量, 值) -> 副本
+	};
+
+	struct Clone {
+		FuncInfo *Orig;
+		FunctionAST *F;
+	};
+
+	//正在改写的函数:源程序中的函数或某个副本
+	struct Caller {
+		FuncInfo *Orig;
+		Clone *C;	//源程序中的函数时为空
+	};
+
+	ASTContext &Ctx;
+	StringInterner &Symbols;
+	SpecializeStats &Stats;
+	std::vector<std::unique_ptr<FuncInfo>> Funcs;
+	DenseMap<unsigned, FuncInfo *> Index;	//函数名的符号编号 -> 函数,重定义的函数不特化
+	std::vector<std::unique_ptr<Clone>> AllClones;
+	std::vector<Clone *> Worklist;	//按生成顺序的副本,逐个改写其函数体
+	size_t Budget;
+
+	static size_t countNodes(StatAST *S) {
+		if (!S)
+			return 0;
+		switch (S->getKind()) {
+		case StatAST::SK_Neg:
+			return 1 + countNodes(cast<NegExprAST>(S)->getExpr());
+		case StatAST::SK_Binary:
+			return 1 + countNodes(cast<BinaryExprAST>(S)->getLHS()) +
+				countNodes(cast<BinaryExprAST>(S)->getRHS());
+		case StatAST::SK_Call: {
+			size_t N = 1;
+			for (StatAST *A : cast<CallExprAST>(S)->getArgs())
+				N += countNodes(A);
+			return N;
+		}
+		case StatAST::SK_Block: {
+			size_t N = 1;
+			for (StatAST *C : cast<BlockStatAST>(S)->getStatList())
+				N += countNodes(C);
+			return N;
+		}
+		case StatAST::SK_Print: {
+			size_t N = 1;
+			for (StatAST *E : cast<PrintStatAST>(S)->getExprs())
+				N += countNodes(E);
+			return N;
+		}
+		case StatAST::SK_If:
+			return 1 + countNodes(cast<IfStatAST>(S)->getCond()) +
+				countNodes(cast<IfStatAST>(S)->getThen()) + countNodes(cast<IfStatAST>(S)->getElse());
+		case StatAST::SK_While:
+			return 1 + countNodes(cast<WhileStatAST>(S)->getCond()) +
+				countNodes(cast<WhileStatAST>(S)->getBody());
+		case StatAST::SK_Ret:
+			return 1 + countNodes(cast<RetStatAST>(S)->getVal());
+		case StatAST::SK_Assign:
+			return 1 + countNodes(cast<AssStatAST>(S)->getExpr());
+		case StatAST::SK_Index:
+			return 1 + countNodes(cast<IndexExprAST>(S)->getIndex());
+		case StatAST::SK_ArrayAssign:
+			return 1 + countNodes(cast<ArrayAssStatAST>(S)->getIndex()) +
+				countNodes(cast<ArrayAssStatAST>(S)->getExpr());
+		default:
+			return 1;
+		}
+	}
+
+	//收集函数体中被赋值或重新声明的变量
+	static void collectWrites(StatAST *S, SmallSet<unsigned, 8> &Writes) {
+		if (!S)
+			return;
+		switch (S->getKind()) {
+		case StatAST::SK_Dec:
+			for (unsigned Sym : cast<DecAST>(S)->getVarNames())
+				Writes.insert(Sym);
+			break;
+		case StatAST::SK_Block:
+			for (DecAST *D : cast<BlockStatAST>(S)->getDecList())
+				collectWrites(D, Writes);
+			for (StatAST *C : cast<BlockStatAST>(S)->getStatList())
+				collectWrites(C, Writes);
+			break;
+		case StatAST::SK_If:
+			collectWrites(cast<IfStatAST>(S)->getThen(), Writes);
+			collectWrites(cast<IfStatAST>(S)->getElse(), Writes);
+			break;
+		case StatAST::SK_While:
+			collectWrites(cast<WhileStatAST>(S)->getBody(), Writes);
+			break;
+		case StatAST::SK_Assign:
+			Writes.insert(cast<AssStatAST>(S)->getName()->getSym());
+			break;
+		default:
+			break;
+		}
+	}
+
+	//把形参替换为常量,Consts 为形参符号 -> 常量
+	struct Substituter {
+		ASTContext &Ctx;
+		const SmallDenseMap<unsigned, int, 4> &Consts;
+
+		StatAST *expr(StatAST *E) {
+			if (!E)
+				return nullptr;
+			switch (E->getKind()) {
+			case StatAST::SK_Variable: {
+				auto It = Consts.find(cast<VariableExprAST>(E)->getSym());
+				if (It == Consts.end())
+					return E;
+				return Ctx.create<NumberExprAST>(It->second);
+			}
+			case StatAST::SK_Neg: {
+				StatAST *Op = expr(cast<NegExprAST>(E)->getExpr());
+				if (Op == cast<NegExprAST>(E)->getExpr())
+					return E;
+				return Ctx.create<NegExprAST>(Op);
+			}
+			case StatAST::SK_Binary: {
+				auto *B = cast<BinaryExprAST>(E);
+				StatAST *L = expr(B->getLHS()), *R = expr(B->getRHS());
+				if (L == B->getLHS() && R == B->getRHS())
+					return E;
+				return Ctx.create<BinaryExprAST>(B->getOp(), L, R);
+			}
+			case StatAST::SK_Call: {
+				auto *C = cast<CallExprAST>(E);
+				SmallVector<StatAST *, 8> Args;
+				bool Changed = false;
+				for (StatAST *A : C->getArgs()) {
+					Args.push_back(expr(A));
+					Changed |= Args.back() != A;
+				}
+				if (!Changed)
+					return E;
+				return Ctx.create<CallExprAST>(C->getCallee(), Ctx.copyArray<StatAST *>(Args));
+			}
+			case StatAST::SK_Index: {
+				auto *I = cast<IndexExprAST>(E);
+				StatAST *Idx = expr(I->getIndex());
+				if (Idx == I->getIndex())
+					return E;
+				return Ctx.create<IndexExprAST>(I->getSym(), Idx);
+			}
+			default:
+				return E;
+			}
+		}
+
+		//语句总是复制一份:RETURN 上的尾递归标记属于所在的函数,不能与原函数共享
+		StatAST *stat(StatAST *S) {
+			if (!S)
+				return nullptr;
+			switch (S->getKind()) {
+			case StatAST::SK_Block: {
+				auto *B = cast<BlockStatAST>(S);
+				SmallVector<StatAST *, 16> List;
+				for (StatAST *C : B->getStatList())
+					List.push_back(stat(C));
+				return Ctx.create<BlockStatAST>(B->getDecList(), Ctx.copyArray<StatAST *>(List));
+			}
+			case StatAST::SK_Print: {
+				auto *P = cast<PrintStatAST>(S);
+				SmallVector<StatAST *, 8> Exprs;
+				for (StatAST *E : P->getExprs())
+					Exprs.push_back(expr(E));
+				return Ctx.create<PrintStatAST>(P->getTexts(), Ctx.copyArray<StatAST *>(Exprs));
+			}
+			case StatAST::SK_If: {
+				auto *I = cast<IfStatAST>(S);
+				return Ctx.create<IfStatAST>(expr(I->getCond()), stat(I->getThen()), stat(I->getElse()));
+			}
+			case StatAST::SK_While: {
+				auto *W = cast<WhileStatAST>(S);
+				return Ctx.create<WhileStatAST>(expr(W->getCond()), stat(W->getBody()));
+			}
+			case StatAST::SK_Ret:
+				return Ctx.create<RetStatAST>(expr(cast<RetStatAST>(S)->getVal()));
+			case StatAST::SK_Assign: {
+				auto *A = cast<AssStatAST>(S);
+				return Ctx.create<AssStatAST>(A->getName(), expr(A->getExpr()));
+			}
+			case StatAST::SK_ArrayAssign: {
+				auto *A = cast<ArrayAssStatAST>(S);
+				return Ctx.create<ArrayAssStatAST>(A->getSym(), expr(A->getIndex()), expr(A->getExpr()));
+			}
+			default:
+				return expr(S);
+			}
+		}
+	};
+
+	//Target 是否排在调用者之前(或就是调用者),只有这样才能调用
+	static bool isVisible(Clone *Target, const Caller &From) {
+		if (!From.C)
+			return Target->Orig->Index < From.Orig->Index;
+		if (Target->Orig != From.Orig)
+			return Target->Orig->Index < From.Orig->Index;
+		for (Clone *C : From.Orig->Clones) {
+			if (C == From.C)
+				return C == Target;
+			if (C == Target)
+				return true;
+		}
+		return false;
+	}
+
+	//为调用 Callee(Args) 查找或生成副本,不能特化时返回空
+	Clone *getClone(FuncInfo *Callee, ArrayRef<StatAST *> Args, const Caller &From) {
+		std::vector<std::pair<bool, int>> Key;
+		bool AnyConst = false;
+		for (unsigned I = 0; I < Args.size(); I++) {
+			auto *N = dyn_cast<NumberExprAST>(Args[I]);
+			if (N && Callee->CanSubst[I]) {
+				Key.push_back(std::make_pair(true, N->getVal()));
+				AnyConst = true;
+			}
+			else
+				Key.push_back(std::make_pair(false, 0));
+		}
+		if (!AnyConst)
+			return nullptr;
+
+		auto It = Callee->ByArgs.find(Key);
+		if (It != Callee->ByArgs.end())
+			return isVisible(It->second, From) ? It->second : nullptr;
+
+		//新的副本:源程序中的调用者排在已有副本之后,副本中的调用插在调用者之前。
+		//源程序中的函数调用自身时副本会排在它之后,不能调用
+		if (Callee == From.Orig ? !From.C : Callee->Index >= From.Orig->Index)
+			return nullptr;
+		if (Callee->Clones.size() >= MaxClones || Callee->Nodes > Budget)
+			return nullptr;
+		Budget -= Callee->Nodes;
+
+		std::string Name = Symbols.getName(Callee->F->getProto()->getSym()).str();
+		SmallDenseMap<unsigned, int, 4> Consts;
+		SmallVector<unsigned, 8> Params;
+		ArrayRef<unsigned> OrigParams = Callee->F->getProto()->getArgs();
+		for (unsigned I = 0; I < Key.size(); I++) {
+			Name += I ? "," : ".";
+			if (Key[I].first) {
+				Name += std::to_string(Key[I].second);
+				Consts[OrigParams[I]] = Key[I].second;
+			}
+			else {
+				Name += "_";
+				Params.push_back(OrigParams[I]);
+			}
+		}
+
+		Substituter Subst{ Ctx, Consts };
+		auto *Proto = Ctx.create<PrototypeAST>(Symbols.intern(Name), Ctx.copyArray<unsigned>(Params));
+		auto *NewF = Ctx.create<FunctionAST>(Proto, Subst.stat(Callee->F->getBody()));
+		NewF->setSpecialized(true);
+
+		AllClones.push_back(llvm::make_unique<Clone>());
+		Clone *C = AllClones.back().get();
+		C->Orig = Callee;
+		C->F = NewF;
+		Callee->ByArgs[Key] = C;
+		if (From.C && From.Orig == Callee)
+			Callee->Clones.insert(std::find(Callee->Clones.begin(), Callee->Clones.end(), From.C), C);
+		else
+			Callee->Clones.push_back(C);
+		Worklist.push_back(C);
+		++Stats.Clones;
+		return C;
+	}
+
+	//改写表达式中的调用,没有变化时返回原节点
+	StatAST *rewriteExpr(StatAST *E, const Caller &From) {
+		if (!E)
+			return nullptr;
+		switch (E->getKind()) {
+		case StatAST::SK_Neg: {
+			StatAST *Op = rewriteExpr(cast<NegExprAST>(E)->getExpr(), From);
+			if (Op == cast<NegExprAST>(E)->getExpr())
+				return E;
+			return Ctx.create<NegExprAST>(Op);
+		}
+		case StatAST::SK_Binary: {
+			auto *B = cast<BinaryExprAST>(E);
+			StatAST *L = rewriteExpr(B->getLHS(), From), *R = rewriteExpr(B->getRHS(), From);
+			if (L == B->getLHS() && R == B->getRHS())
+				return E;
+			return Ctx.create<BinaryExprAST>(B->getOp(), L, R);
+		}
+		case StatAST::SK_Call: {
+			auto *Call = cast<CallExprAST>(E);
+			SmallVector<StatAST *, 8> Args;
+			bool Changed = false;
+			for (StatAST *A : Call->getArgs()) {
+				Args.push_back(rewriteExpr(A, From));
+				Changed |= Args.back() != A;
+			}
+			auto It = Index.find(Call->getCallee());
+			FuncInfo *Callee = It != Index.end() ? It->second : nullptr;
+			Clone *C = nullptr;
+			if (Callee && Callee->F->getProto()->getArgs().size() == Args.size())
+				C = getClone(Callee, Args, From);
+			if (C) {
+				SmallVector<StatAST *, 8> Rest;
+				for (unsigned I = 0; I < Args.size(); I++)
+					if (!isa<NumberExprAST>(Args[I]) || !Callee->CanSubst[I])
+						Rest.push_back(Args[I]);
+				++Stats.CallSites;
+				return Ctx.create<CallExprAST>(C->F->getProto()->getSym(), Ctx.copyArray<StatAST *>(Rest));
+			}
+			if (!Changed)
+				return E;
+			return Ctx.create<CallExprAST>(Call->getCallee(), Ctx.copyArray<StatAST *>(Args));
+		}
+		case StatAST::SK_Index: {
+			auto *I = cast<IndexExprAST>(E);
+			StatAST *Idx = rewriteExpr(I->getIndex(), From);
+			if (Idx == I->getIndex())
+				return E;
+			return Ctx.create<IndexExprAST>(I->getSym(), Idx);
+		}
+		default:
+			return E;
+		}
+	}
+
+	StatAST *rewriteStat(StatAST *S, const Caller &From) {
+		if (!S)
+			return nullptr;
+		switch (S->getKind()) {
+		case StatAST::SK_Block: {
+			auto *B = cast<BlockStatAST>(S);
+			SmallVector<StatAST *, 16> List;
+			bool Changed = false;
+			for (StatAST *C : B->getStatList()) {
+				List.push_back(rewriteStat(C, From));
+				Changed |= List.back() != C;
+			}
+			if (!Changed)
+				return S;
+			return Ctx.create<BlockStatAST>(B->getDecList(), Ctx.copyArray<StatAST *>(List));
+		}
+		case StatAST::SK_Print: {
+			auto *P = cast<PrintStatAST>(S);
+			SmallVector<StatAST *, 8> Exprs;
+			bool Changed = false;
+			for (StatAST *E : P->getExprs()) {
+				Exprs.push_back(rewriteExpr(E, From));
+				Changed |= Exprs.back() != E;
+			}
+			if (!Changed)
+				return S;
+			return Ctx.create<PrintStatAST>(P->getTexts(), Ctx.copyArray<StatAST *>(Exprs));
+		}
+		case StatAST::SK_If: {
+			auto *I = cast<IfStatAST>(S);
+			StatAST *Cond = rewriteExpr(I->getCond(), From);
+			StatAST *Then = rewriteStat(I->getThen(), From), *Else = rewriteStat(I->getElse(), From);
+			if (Cond == I->getCond() && Then == I->getThen() && Else == I->getElse())
+				return S;
+			return Ctx.create<IfStatAST>(Cond, Then, Else);
+		}
+		case StatAST::SK_While: {
+			auto *W = cast<WhileStatAST>(S);
+			StatAST *Cond = rewriteExpr(W->getCond(), From), *Body = rewriteStat(W->getBody(), From);
+			if (Cond == W->getCond() && Body == W->getBody())
+				return S;
+			return Ctx.create<WhileStatAST>(Cond, Body);
+		}
+		case StatAST::SK_Ret: {
+			auto *R = cast<RetStatAST>(S);
+			StatAST *Val = rewriteExpr(R->getVal(), From);
+			if (Val == R->getVal())
+				return S;
+			return Ctx.create<RetStatAST>(Val);
+		}
+		case StatAST::SK_Assign: {
+			auto *A = cast<AssStatAST>(S);
+			StatAST *E = rewriteExpr(A->getExpr(), From);
+			if (E == A->getExpr())
+				return S;
+			return Ctx.create<AssStatAST>(A->getName(), E);
+		}
+		case StatAST::SK_ArrayAssign: {
+			auto *A = cast<ArrayAssStatAST>(S);
+			StatAST *Idx = rewriteExpr(A->getIndex(), From), *E = rewriteExpr(A->getExpr(), From);
+			if (Idx == A->getIndex() && E == A->getExpr())
+				return S;
+			return Ctx.create<ArrayAssStatAST>(A->getSym(), Idx, E);
+		}
+		default:
+			return rewriteExpr(S, From);
+		}
+	}
+
+public:
+	static const size_t MaxCalleeNodes = 200;	//可以特化的函数的大小上限
+	static const size_t MaxClones = 8;	//每个函数的副本数上限
+	static const size_t MinBudget = 1000;
+
+	FunctionSpecializer(ASTContext &Ctx, StringInterner &Symbols, SpecializeStats &Stats)
+		: Ctx(Ctx), Symbols(Symbols), Stats(Stats) {}
+
+	//特化 Functions 中的调用,返回包含副本的新函数列表
+	std::vector<FunctionAST *> run(ArrayRef<FunctionAST *> Functions) {
+		size_t ProgramNodes = 0;
+		for (FunctionAST *F : Functions) {
+			if (!F)
+				continue;
+			Funcs.push_back(llvm::make_unique<FuncInfo>());
+			FuncInfo *FI = Funcs.back().get();
+			FI->F = F;
+			FI->Index = Funcs.size() - 1;
+			FI->Nodes = countNodes(F->getBody());
+			ProgramNodes += FI->Nodes;
+
+			unsigned Sym = F->getProto()->getSym();
+			auto Ins = Index.insert(std::make_pair(Sym, FI));
+			if (!Ins.second) {
+				Ins.first->second->CanSubst.clear();
+				continue;
+			}
+			//能替换为常量的形参:函数体中没有赋值或重新声明
+			SmallSet<unsigned, 8> Writes;
+			collectWrites(F->getBody(), Writes);
+			for (unsigned Arg : F->getProto()->getArgs())
+				FI->CanSubst.push_back(FI->Nodes <= MaxCalleeNodes && !Writes.count(Arg));
+		}
+		//重定义的函数在代码生成时报错,不特化
+		for (auto &FI : Funcs)
+			if (FI->CanSubst.size() != FI->F->getProto()->getArgs().size())
+				FI->CanSubst.assign(FI->F->getProto()->getArgs().size(), false);
+		Budget = ProgramNodes / 2 + MinBudget;
+
+		SimplifyStats SimpStats;
+		ASTSimplifier Simplifier(Ctx, SimpStats);
+		for (auto &FI : Funcs) {
+			Caller From = { FI.get(), nullptr };
+			FI->F->setBody(rewriteStat(FI->F->getBody(), From));
+		}
+		//按生成的顺序处理,避免一连串递归的副本(如 f(10) -> f(9) -> ...)用完某个函数的副本数
+		for (size_t I = 0; I < Worklist.size(); I++) {
+			Clone *C = Worklist[I];
+			Simplifier.simplifyFunction(C->F);
+			Caller From = { C->Orig, C };
+			C->F->setBody(rewriteStat(C->F->getBody(), From));
+			Stats.ClonedNodes += countNodes(C->F->getBody());
+		}
+
+		std::vector<FunctionAST *> Result;
+		for (auto &FI : Funcs) {
+			Result.push_back(FI->F);
+			for (Clone *C : FI->Clones)
+				Result.push_back(C->F);
+		}
+		return Result;
+	}
+};
+
+//特化常量实参的调用,副本加入 Functions,新节点从 Ctx 分配
+static void SpecializeFunctions(ASTContext &Ctx, StringInterner &Symbols,
+	std::vector<FunctionAST *> &Functions, SpecializeStats &Stats) {
+	Functions = FunctionSpecializer(Ctx, Symbols, Stats).run(Functions);
+}
+
+#endif
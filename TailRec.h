@@ -0,0 +1,111 @@
+#ifndef __TAILREC_H__
+#define __TAILREC_H__
+#include "AST.h"
+
+//尾递归的统计信息
+struct TailRecStats {
+	size_t Functions = 0;	//变成循环的函数
+	size_t Calls = 0;	//不再调用的尾递归
+
+	TailRecStats &operator+=(const TailRecStats &O) {
+		Functions += O.Functions;
+		Calls += O.Calls;
+		return *this;
+	}
+};
+
+//尾递归变换:标记 RETURN 中对本函数的直接调用,代码生成时(AST.h 中的 EmitTailRec)
+//给形参赋新值后跳回函数开头,不再占用新的栈帧。
+//RETURN e op f(...) 和 RETURN f(...) op e (op 为 +、-、*) 引入累加器:
+//函数的返回值总是写成 Mul * r + Add,r 为余下递归的结果,按 32 位补码计算是精确的。
+//f(...) op e 中 e 会提前到递归调用之前求值,所以只在 e 不含函数调用时变换
+//(变量都是局部的,递归调用不会改变 e 的值)
+class TailRecMarker {
+	PrototypeAST *Proto;
+	size_t NumCalls = 0;
+
+	static bool hasCalls(StatAST *E) {
+		switch (E->getKind()) {
+		case StatAST::SK_Call:
+			return true;
+		case StatAST::SK_Neg:
+			return hasCalls(cast<NegExprAST>(E)->getExpr());
+		case StatAST::SK_Binary:
+			return hasCalls(cast<BinaryExprAST>(E)->getLHS()) ||
+				hasCalls(cast<BinaryExprAST>(E)->getRHS());
+		case StatAST::SK_Index:
+			return hasCalls(cast<IndexExprAST>(E)->getIndex());
+		default:
+			return false;
+		}
+	}
+
+	bool isSelfCall(StatAST *E) const {
+		auto *C = dyn_cast_or_null<CallExprAST>(E);
+		return C && C->getCallee() == Proto->getSym() &&
+			C->getArgs().size() == Proto->getArgs().size();
+	}
+
+	StatAST::TailRecKind classify(StatAST *Val) const {
+		if (isSelfCall(Val))
+			return StatAST::TR_Call;
+		auto *B = dyn_cast_or_null<BinaryExprAST>(Val);
+		if (!B || (B->getOp() != '+' && B->getOp() != '-' && B->getOp() != '*'))
+			return StatAST::TR_None;
+		//e 先于递归调用求值,与原来的顺序相同
+		if (isSelfCall(B->getRHS()))
+			return StatAST::TR_CallRight;
+		if (isSelfCall(B->getLHS()) && !hasCalls(B->getRHS()))
+			return StatAST::TR_CallLeft;
+		return StatAST::TR_None;
+	}
+
+	void visit(StatAST *S) {
+		if (!S)
+			return;
+		switch (S->getKind()) {
+		case StatAST::SK_Block:
+			for (StatAST *C : cast<BlockStatAST>(S)->getStatList())
+				visit(C);
+			break;
+		case StatAST::SK_If:
+			visit(cast<IfStatAST>(S)->getThen());
+			visit(cast<IfStatAST>(S)->getElse());
+			break;
+		case StatAST::SK_While:
+			visit(cast<WhileStatAST>(S)->getBody());
+			break;
+		case StatAST::SK_Ret: {
+			auto *R = cast<RetStatAST>(S);
+			R->setTailRec(classify(R->getVal()));
+			NumCalls += R->getTailRec() != StatAST::TR_None;
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+public:
+	TailRecMarker(PrototypeAST *Proto) : Proto(Proto) {}
+
+	//返回标记的尾递归调用个数
+	size_t markFunction(FunctionAST *F) {
+		visit(F->getBody());
+		F->setTailRec(NumCalls != 0);
+		return NumCalls;
+	}
+};
+
+static void MarkTailRecursion(ArrayRef<FunctionAST *> Functions, TailRecStats &Stats) {
+	for (FunctionAST *F : Functions) {
+		if (!F)
+			continue;
+		if (size_t N = TailRecMarker(F->getProto()).markFunction(F)) {
+			++Stats.Functions;
+			Stats.Calls += N;
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef __TIER_H__
+#define __TIER_H__
+#include "AST.h"
+#include "VSLJIT.h"
+#include "llvm/ADT/DenseSet.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+//分层执行(-tier):整个程序先以 -O0 生成和编译(基线层),生成机器码的开销最小。
+//插入了计数器的函数 F(见 AST.h 中的 TierCounter)的函数体改名为 F.tier0,
+//对 F 的调用都经过 JIT 中名为 F 的间接跳转桩,桩开始时指向 F.tier0。
+//F 的入口和回边计数达到阈值时,生成的代码调用 TierManager::tierUp 把 F 放入队列,
+//后台线程在新的上下文中以较高的优化级别单独生成 F 的代码 F.tier2,加入 JIT 后把桩改为指向它。
+//F.tier2 中调用其他函数仍经过桩(总是进入它们当前最好的代码),只有对自身的调用是直接的。
+//已经在运行的 F.tier0 不受影响(没有栈上替换),之后的调用才进入优化的代码,
+//所以只调用一次的 main 不插入计数器。main 返回时放弃队列中还没有开始生成的函数
+
+//把模块 M 中定义的函数 Name 改名为 Name.tier0,模块中对它的调用改为调用外部声明 Name(即 JIT 中的桩)
+static void MoveToTier0(Module &M, StringRef Name) {
+	Function *F = M.getFunction(Name);
+	if (!F || F->isDeclaration())
+		return;
+	std::string N = Name.str();
+	F->setName(N + ".tier0");
+	Function *Decl = Function::Create(F->getFunctionType(), Function::ExternalLinkage, N, &M);
+	F->replaceAllUsesWith(Decl);
+}
+
+//升级队列和生成优化代码的后台线程
+class TierManager {
+public:
+	struct Record {
+		unsigned Sym;	//函数名的符号编号
+		double HotMs;	//计数达到阈值的时间,从 main 开始运行算起
+		double InstalledMs = -1;	//桩改为指向优化代码的时间,没有完成时为负
+		double CompileMs = 0;	//生成优化代码所用的时间
+	};
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	orc::VSLJIT &JIT;
+	StringInterner &Symbols;
+	DenseMap<unsigned, FunctionAST *> FuncBySym;
+	std::function<void(CodeGenContext &)> InitCodeGen;	//按优化代码的选项初始化新的上下文
+	Clock::time_point Start;
+	std::mutex Lock;	//保护以下成员
+	std::condition_variable Wakeup;
+	std::deque<size_t> Queue;	//等待生成的函数在 Records 中的下标
+	std::vector<Record> Records;
+	DenseSet<unsigned> Requested;	//计数器回绕后不重复升级
+	bool Stopping = false;
+	std::thread Worker;
+	std::vector<std::unique_ptr<CodeGenContext>> Contexts;	//优化代码的模块所在的上下文
+
+	double msSinceStart() const {
+		return std::chrono::duration<double, std::milli>(Clock::now() - Start).count();
+	}
+
+	//单独生成函数 Sym 的优化代码,加入 JIT 后更新它的桩
+	bool compile(unsigned Sym) {
+		FunctionAST *FnAST = FuncBySym.lookup(Sym);
+		if (!FnAST)
+			return false;
+		std::string Name = Symbols.getName(Sym).str();
+		auto C = llvm::make_unique<CodeGenContext>(Symbols, "tier2." + Name);
+		InitCodeGen(*C);
+		//其他函数只生成声明,调用经由 JIT 中的桩
+		for (auto &F : FuncBySym)
+			C->FunctionProtos[F.first] = F.second->getProto();
+		Function *F = FnAST->codegen(*C);
+		if (!F)
+			return false;
+		F->setName(Name + ".tier2");
+		F->setLinkage(Function::ExternalLinkage);
+		OptimizeModule(*C);
+
+		JIT.addModule(std::move(C->Owner));
+		Contexts.push_back(std::move(C));
+		auto Compiled = JIT.findSymbol(Name + ".tier2");
+		if (!Compiled)
+			return false;
+		auto Addr = Compiled.getAddress();
+		if (!Addr) {
+			consumeError(Addr.takeError());
+			return false;
+		}
+		JIT.updateStub(Name, *Addr);
+		return true;
+	}
+
+	void work() {
+		std::unique_lock<std::mutex> L(Lock);
+		for (;;) {
+			Wakeup.wait(L, [this]() { return Stopping || !Queue.empty(); });
+			if (Stopping)
+				return;
+			size_t R = Queue.front();
+			Queue.pop_front();
+			unsigned Sym = Records[R].Sym;
+			L.unlock();
+
+			auto T0 = Clock::now();
+			bool Installed = compile(Sym);
+			double CompileMs = std::chrono::duration<double, std::milli>(Clock::now() - T0).count();
+			double Now = msSinceStart();
+
+			L.lock();
+			Records[R].CompileMs = CompileMs;
+			if (Installed)
+				Records[R].InstalledMs = Now;
+		}
+	}
+
+public:
+	TierManager(orc::VSLJIT &JIT, StringInterner &Symbols, ArrayRef<FunctionAST *> Functions,
+		std::function<void(CodeGenContext &)> InitCodeGen)
+		: JIT(JIT), Symbols(Symbols), InitCodeGen(std::move(InitCodeGen)) {
+		for (FunctionAST *F : Functions)
+			FuncBySym.insert(std::make_pair(F->getProto()->getSym(), F));
+	}
+
+	~TierManager() { stop(); }
+
+	//main 开始运行前启动后台线程
+	void start() {
+		Start = Clock::now();
+		Worker = std::thread([this]() { work(); });
+	}
+
+	//main 返回后停止:正在生成的函数完成后线程退出,队列中其余的函数放弃
+	void stop() {
+		{
+			std::lock_guard<std::mutex> L(Lock);
+			Stopping = true;
+		}
+		Wakeup.notify_one();
+		if (Worker.joinable())
+			Worker.join();
+	}
+
+	//在运行 VSL 程序的线程上调用,只把函数放入队列
+	void request(unsigned Sym) {
+		double Now = msSinceStart();
+		std::lock_guard<std::mutex> L(Lock);
+		if (Stopping || !Requested.insert(Sym).second)
+			return;
+		Record R;
+		R.Sym = Sym;
+		R.HotMs = Now;
+		Records.push_back(R);
+		Queue.push_back(Records.size() - 1);
+		Wakeup.notify_one();
+	}
+
+	//生成的代码中 vsl_tier_up 的实现,Manager 为 JIT 中的 vsl.tier.manager
+	static void tierUp(void *Manager, int32_t Sym) {
+		static_cast<TierManager *>(Manager)->request(Sym);
+	}
+
+	//stop 之后调用
+	const std::vector<Record> &getRecords() const { return Records; }
+};
+
+#endif
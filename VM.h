@@ -0,0 +1,151 @@
+#ifndef __VM_H__
+#define __VM_H__
+#include "Bytecode.h"
+#include "VSLRuntime.h"
+#include <algorithm>
+#include <vector>
+
+//字节码解释器(Bytecode.h 的格式),不依赖 LLVM,PRINT 使用 VSLRuntime.h 中的运行时。
+//GCC/Clang 下用 computed goto 做线索化的分派:每条指令末尾直接跳到下一条指令的处理代码,
+//没有回到循环开头的 switch;其他编译器退回到 switch。
+//所有栈帧的寄存器在一个连续的数组中,调用时按需扩大;调用信息在另一个栈中,
+//VSL 的递归不占用宿主的栈。算术与 JIT 生成的代码相同,按 32 位补码回绕
+class VSLVM {
+	struct CallFrame {
+		const uint32_t *RetPC;
+		size_t Base;	//调用者栈帧的开始
+		uint32_t Dest;	//调用者中接收返回值的寄存器
+	};
+
+	const char *Data;
+	const VMImageHeader *Header = nullptr;
+	const VMFunction *Funcs = nullptr;
+	const uint32_t *Code = nullptr;
+	const char *Strings = nullptr;
+	std::vector<int32_t> Stack;
+	std::vector<CallFrame> Frames;
+
+	//保证从 Base 开始的栈帧有 Size 个寄存器
+	int32_t *reserve(size_t Base, size_t Size) {
+		if (Base + Size > Stack.size())
+			Stack.resize(std::max(Stack.size() * 2, Base + Size));
+		return Stack.data() + Base;
+	}
+
+public:
+	//Data 为整个映像(如 mmap 的文件),须按 4 字节对齐,运行期间保持有效。
+	//装入时检查全部指令(VerifyVMCode),不合法的映像返回 false
+	bool load(const char *Image, size_t Size) {
+		Data = Image;
+		Header = CheckVMImage(Image, Size);
+		if (!Header || !VerifyVMCode(Image, Header)) {
+			Header = nullptr;
+			return false;
+		}
+		Funcs = (const VMFunction *)(Data + Header->FuncsOffset);
+		Code = (const uint32_t *)(Data + Header->CodeOffset);
+		Strings = Data + Header->StringsOffset;
+		return true;
+	}
+
+	//运行 main,返回它的返回值
+	int32_t run() {
+		const VMFunction &Main = Funcs[Header->MainFunc];
+		Stack.assign(std::max<size_t>(Main.FrameSize, 1 << 16), 0);
+		Frames.clear();
+		size_t Base = 0;
+		int32_t *R = Stack.data();
+		const uint32_t *PC = Code + Main.Entry;
+		uint32_t I, A;
+
+#define VM_U(X) ((uint32_t)(X))
+#if defined(__GNUC__)
+		static void *const Labels[] = {
+#define VM_LABEL(Name, Ops) &&L_##Name,
+			VM_OPCODES(VM_LABEL)
+#undef VM_LABEL
+		};
+#define VM_CASE(Name) L_##Name:
+#define VM_NEXT(Words) do { PC += (Words); I = *PC; A = I >> 8; goto *Labels[I & 0xff]; } while (0)
+		VM_NEXT(0);
+#else
+#define VM_CASE(Name) case OP_##Name:
+#define VM_NEXT(Words) do { PC += (Words); goto Dispatch; } while (0)
+	Dispatch:
+		I = *PC;
+		A = I >> 8;
+		switch (I & 0xff) {
+#endif
+		VM_CASE(LOADK) R[A] = (int32_t)PC[1]; VM_NEXT(2);
+		VM_CASE(MOV) R[A] = R[PC[1]]; VM_NEXT(2);
+		VM_CASE(ADD) R[A] = (int32_t)(VM_U(R[PC[1]]) + VM_U(R[PC[2]])); VM_NEXT(3);
+		VM_CASE(SUB) R[A] = (int32_t)(VM_U(R[PC[1]]) - VM_U(R[PC[2]])); VM_NEXT(3);
+		VM_CASE(MUL) R[A] = (int32_t)(VM_U(R[PC[1]]) * VM_U(R[PC[2]])); VM_NEXT(3);
+		VM_CASE(DIV) R[A] = R[PC[1]] / R[PC[2]]; VM_NEXT(3);
+		VM_CASE(NEG) R[A] = (int32_t)(0u - VM_U(R[PC[1]])); VM_NEXT(2);
+		VM_CASE(ADDI) R[A] = (int32_t)(VM_U(R[PC[1]]) + PC[2]); VM_NEXT(3);
+		VM_CASE(MULI) R[A] = (int32_t)(VM_U(R[PC[1]]) * PC[2]); VM_NEXT(3);
+		VM_CASE(INC) R[A] = (int32_t)(VM_U(R[A]) + PC[1]); VM_NEXT(2);
+		VM_CASE(JMP) PC = Code + PC[1]; VM_NEXT(0);
+		VM_CASE(JZ)
+			if (R[A] == 0) { PC = Code + PC[1]; VM_NEXT(0); }
+			VM_NEXT(2);
+		VM_CASE(JNZ)
+			if (R[A] != 0) { PC = Code + PC[1]; VM_NEXT(0); }
+			VM_NEXT(2);
+		VM_CASE(JEQ)
+			if (R[A] == R[PC[1]]) { PC = Code + PC[2]; VM_NEXT(0); }
+			VM_NEXT(3);
+		VM_CASE(JNE)
+			if (R[A] != R[PC[1]]) { PC = Code + PC[2]; VM_NEXT(0); }
+			VM_NEXT(3);
+		VM_CASE(JEQI)
+			if (R[A] == (int32_t)PC[1]) { PC = Code + PC[2]; VM_NEXT(0); }
+			VM_NEXT(3);
+		VM_CASE(JNEI)
+			if (R[A] != (int32_t)PC[1]) { PC = Code + PC[2]; VM_NEXT(0); }
+			VM_NEXT(3);
+		VM_CASE(CALL) {
+			const VMFunction &F = Funcs[PC[1]];
+			CallFrame CF = { PC + 3, Base, A };
+			Frames.push_back(CF);
+			Base += PC[2];
+			R = reserve(Base, F.FrameSize);
+			PC = Code + F.Entry;
+			VM_NEXT(0);
+		}
+		VM_CASE(TAILCALL) {
+			const VMFunction &F = Funcs[PC[1]];
+			memmove(R, R + PC[2], F.NumArgs * sizeof(int32_t));
+			R = reserve(Base, F.FrameSize);
+			PC = Code + F.Entry;
+			VM_NEXT(0);
+		}
+		VM_CASE(RET) {
+			int32_t V = R[A];
+			if (Frames.empty())
+				return V;
+			const CallFrame &CF = Frames.back();
+			PC = CF.RetPC;
+			Base = CF.Base;
+			R = Stack.data() + Base;
+			R[CF.Dest] = V;
+			Frames.pop_back();
+			VM_NEXT(0);
+		}
+		VM_CASE(ALOAD) R[A] = R[PC[1] + R[PC[2]]]; VM_NEXT(3);
+		VM_CASE(ASTORE) R[A + R[PC[1]]] = R[PC[2]]; VM_NEXT(3);
+		VM_CASE(AZERO) memset(R + A, 0, PC[1] * sizeof(int32_t)); VM_NEXT(2);
+		VM_CASE(PRINTS) vsl_print_str(Strings + PC[1], A); VM_NEXT(2);
+		VM_CASE(PRINTI) vsl_print_int(R[A]); VM_NEXT(1);
+#if !defined(__GNUC__)
+		}
+		return 0;
+#endif
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_U
+	}
+};
+
+#endif
@@ -17,21 +17,28 @@
 
 #include "llvm/ADT/iterator_range.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
 #include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
 #include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h"
 #include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
 #include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
+#include "llvm/ExecutionEngine/Orc/IRTransformLayer.h"
 #include "llvm/ExecutionEngine/Orc/LambdaResolver.h"
 #include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/Mangler.h"
+#include "llvm/Object/ObjectFile.h"
 #include "llvm/Support/DynamicLibrary.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetMachine.h"
 #include <algorithm>
 #include <memory>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -43,37 +50,100 @@ namespace llvm {
 			using ObjLayerT = RTDyldObjectLinkingLayer;
 			using CompileLayerT = IRCompileLayer<ObjLayerT, SimpleCompiler>;
 			using ModuleHandleT = CompileLayerT::ModuleHandleT;
-
-			VSLJIT()
-				: TM(EngineBuilder().selectTarget()), DL(TM->createDataLayout()),
+			using ObjHandleT = ObjLayerT::ObjHandleT;
+			using CountFunctionT =
+				std::function<std::shared_ptr<Module>(std::shared_ptr<Module>)>;
+			using CountLayerT = IRTransformLayer<CompileLayerT, CountFunctionT>;
+			using CODLayerT = CompileOnDemandLayer<CountLayerT>;
+
+			// OptLevel selects the code generator optimization level of the
+			// compiled machine code. In lazy mode every function of an added
+			// module is replaced by an indirection stub, and the function is
+			// compiled on its own the first time its stub is called. If Cache is
+			// given, every module compiled eagerly is handed to it as an object.
+			VSLJIT(CodeGenOpt::Level OptLevel = CodeGenOpt::Default, bool Lazy = false,
+				ObjectCache *Cache = nullptr)
+				: TM(EngineBuilder().setOptLevel(OptLevel).selectTarget()), DL(TM->createDataLayout()),
 				ObjectLayer([]() { return std::make_shared<SectionMemoryManager>(); }),
-				CompileLayer(ObjectLayer, SimpleCompiler(*TM)) {
+				CompileLayer(ObjectLayer, SimpleCompiler(*TM, Cache)) {
 				llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+				if (!Lazy)
+					return;
+				CountLayer = llvm::make_unique<CountLayerT>(CompileLayer,
+					[this](std::shared_ptr<Module> M) {
+					for (auto &F : *M)
+						if (!F.isDeclaration())
+							++NumCompiledFunctions;
+					return M;
+				});
+				CompileCallbackManager =
+					createLocalCompileCallbackManager(TM->getTargetTriple(), 0);
+				CODLayer = llvm::make_unique<CODLayerT>(*CountLayer,
+					[](Function &F) { return std::set<Function *>({ &F }); },
+					*CompileCallbackManager,
+					createLocalIndirectStubsManagerBuilder(TM->getTargetTriple()));
 			}
 
 			TargetMachine &getTargetMachine() { return *TM; }
 
-			ModuleHandleT addModule(std::unique_ptr<Module> M) {
-				// We need a memory manager to allocate memory and resolve symbols for this
-				// new module. Create one that resolves symbols by looking back into the
-				// JIT.
-				auto Resolver = createLambdaResolver(
-					[&](const std::string &Name) {
-					if (auto Sym = findMangledSymbol(Name))
-						return Sym;
-					return JITSymbol(nullptr);
-				},
-					[](const std::string &S) { return nullptr; });
-				auto H = cantFail(CompileLayer.addModule(std::move(M),
-					std::move(Resolver)));
+			bool isLazy() const { return CODLayer != nullptr; }
+
+			// Changes the code generator optimization level of modules added from
+			// now on; modules already added have been compiled.
+			void setOptLevel(CodeGenOpt::Level OptLevel) { TM->setOptLevel(OptLevel); }
+
+			// Defines Name as an absolute address (e.g. a host function or object
+			// the generated code refers to).
+			void addSymbol(const std::string &Name, JITTargetAddress Addr) {
+				Symbols[mangle(Name)] = Addr;
+			}
+
+			// Creates an indirection stub for Name jumping to Addr. Calls to Name
+			// from modules added later bind to the stub, so the target can be
+			// replaced with updateStub while the code is running.
+			void createStub(const std::string &Name, JITTargetAddress Addr) {
+				if (!StubsMgr)
+					StubsMgr = createLocalIndirectStubsManagerBuilder(TM->getTargetTriple())();
+				cantFail(StubsMgr->createStub(mangle(Name), Addr, JITSymbolFlags::Exported));
+			}
+
+			void updateStub(const std::string &Name, JITTargetAddress Addr) {
+				cantFail(StubsMgr->updatePointer(mangle(Name), Addr));
+			}
+
+			// Number of functions compiled to machine code so far (lazy mode only).
+			unsigned getNumCompiledFunctions() const { return NumCompiledFunctions; }
+
+			// The module's LLVMContext must outlive the JIT in lazy mode: functions
+			// are cloned out of the module when they are first called.
+			void addModule(std::unique_ptr<Module> M) {
+				if (CODLayer) {
+					cantFail(CODLayer->addModule(std::move(M), createResolver()));
+					return;
+				}
+				auto H = cantFail(CompileLayer.addModule(std::move(M), createResolver()));
 
 				ModuleHandles.push_back(H);
-				return H;
 			}
 
-			void removeModule(ModuleHandleT H) {
-				ModuleHandles.erase(find(ModuleHandles, H));
-				cantFail(CompileLayer.removeModule(H));
+			// Adds an object file compiled earlier (e.g. loaded from an object
+			// cache) directly to the linking layer. Returns false if Obj is not a
+			// valid object file.
+			bool addObject(std::unique_ptr<MemoryBuffer> Obj) {
+				auto ObjFile = object::ObjectFile::createObjectFile(Obj->getMemBufferRef());
+				if (!ObjFile) {
+					consumeError(ObjFile.takeError());
+					return false;
+				}
+				auto Owning = std::make_shared<object::OwningBinary<object::ObjectFile>>(
+					std::move(*ObjFile), std::move(Obj));
+				auto H = ObjectLayer.addObject(std::move(Owning), createResolver());
+				if (!H) {
+					consumeError(H.takeError());
+					return false;
+				}
+				ObjHandles.push_back(*H);
+				return true;
 			}
 
 			JITSymbol findSymbol(const std::string Name) {
@@ -81,6 +151,24 @@ namespace llvm {
 			}
 
 		private:
+			// We need a memory manager to allocate memory and resolve symbols for each
+			// new module or object. Create one that resolves symbols by looking back
+			// into the JIT.
+			std::shared_ptr<JITSymbolResolver> createResolver() {
+				return createLambdaResolver(
+					[this](const std::string &Name) {
+					// The partitions of a lazily compiled module refer to each other
+					// through symbols that the layer has made hidden.
+					if (CODLayer)
+						if (auto Sym = CODLayer->findSymbol(Name, false))
+							return Sym;
+					if (auto Sym = findMangledSymbol(Name))
+						return Sym;
+					return JITSymbol(nullptr);
+				},
+					[](const std::string &S) { return nullptr; });
+			}
+
 			std::string mangle(const std::string &Name) {
 				std::string MangledName;
 				{
@@ -104,12 +192,26 @@ namespace llvm {
 				const bool ExportedSymbolsOnly = true;
 #endif
 
+				if (StubsMgr)
+					if (auto Sym = StubsMgr->findStub(Name, ExportedSymbolsOnly))
+						return Sym;
+
 				// Search modules in reverse order: from last added to first added.
 				// This is the opposite of the usual search order for dlsym, but makes more
 				// sense in a REPL where we want to bind to the newest available definition.
 				for (auto H : make_range(ModuleHandles.rbegin(), ModuleHandles.rend()))
 					if (auto Sym = CompileLayer.findSymbolIn(H, Name, ExportedSymbolsOnly))
 						return Sym;
+				for (auto H : make_range(ObjHandles.rbegin(), ObjHandles.rend()))
+					if (auto Sym = ObjectLayer.findSymbolIn(H, Name, ExportedSymbolsOnly))
+						return Sym;
+				if (CODLayer)
+					if (auto Sym = CODLayer->findSymbol(Name, ExportedSymbolsOnly))
+						return Sym;
+
+				auto It = Symbols.find(Name);
+				if (It != Symbols.end())
+					return JITSymbol(It->second, JITSymbolFlags::Exported);
 
 				// If we can't find the symbol in the JIT, try looking in the host process.
 				if (auto SymAddr = RTDyldMemoryManager::getSymbolAddressInProcess(Name))
@@ -133,6 +235,14 @@ namespace llvm {
 			ObjLayerT ObjectLayer;
 			CompileLayerT CompileLayer;
 			std::vector<ModuleHandleT> ModuleHandles;
+			std::vector<ObjHandleT> ObjHandles;
+			std::unique_ptr<IndirectStubsManager> StubsMgr;
+			StringMap<JITTargetAddress> Symbols;
+			// Lazy mode only
+			std::unique_ptr<CountLayerT> CountLayer;
+			std::unique_ptr<JITCompileCallbackManager> CompileCallbackManager;
+			std::unique_ptr<CODLayerT> CODLayer;
+			unsigned NumCompiledFunctions = 0;
 		};
 
 	} // end namespace orc
@@ -0,0 +1,101 @@
+#ifndef __VSLRUNTIME_H__
+#define __VSLRUNTIME_H__
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+//VSL 运行时库:PRINT 语句编译为对 vsl_print_str/vsl_print_int 的直接调用(见 AST.h 中的 EmitPrint),
+//输出先写入 VSLOutBufSize 字节的缓冲区,满了或程序结束时一次写到 stdout,
+//不再为每条 PRINT 解析格式串、对 stdout 加锁。
+//不依赖 LLVM:JIT 运行时由 CompilerInstance 注册这些符号,
+//-obj 生成的目标文件链接 vslrt.cpp 编译出的 libvslrt.a。
+//函数都是 inline 的,包含本文件的各个翻译单元中的定义在链接时合并为一个;
+//缓冲区是 inline 函数中的静态变量,同样在进程内唯一,只能在一个线程上运行 VSL 程序
+static const size_t VSLOutBufSize = 1 << 16;
+
+struct VSLOutState {
+	char Buf[VSLOutBufSize];
+	size_t Len;
+	bool AtExit;	//已用 atexit 注册 vsl_flush
+};
+
+//输出缓冲区:没有构造函数,静态初始化为 0,访问时没有初始化检查
+inline VSLOutState &vslOut()
+{
+	static VSLOutState Out;
+	return Out;
+}
+
+//把缓冲区中的内容写到 stdout
+extern "C" inline void vsl_flush(void)
+{
+	VSLOutState &Out = vslOut();
+	if (Out.Len) {
+		fwrite(Out.Buf, 1, Out.Len, stdout);
+		Out.Len = 0;
+	}
+	fflush(stdout);
+}
+
+//保证缓冲区中还有 N 字节的空间,第一次输出时注册退出时的 vsl_flush
+inline VSLOutState &vslReserve(size_t N)
+{
+	VSLOutState &Out = vslOut();
+	if (!Out.AtExit) {
+		Out.AtExit = true;
+		atexit(vsl_flush);
+	}
+	if (Out.Len + N > VSLOutBufSize)
+		vsl_flush();
+	return Out;
+}
+
+//输出 PRINT 中的一段文本(已处理转义,不含结尾的 '\0')
+extern "C" inline void vsl_print_str(const char *S, uint32_t Len)
+{
+	VSLOutState &Out = vslReserve(Len < VSLOutBufSize ? Len : VSLOutBufSize);
+	if (Len >= VSLOutBufSize) {
+		fwrite(S, 1, Len, stdout);
+		return;
+	}
+	memcpy(Out.Buf + Out.Len, S, Len);
+	Out.Len += Len;
+}
+
+//输出 PRINT 中的一个整数,格式与原来的 printf(" %d ") 相同:前后各一个空格
+extern "C" inline void vsl_print_int(int32_t V)
+{
+	//两位十进制数字表,每次转换两位
+	static const char Digits[] =
+		"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+		"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+		"8081828384858687888990919293949596979899";
+	char Tmp[12];
+	char *End = Tmp + sizeof(Tmp), *P = End;
+	uint32_t U = V < 0 ? 0u - (uint32_t)V : (uint32_t)V;
+	while (U >= 100) {
+		unsigned I = (U % 100) * 2;
+		U /= 100;
+		*--P = Digits[I + 1];
+		*--P = Digits[I];
+	}
+	if (U >= 10) {
+		*--P = Digits[U * 2 + 1];
+		*--P = Digits[U * 2];
+	}
+	else
+		*--P = char('0' + U);
+	if (V < 0)
+		*--P = '-';
+
+	size_t Len = End - P;
+	VSLOutState &Out = vslReserve(Len + 2);
+	char *Q = Out.Buf + Out.Len;
+	*Q++ = ' ';
+	memcpy(Q, P, Len);
+	Q[Len] = ' ';
+	Out.Len += Len + 2;
+}
+
+#endif
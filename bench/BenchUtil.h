@@ -0,0 +1,111 @@
+#ifndef __BENCHUTIL_H__
+#define __BENCHUTIL_H__
+//各个基准测试共用的计时函数和 VSL 程序生成器
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+typedef std::chrono::steady_clock Clock;
+
+static inline double msBetween(Clock::time_point A, Clock::time_point B)
+{
+    return std::chrono::duration<double, std::milli>(B - A).count();
+}
+
+static inline double msSince(Clock::time_point T)
+{
+    return msBetween(T, Clock::now());
+}
+
+//Funcs 个互不调用、没有 main 的函数,每个有一个循环和一条 PRINT,用于测试分析和代码生成。
+//LongNames 时使用长注释、长字符串和长标识符(词法分析的基准)
+static std::string genLoopFunctions(int Funcs, bool LongNames = false)
+{
+    const char *Short =
+        "FUNC f%d(a, b)\n"
+        "{\n"
+        "    VAR x, y\n"
+        "    // comment for f%d\n"
+        "    x := a * 3 + b\n"
+        "    WHILE x - y\n"
+        "    DO\n"
+        "    {\n"
+        "        y := y + 1\n"
+        "    }\n"
+        "    DONE\n"
+        "    PRINT \"f%d done: \", y, \"\\n\"\n"
+        "    RETURN y + %d\n"
+        "}\n\n";
+    const char *Long =
+        "FUNC function%dWithAVeryLongDescriptiveName(argumentNumberOne, argumentNumberTwo)\n"
+        "{\n"
+        "    VAR localCounterVariable, accumulatedResultValue\n"
+        "    // this comment is long enough to span several vector widths of input text\n"
+        "    localCounterVariable := argumentNumberOne * 3 + argumentNumberTwo\n"
+        "    WHILE localCounterVariable - accumulatedResultValue\n"
+        "    DO\n"
+        "    {\n"
+        "        accumulatedResultValue := accumulatedResultValue + 1\n"
+        "    }\n"
+        "    DONE\n"
+        "    PRINT \"function %d finished computing its accumulated result:\\t\", accumulatedResultValue, \"\\n\"\n"
+        "    RETURN accumulatedResultValue + %d\n"
+        "}\n\n";
+    std::string Src;
+    char Buf[1024];
+    for(int i = 0; i < Funcs; i++)
+    {
+        if(LongNames)
+            snprintf(Buf, sizeof(Buf), Long, i, i, i);
+        else
+            snprintf(Buf, sizeof(Buf), Short, i, i, i, i);
+        Src += Buf;
+    }
+    return Src;
+}
+
+//Funcs 个各含一个循环的函数,main 调用其中的前 Called 个。
+//实参 N 先赋给变量,调用不会被特化为副本
+static std::string genCallSource(int Funcs, int Called, int N)
+{
+    std::string Src;
+    for(int i = 0; i < Funcs; i++)
+    {
+        std::string I = std::to_string(i);
+        Src += "FUNC f" + I + "(x)\n{\n    VAR s, j\n"
+               "    WHILE x - j DO { s := s + j * " + I + " - s / 7 j := j + 1 } DONE\n"
+               "    IF s - " + I + " THEN RETURN s / 3 ELSE RETURN s * 2 FI\n}\n";
+    }
+    Src += "FUNC main()\n{\n    VAR t, n\n    n := " + std::to_string(N) + "\n";
+    for(int i = 0; i < Called; i++)
+        Src += "    t := t + f" + std::to_string(i) + "(n)\n";
+    return Src + "    PRINT t, \"\\n\"\n}\n";
+}
+
+//以下只供编译并运行程序的基准测试使用,它们在本文件之前包含 CompilerInstance.h
+#ifdef __COMPILERINSTANCE_H__
+typedef std::function<void(CompilerInstance &)> InspectFn;
+
+//编译并运行一次,返回运行时间(含 JIT 生成机器码)。
+//Before 在生成代码之后、运行之前调用,After 在运行之后调用,用于读取这次编译的统计
+static double runOnce(const std::string &Src, const CompilerOptions &Opts,
+                      const InspectFn &Before = nullptr, const InspectFn &After = nullptr)
+{
+    CompilerInstance CI(Opts);
+    CI.setSource(Src);
+    CI.parse();
+    CI.codegen();
+    if(Before)
+        Before(CI);
+    auto T0 = Clock::now();
+    CI.run();
+    fflush(stdout);
+    double RunMs = msSince(T0);
+    if(After)
+        After(CI);
+    return RunMs;
+}
+#endif
+
+#endif
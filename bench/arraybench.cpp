@@ -0,0 +1,85 @@
+//数组的基准测试:求和、点积和前缀和三个核心循环,比较 -O0、关闭向量化的 -O2
+//和默认 -O2(循环向量化)下的运行时间(含 JIT 生成机器码)
+//用法: arraybench [-n 数组长度] [-r 重复次数]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "../CompilerInstance.h"
+#include "BenchUtil.h"
+
+struct Kernel {
+    const char *Name;
+    const char *Loop;	//重复执行的循环,a、b 已填好,结果累加到 s
+};
+
+static const Kernel Kernels[] = {
+    { "sum",
+      "        i := 0\n"
+      "        WHILE # - i DO { s := s + a[i] i := i + 1 } DONE\n" },
+    { "dot",
+      "        i := 0\n"
+      "        WHILE # - i DO { s := s + a[i] * b[i] i := i + 1 } DONE\n" },
+    //循环携带依赖,不能向量化
+    { "prefix",
+      "        i := 1\n"
+      "        WHILE # - i DO { b[i] := b[i] + b[i - 1] i := i + 1 } DONE\n"
+      "        s := s + b[# - 1]\n" },
+};
+
+struct Config {
+    const char *Name;
+    unsigned OptLevel;
+    int Vectorize;
+};
+
+static const Config Configs[] = {
+    { "-O0", 0, -1 },
+    { "-O2 vectorize=0", 2, 0 },
+    { "-O2", 2, -1 },
+};
+
+static std::string genSource(const Kernel &K, long N, long Reps)
+{
+    std::string Loop = K.Loop;
+    for(size_t Pos; (Pos = Loop.find('#')) != std::string::npos;)
+        Loop.replace(Pos, 1, std::to_string(N));
+    std::string Len = std::to_string(N);
+    return "FUNC main()\n{\n    VAR a[" + Len + "], b[" + Len + "], i, r, s\n"
+           "    WHILE " + Len + " - i DO { a[i] := i - i / 7 * 7 b[i] := 3 - i / 5 * 5 i := i + 1 } DONE\n"
+           "    WHILE " + std::to_string(Reps) + " - r DO\n    {\n" + Loop +
+           "        r := r + 1\n    }\n    DONE\n    PRINT s, \"\\n\"\n}\n";
+}
+
+int main(int argc, char *argv[])
+{
+    long N = 1 << 16, Reps = 2000;
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        if(!strcmp(argv[i], "-n"))
+            N = atol(argv[i + 1]);
+        else if(!strcmp(argv[i], "-r"))
+            Reps = atol(argv[i + 1]);
+    }
+
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetAsmParser();
+
+    printf("%ld elements, %ld repetitions\n%-8s %-18s %10s %12s\n", N, Reps, "kernel", "options",
+           "run ms", "ns/element");
+    for(const Kernel &K : Kernels)
+    {
+        std::string Src = genSource(K, N, Reps);
+        for(const Config &C : Configs)
+        {
+            CompilerOptions Opts;
+            Opts.OptLevel = C.OptLevel;
+            Opts.LoopVectorize = C.Vectorize;
+            double RunMs = runOnce(Src, Opts);
+            printf("%-8s %-18s %10.1f %12.3f\n", K.Name, C.Name, RunMs, RunMs * 1e6 / (double(N) * Reps));
+        }
+    }
+    return 0;
+}
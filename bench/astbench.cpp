@@ -0,0 +1,201 @@
+//语法树表示的基准测试:指针树(虚函数 codegen)与下标式语法树(FlatAST.h)
+//分别测量分析、代码生成和一个简单的遍历分析的时间,并检查两者生成的 IR 相同
+//用法: astbench [-n 函数个数] [-d 表达式深度] [-r 重复次数]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "../CompilerInstance.h"
+#include "BenchUtil.h"
+
+//深度为 Depth 的表达式,叶子是变量和常数
+static void genExpr(std::string &Src, int Depth, unsigned Seed)
+{
+    if(Depth == 0)
+    {
+        static const char *Leaves[] = { "a", "b", "x", "y" };
+        if(Seed % 3)
+            Src += Leaves[Seed % 4];
+        else
+            Src += std::to_string(Seed % 97 + 1);
+        return;
+    }
+    static const char Ops[] = { '+', '-', '*', '+' };
+    Src += '(';
+    genExpr(Src, Depth - 1, Seed * 7 + 1);
+    Src += ' ';
+    Src += Ops[Seed % 4];
+    Src += ' ';
+    genExpr(Src, Depth - 1, Seed * 5 + 3);
+    Src += ')';
+}
+
+static std::string genSource(int Funcs, int Depth)
+{
+    std::string Src;
+    for(int i = 0; i < Funcs; i++)
+    {
+        std::string F = "f" + std::to_string(i);
+        Src += "FUNC " + F + "(a, b)\n{\n    VAR x, y\n    x := ";
+        genExpr(Src, Depth, i);
+        Src += "\n    WHILE x - y\n    DO\n    {\n        y := y + 1\n"
+               "        IF y - b THEN x := ";
+        genExpr(Src, Depth, i + 1);
+        Src += " FI\n    }\n    DONE\n";
+        if(i)
+            Src += "    PRINT \"" + F + ": \", f" + std::to_string(i - 1) + "(x, y), \"\\n\"\n";
+        Src += "    RETURN y\n}\n\n";
+    }
+    return Src;
+}
+
+static std::string printModule(CodeGenContext &CG)
+{
+    std::string IR;
+    raw_string_ostream OS(IR);
+    CG.TheModule->print(OS, nullptr);
+    return OS.str();
+}
+
+//统计函数调用个数:指针树递归遍历,下标式语法树顺序扫描
+static size_t countCallsTree(StatAST *S)
+{
+    if(!S)
+        return 0;
+    switch(S->getKind())
+    {
+    case StatAST::SK_Neg:
+        return countCallsTree(cast<NegExprAST>(S)->getExpr());
+    case StatAST::SK_Binary:
+        return countCallsTree(cast<BinaryExprAST>(S)->getLHS()) +
+               countCallsTree(cast<BinaryExprAST>(S)->getRHS());
+    case StatAST::SK_Call: {
+        size_t N = 1;
+        for(StatAST *A : cast<CallExprAST>(S)->getArgs())
+            N += countCallsTree(A);
+        return N;
+    }
+    case StatAST::SK_Block: {
+        size_t N = 0;
+        for(StatAST *C : cast<BlockStatAST>(S)->getStatList())
+            N += countCallsTree(C);
+        return N;
+    }
+    case StatAST::SK_Print: {
+        size_t N = 0;
+        for(StatAST *E : cast<PrintStatAST>(S)->getExprs())
+            N += countCallsTree(E);
+        return N;
+    }
+    case StatAST::SK_If:
+        return countCallsTree(cast<IfStatAST>(S)->getCond()) +
+               countCallsTree(cast<IfStatAST>(S)->getThen()) +
+               countCallsTree(cast<IfStatAST>(S)->getElse());
+    case StatAST::SK_Ret:
+        return countCallsTree(cast<RetStatAST>(S)->getVal());
+    case StatAST::SK_Assign:
+        return countCallsTree(cast<AssStatAST>(S)->getExpr());
+    case StatAST::SK_While:
+        return countCallsTree(cast<WhileStatAST>(S)->getCond()) +
+               countCallsTree(cast<WhileStatAST>(S)->getBody());
+    default:
+        return 0;
+    }
+}
+
+static size_t countCallsFlat(const FlatAST &Flat)
+{
+    size_t N = 0;
+    for(size_t I = 0; I < Flat.size(); I++)
+        N += Flat.Kinds[I] == StatAST::SK_Call;
+    return N;
+}
+
+int main(int argc, char *argv[])
+{
+    int Funcs = 20000, Depth = 6, Reps = 3;
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        if(!strcmp(argv[i], "-n"))
+            Funcs = atoi(argv[i + 1]);
+        else if(!strcmp(argv[i], "-d"))
+            Depth = atoi(argv[i + 1]);
+        else if(!strcmp(argv[i], "-r"))
+            Reps = atoi(argv[i + 1]);
+    }
+
+    std::string Src = genSource(Funcs, Depth);
+    StringInterner Symbols;
+    ASTContext AST;
+
+    auto T = Clock::now();
+    Lexer Lex(Symbols);
+    Lex.lexBuffer(Src.data(), Src.data() + Src.size());
+    std::vector<FunctionAST *> Functions;
+    Parser P(Lex, AST);
+    P.ParseFunctions(Functions);
+    double ParseMs = msSince(T);
+
+    T = Clock::now();
+    FlatAST Flat;
+    Flat.reserve(AST.getNumAllocs());
+    for(FunctionAST *F : Functions)
+        Flat.addFunction(F);
+    double FlattenMs = msSince(T);
+
+    printf("input: %.1f MB, %zu functions, %zu nodes\n",
+           Src.size() / (1024.0 * 1024), Functions.size(), Flat.size());
+    printf("lex+parse %.1f ms, flatten %.1f ms\n", ParseMs, FlattenMs);
+    printf("memory: tree %.1f MB (arena), flat %.1f MB\n",
+           AST.getArenaBytes() / (1024.0 * 1024),
+           (Flat.size() * (sizeof(uint8_t) + sizeof(int32_t) + 2 * sizeof(uint32_t)) +
+            Flat.Children.size() * sizeof(FlatAST::NodeId) +
+            Flat.Names.size() * sizeof(unsigned)) / (1024.0 * 1024));
+
+    double TreeMs = 1e100, FlatMs = 1e100;
+    std::string TreeIR, FlatIR;
+    for(int r = 0; r < Reps; r++)
+    {
+        //每轮代码生成都使用新的模块
+        {
+            CodeGenContext CG(Symbols, "astbench");
+            T = Clock::now();
+            for(FunctionAST *F : Functions)
+                F->codegen(CG);
+            TreeMs = std::min(TreeMs, msSince(T));
+            TreeIR = printModule(CG);
+        }
+        {
+            CodeGenContext CG(Symbols, "astbench");
+            T = Clock::now();
+            FlatCodeGen FCG(CG, Flat);
+            for(size_t I = 0; I < Flat.getNumFunctions(); I++)
+                FCG.emitFunction(I);
+            FlatMs = std::min(FlatMs, msSince(T));
+            FlatIR = printModule(CG);
+        }
+    }
+    printf("codegen: tree %.1f ms, flat %.1f ms\n", TreeMs, FlatMs);
+
+    double TreeScan = 1e100, FlatScan = 1e100;
+    size_t TreeCalls = 0, FlatCalls = 0;
+    for(int r = 0; r < Reps; r++)
+    {
+        T = Clock::now();
+        TreeCalls = 0;
+        for(FunctionAST *F : Functions)
+            TreeCalls += countCallsTree(F->getBody());
+        TreeScan = std::min(TreeScan, msSince(T));
+
+        T = Clock::now();
+        FlatCalls = countCallsFlat(Flat);
+        FlatScan = std::min(FlatScan, msSince(T));
+    }
+    printf("count calls: tree %.2f ms, flat %.2f ms (%zu / %zu)\n",
+           TreeScan, FlatScan, TreeCalls, FlatCalls);
+
+    bool Same = TreeIR == FlatIR && TreeCalls == FlatCalls;
+    printf("flat result %s tree\n", Same ? "matches" : "DIFFERS FROM");
+    return Same ? 0 : 1;
+}
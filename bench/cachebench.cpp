@@ -0,0 +1,67 @@
+//目标文件缓存的基准测试:同一个程序先在空的缓存目录中运行一次(未命中,分析、生成代码后写入缓存),
+//再运行若干次(命中,直接装入目标文件),比较从开始到 main 返回的时间。
+//程序中有 Funcs 个函数,main 调用全部函数各一次,运行时间很短,时间主要是编译
+//用法: cachebench [-r 命中的重复次数] [-O 优化级别]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "../CompilerInstance.h"
+#include "BenchUtil.h"
+
+//完整运行一次,返回总时间
+static double runOnce(const std::string &Src, unsigned OptLevel, const std::string &Dir, bool &Hit)
+{
+    auto T0 = Clock::now();
+    CompilerOptions Opts;
+    Opts.OptLevel = OptLevel;
+    Opts.UseCache = true;
+    Opts.CacheDir = Dir;
+    CompilerInstance CI(Opts);
+    CI.setSource(Src);
+    CI.compile();
+    Hit = CI.Cache && CI.Cache->Hit;
+    return msSince(T0);
+}
+
+int main(int argc, char *argv[])
+{
+    int Reps = 10;
+    unsigned OptLevel = 2;
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        if(!strcmp(argv[i], "-r"))
+            Reps = atoi(argv[i + 1]);
+        else if(!strcmp(argv[i], "-O"))
+            OptLevel = atoi(argv[i + 1]);
+    }
+    if(!freopen("/dev/null", "w", stdout))
+        return 1;
+
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetAsmParser();
+
+    fprintf(stderr, "-O%u, hit x%d\n%-10s %12s %12s %12s %10s\n", OptLevel, Reps, "functions", "miss ms",
+            "hit ms", "speedup", "obj bytes");
+    const int Sizes[] = { 1, 10, 100, 1000 };
+    for(int Funcs : Sizes)
+    {
+        SmallString<128> Dir;
+        if(sys::fs::createUniqueDirectory("vslcache", Dir))
+            return 1;
+        std::string Src = genCallSource(Funcs, Funcs, 10);
+        bool Hit;
+        double MissMs = runOnce(Src, OptLevel, Dir.str().str(), Hit);
+        double HitMs = 0;
+        for(int i = 0; i < Reps; i++)
+            HitMs += runOnce(Src, OptLevel, Dir.str().str(), Hit);
+        HitMs /= Reps;
+        JITObjectCache Usage(Dir, 0, "");
+        fprintf(stderr, "%-10d %12.2f %12.2f %11.1fx %10llu%s\n", Funcs, MissMs, HitMs, MissMs / HitMs,
+                (unsigned long long)Usage.getUsage().second, Hit ? "" : " (not hit)");
+        sys::fs::remove_directories(Dir);
+    }
+    return 0;
+}
@@ -0,0 +1,116 @@
+//并行代码生成基准测试:用 1, 2, 4, ... 个线程分析并生成(含优化)一个大程序的代码
+//用法: cgbench [-n 函数个数] [-t 最大线程数] [-O 优化级别] [-link]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "../CompilerInstance.h"
+#include "BenchUtil.h"
+
+//每个函数调用前一个函数,使模块之间有交叉调用
+static std::string genSource(int Funcs)
+{
+    std::string Src;
+    for(int i = 0; i < Funcs; i++)
+    {
+        std::string N = std::to_string(i);
+        Src += "FUNC f" + N + "(a, b)\n"
+               "{\n"
+               "    VAR x, y, z\n"
+               "    x := (a * 3 + b) * (a - b) + " + N + "\n"
+               "    z := x * x - (a + 1) * (b + 2)\n"
+               "    WHILE x - y\n"
+               "    DO\n"
+               "    {\n"
+               "        IF y - b THEN z := z + y * 2 ELSE z := z - 1 FI\n"
+               "        y := y + 1\n"
+               "    }\n"
+               "    DONE\n"
+               "    PRINT \"f" + N + ": \", z, \"\\n\"\n";
+        if(i)
+            Src += "    RETURN z + f" + std::to_string(i - 1) + "(y, z)\n}\n\n";
+        else
+            Src += "    RETURN z\n}\n\n";
+    }
+    return Src;
+}
+
+int main(int argc, char *argv[])
+{
+    int Funcs = 100000;
+    unsigned MaxThreads = std::thread::hardware_concurrency();
+    unsigned OptLevel = 2;
+    bool Link = false;
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "-n") && i + 1 < argc)
+            Funcs = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-t") && i + 1 < argc)
+            MaxThreads = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-O") && i + 1 < argc)
+            OptLevel = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-link"))
+            Link = true;
+    }
+    if(MaxThreads == 0)
+        MaxThreads = 1;
+
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetAsmParser();
+
+    std::string Src = genSource(Funcs);
+    printf("input: %.1f MB, %d functions\n", Src.size() / (1024.0 * 1024), Funcs);
+
+    double Base = 0;
+    size_t BaseInsts = 0;
+    for(unsigned T = 1; T <= MaxThreads; T = T < MaxThreads && T * 2 > MaxThreads ? MaxThreads : T * 2)
+    {
+        CompilerOptions Opts;
+        Opts.NumThreads = T;
+        Opts.OptLevel = OptLevel;
+        CompilerInstance CI(Opts);
+        CI.setSource(Src);
+
+        auto T0 = Clock::now();
+        CI.parse();
+        double Parse = msSince(T0);
+        T0 = Clock::now();
+        CI.codegen();
+        double Codegen = msSince(T0);
+        double LinkMs = 0;
+        if(Link)
+        {
+            T0 = Clock::now();
+            CI.linkWorkerModules();
+            LinkMs = msSince(T0);
+        }
+
+        //各模块中的指令总数,用于确认结果一致
+        size_t Insts = 0;
+        auto Count = [&](Module &M) {
+            for(Function &F : M)
+                for(BasicBlock &BB : F)
+                    Insts += BB.size();
+        };
+        Count(*CI.CG.TheModule);
+        for(auto &W : CI.WorkerCGs)
+            Count(*W->TheModule);
+
+        double Total = Parse + Codegen;
+        if(T == 1)
+        {
+            Base = Total;
+            BaseInsts = Insts;
+        }
+        printf("%2u threads: parse %8.1f ms, codegen+opt %8.1f ms", T, Parse, Codegen);
+        if(Link)
+            printf(", link %8.1f ms", LinkMs);
+        printf(", speedup %.2fx%s\n", Base / Total,
+               Insts == BaseInsts ? "" : "  INSTRUCTION COUNT DIFFERS");
+        if(T == MaxThreads)
+            break;
+    }
+    return 0;
+}
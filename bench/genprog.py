@@ -0,0 +1,25 @@
+#!/usr/bin/env python3
+# 生成大型 VSL 基准程序: genprog.py 函数个数 > big.VSL
+import sys
+
+n = int(sys.argv[1]) if len(sys.argv) > 1 else 50000
+for i in range(n):
+    print(f"""FUNC f{i}(a, b)
+{{
+	VAR x, y
+	// comment for f{i}
+	x := a * 3 + b
+	y := 0
+	WHILE x - y
+	DO
+	{{
+		y := y + 1
+	}}
+	DONE
+	IF a - b THEN RETURN x ELSE RETURN y + {i} FI
+}}
+""")
+print("""FUNC main()
+{
+	PRINT "r=", f0(3, 4), "\\n"
+}""")
@@ -0,0 +1,85 @@
+//增量前端基准测试:在大文件上做单字符编辑,测量每次重新分析的时间
+//用法: incbench [-n 函数个数] [-e 编辑次数]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+
+#include "../Incremental.h"
+#include "BenchUtil.h"
+
+static bool sameFunctions(const IncrementalFrontend &A, const IncrementalFrontend &B)
+{
+    std::vector<FunctionAST *> FA = A.getFunctions(), FB = B.getFunctions();
+    if(FA.size() != FB.size())
+        return false;
+    for(size_t i = 0; i < FA.size(); i++)
+        if(A.getSymbols().getName(FA[i]->getProto()->getSym()) !=
+           B.getSymbols().getName(FB[i]->getProto()->getSym()))
+            return false;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    int Funcs = 30000, Edits = 2000;
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        if(!strcmp(argv[i], "-n"))
+            Funcs = atoi(argv[i + 1]);
+        else if(!strcmp(argv[i], "-e"))
+            Edits = atoi(argv[i + 1]);
+    }
+
+    std::string Src = genLoopFunctions(Funcs);
+    IncrementalFrontend Inc;
+    auto T0 = Clock::now();
+    Inc.reset(Src);
+    auto T1 = Clock::now();
+    printf("input: %.1f MB, %zu functions, full parse %.1f ms\n",
+           Src.size() / (1024.0 * 1024), Inc.getFunctions().size(),
+           msBetween(T0, T1));
+
+    //编辑:把某个数字换成另一个数字、插入一个空格、再删掉它;
+    //偶尔插入一个 '{' 或删掉后面最近的 '}',留下括号不配对的函数
+    std::mt19937 Rng(42);
+    double Total = 0, Max = 0;
+    size_t Changed = 0;
+    for(int i = 0; i < Edits; i++)
+    {
+        size_t Pos = Rng() % Inc.getSize();
+        char C = Inc.getChar(Pos);
+        if(i % 50 == 25)
+            while(Pos + 1 < Inc.getSize() && (C = Inc.getChar(Pos)) != '}')
+                Pos++;
+        auto E0 = Clock::now();
+        IncrementalFrontend::EditResult R;
+        if(i % 50 == 0)
+            R = Inc.applyEdit(Pos, 0, "{");
+        else if(C == '}')
+            R = Inc.applyEdit(Pos, 1, "");
+        else if(isdigit((unsigned char)C))
+            R = Inc.applyEdit(Pos, 1, (i & 1) ? "7" : "3");
+        else if(i % 3)
+            R = Inc.applyEdit(Pos, 0, " ");
+        else if(C == ' ')
+            R = Inc.applyEdit(Pos, 1, "");
+        else
+            R = Inc.applyEdit(Pos, 0, "\n");
+        auto E1 = Clock::now();
+        double Us = std::chrono::duration<double, std::micro>(E1 - E0).count();
+        Total += Us;
+        Max = std::max(Max, Us);
+        Changed += R.Changed.size() + R.Added.size() + R.Removed.size();
+    }
+    printf("%d edits: avg %.1f us, max %.1f us, %zu function changes reported\n",
+           Edits, Total / Edits, Max, Changed);
+
+    IncrementalFrontend Full;
+    Full.reset(Inc.getText());
+    printf("incremental result %s full reparse\n",
+           sameFunctions(Inc, Full) ? "matches" : "DIFFERS FROM");
+    return 0;
+}
@@ -0,0 +1,98 @@
+//执行引擎的基准测试:比较 ORC JIT 加函数指针直接调用 main(CompilerInstance::run)
+//和原来的 MCJIT ExecutionEngine::runFunction。
+//启动时间为从开始分析只有一条 PRINT 的程序到输出写出的时间;
+//稳定状态为一个长循环去掉生成机器码后的运行时间。
+//标准输出重定向到 /dev/null,结果输出到标准错误
+//用法: jitbench [-n 循环次数] [-r 启动测试的重复次数] [-O 优化级别]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "../CompilerInstance.h"
+#include "BenchUtil.h"
+
+struct Result {
+    double TotalMs = 0;	//分析开始到输出写出
+    double JitMs = 0;	//生成机器码
+    double RunMs = 0;	//运行 main
+};
+
+//原来的方式:由 EngineBuilder 创建引擎,经 GenericValue 调用 main
+static void runMCJIT(CompilerInstance &CI, Result &R)
+{
+    Function *Main = CI.CG.TheModule->getFunction("main");
+    RegisterRuntimeSymbols();
+    auto T0 = Clock::now();
+    std::unique_ptr<ExecutionEngine> EE(EngineBuilder(std::move(CI.CG.Owner))
+        .setOptLevel(GetCodeGenOptLevel(CI.Opts.OptLevel)).create());
+    EE->finalizeObject();
+    auto T1 = Clock::now();
+    EE->runFunction(Main, std::vector<GenericValue>());
+    vsl_flush();
+    R.JitMs = msBetween(T0, T1);
+    R.RunMs = msBetween(T1, Clock::now());
+}
+
+static Result runOnce(const std::string &Src, unsigned OptLevel, bool UseORC)
+{
+    Result R;
+    auto T0 = Clock::now();
+    CompilerOptions Opts;
+    Opts.OptLevel = OptLevel;
+    CompilerInstance CI(Opts);
+    CI.setSource(Src);
+    CI.parse();
+    CI.codegen();
+    if(UseORC)
+    {
+        CI.run();
+        R.JitMs = CI.JitMs;
+        R.RunMs = CI.RunMs;
+    }
+    else
+        runMCJIT(CI, R);
+    R.TotalMs = msBetween(T0, Clock::now());
+    return R;
+}
+
+int main(int argc, char *argv[])
+{
+    long N = 200000000;
+    int Reps = 20;
+    unsigned OptLevel = 2;
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        if(!strcmp(argv[i], "-n"))
+            N = atol(argv[i + 1]);
+        else if(!strcmp(argv[i], "-r"))
+            Reps = atoi(argv[i + 1]);
+        else if(!strcmp(argv[i], "-O"))
+            OptLevel = atoi(argv[i + 1]);
+    }
+    if(!freopen("/dev/null", "w", stdout))
+        return 1;
+
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetAsmParser();
+
+    std::string Hello = "FUNC main()\n{\n    PRINT \"hello\\n\"\n}\n";
+    std::string Loop = "FUNC main()\n{\n    VAR i, s\n    WHILE " + std::to_string(N) +
+                       " - i DO { s := s + i * i - s / 3 i := i + 1 } DONE\n    PRINT s, \"\\n\"\n}\n";
+
+    fprintf(stderr, "-O%u, startup x%d, loop %ld iterations\n%-22s %18s %12s %14s\n", OptLevel, Reps, N,
+            "engine", "first output ms", "jit ms", "loop ns/iter");
+    for(int UseORC = 1; UseORC >= 0; UseORC--)
+    {
+        //第一次运行包括 LLVM 各个单例的初始化,不计入
+        runOnce(Hello, OptLevel, UseORC);
+        double StartMs = 0;
+        for(int i = 0; i < Reps; i++)
+            StartMs += runOnce(Hello, OptLevel, UseORC).TotalMs;
+        Result L = runOnce(Loop, OptLevel, UseORC);
+        fprintf(stderr, "%-22s %18.2f %12.2f %14.3f\n", UseORC ? "ORC JIT, native call" : "MCJIT runFunction",
+                StartMs / Reps, L.JitMs, L.RunMs * 1e6 / N);
+    }
+    return 0;
+}
@@ -0,0 +1,55 @@
+//惰性 JIT 的基准测试:程序中有很多函数,main 只调用其中的一部分,
+//比较一次生成全部机器码和 -lazy(函数第一次被调用时才生成)时的机器码生成时间、
+//运行时间(含惰性生成)和实际生成了机器码的函数数
+//用法: lazybench [-f 函数数] [-O 优化级别]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "../CompilerInstance.h"
+#include "BenchUtil.h"
+
+int main(int argc, char *argv[])
+{
+    int Funcs = 2000;
+    unsigned OptLevel = 1;
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        if(!strcmp(argv[i], "-f"))
+            Funcs = atoi(argv[i + 1]);
+        else if(!strcmp(argv[i], "-O"))
+            OptLevel = atoi(argv[i + 1]);
+    }
+
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetAsmParser();
+
+    const int Called[] = { 1, Funcs / 100, Funcs };
+    printf("%d functions, -O%u\n%-8s %-6s %12s %12s %12s %10s\n", Funcs, OptLevel, "called", "jit",
+           "codegen ms", "jit ms", "run ms", "compiled");
+    for(int C : Called)
+    {
+        std::string Src = genCallSource(Funcs, C, 100);
+        for(int Lazy = 0; Lazy < 2; Lazy++)
+        {
+            CompilerOptions Opts;
+            Opts.OptLevel = OptLevel;
+            Opts.LazyJIT = Lazy;
+            CompilerInstance CI(Opts);
+            CI.setSource(Src);
+            CI.parse();
+            auto T0 = Clock::now();
+            CI.codegen();
+            double CodegenMs = msSince(T0);
+            CI.run();
+            fflush(stdout);
+            //一次生成全部机器码时,加入 JIT 的函数都已编译
+            size_t Compiled = Lazy ? CI.JIT->getNumCompiledFunctions() : CI.NumJITFunctions;
+            printf("%-8d %-6s %12.1f %12.1f %12.1f %10zu\n", C, Lazy ? "lazy" : "eager", CodegenMs,
+                   CI.JitMs, CI.RunMs, Compiled);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+//词法分析基准测试:比较标量扫描与 SSE2/AVX2 扫描在大输入上的速度
+//用法: lexbench [inputFile] [-n 函数个数] [-r 重复次数]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "../Lexer.h"
+#include "BenchUtil.h"
+
+//返回每秒处理的 MB 数
+static double timeLex(const ScanKernels &K, const std::string &Src, int Reps,
+                      std::vector<TokenRec> &Result)
+{
+    StringInterner Symbols;
+    Lexer Lex(Symbols);
+    Lex.Scan = &K;
+    Lex.lexBuffer(Src.data(), Src.data() + Src.size()); //预热
+
+    auto Begin = Clock::now();
+    for(int i = 0; i < Reps; i++)
+        Lex.lexBuffer(Src.data(), Src.data() + Src.size());
+    auto End = Clock::now();
+
+    Result = Lex.Tokens;
+    double Secs = std::chrono::duration<double>(End - Begin).count();
+    return (double)Src.size() * Reps / Secs / (1024 * 1024);
+}
+
+//只测扫描函数本身:在一段很长的同类字符上反复扫描
+static double timeKernel(const char *(*Fn)(const char *, const char *),
+                         const std::string &Run, int Reps)
+{
+    const char *Begin = Run.data(), *End = Run.data() + Run.size();
+    size_t Sum = 0;
+    auto T0 = Clock::now();
+    for(int i = 0; i < Reps; i++)
+        Sum += Fn(Begin + (i & 7), End) - Begin;
+    auto T1 = Clock::now();
+    if(Sum == 0)
+        printf("unexpected\n");
+    double Secs = std::chrono::duration<double>(T1 - T0).count();
+    return (double)Run.size() * Reps / Secs / (1024 * 1024);
+}
+
+int main(int argc, char *argv[])
+{
+    int Funcs = 50000, Reps = 10;
+    const char *FileName = nullptr;
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "-n") && i + 1 < argc)
+            Funcs = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-r") && i + 1 < argc)
+            Reps = atoi(argv[++i]);
+        else
+            FileName = argv[i];
+    }
+
+    std::string Src;
+    if(FileName)
+    {
+        auto BufOrErr = llvm::MemoryBuffer::getFile(FileName);
+        if(!BufOrErr)
+        {
+            printf("%s open error!\n", FileName);
+            return 1;
+        }
+        Src = (*BufOrErr)->getBuffer().str();
+    }
+    else
+        Src = genLoopFunctions(Funcs, true);
+
+    std::vector<const ScanKernels *> Kernels;
+    Kernels.push_back(&ScalarScan);
+#ifdef VSL_SCAN_SSE2
+    Kernels.push_back(&SSE2Scan);
+#endif
+#ifdef VSL_SCAN_AVX2
+    if(__builtin_cpu_supports("avx2"))
+        Kernels.push_back(&AVX2Scan);
+#endif
+
+    printf("input: %.1f MB, %d repetitions\n", Src.size() / (1024.0 * 1024), Reps);
+
+    std::vector<TokenRec> Expected, Got;
+    double Base = timeLex(ScalarScan, Src, Reps, Expected);
+    printf("%-8s lexer %8.1f MB/s  (%zu tokens)\n", ScalarScan.Name, Base, Expected.size());
+    for(size_t i = 1; i < Kernels.size(); i++)
+    {
+        double Speed = timeLex(*Kernels[i], Src, Reps, Got);
+        bool Same = Got.size() == Expected.size() &&
+            std::equal(Got.begin(), Got.end(), Expected.begin(),
+                       [](const TokenRec &A, const TokenRec &B) {
+                           return A.Kind == B.Kind && A.Offset == B.Offset &&
+                                  A.Length == B.Length && A.Val == B.Val;
+                       });
+        printf("%-8s lexer %8.1f MB/s  %.2fx%s\n", Kernels[i]->Name, Speed,
+               Speed / Base, Same ? "" : "  TOKEN MISMATCH");
+    }
+
+    //单个扫描函数在长字符串上的吞吐量
+    std::string Spaces(4096, ' '), Ident(4096, 'a'), Line(4096, 'x'), Text(4096, 'y');
+    for(size_t i = 0; i < Ident.size(); i += 7)
+        Ident[i] = '7';
+    for(const ScanKernels *K : Kernels)
+        printf("%-8s kernels MB/s: space %8.1f  ident %8.1f  line %8.1f  text %8.1f\n",
+               K->Name, timeKernel(K->SkipSpace, Spaces, 200000),
+               timeKernel(K->SkipIdent, Ident, 200000),
+               timeKernel(K->SkipLine, Line, 200000),
+               timeKernel(K->SkipText, Text, 200000));
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+//WHILE 循环的基准测试:在几个热循环程序上比较不同优化级别和 llvm.loop 提示
+//下 IR 的指令数(优化前/后)和运行时间(含 JIT 生成机器码)
+//用法: loopbench [-n 迭代次数]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "../CompilerInstance.h"
+#include "BenchUtil.h"
+
+struct Program {
+    const char *Name;
+    const char *Body;	//main 的函数体,# 为迭代次数
+};
+
+static const Program Programs[] = {
+    //简单的累加循环
+    { "sum",
+      "    VAR i, s\n"
+      "    WHILE # - i DO { s := s + i * 3 i := i + 1 } DONE\n" },
+    //条件较复杂:条件表达式只应生成一次
+    { "cond",
+      "    VAR i, s\n"
+      "    WHILE (# - i) * (i + 1) * (i - # * 2 - 1) DO { s := s + i / 3 - s / 7 i := i + 1 } DONE\n" },
+    //二重循环,内层次数固定
+    { "nested",
+      "    VAR i, j, s\n"
+      "    WHILE # / 64 - i DO\n"
+      "    {\n"
+      "        j := 0\n"
+      "        WHILE 64 - j DO { s := s + i * j - s / 5 j := j + 1 } DONE\n"
+      "        i := i + 1\n"
+      "    }\n"
+      "    DONE\n" },
+};
+
+struct Config {
+    const char *Name;
+    unsigned OptLevel;
+    int Unroll, Vectorize;
+};
+
+static const Config Configs[] = {
+    { "-O0", 0, -1, -1 },
+    { "-O2", 2, -1, -1 },
+    { "-O2 unroll=0 vectorize=0", 2, 0, 0 },
+    { "-O2 unroll=8", 2, 8, -1 },
+    { "-O3 vectorize=4", 3, -1, 4 },
+};
+
+static std::string genSource(const Program &P, long N)
+{
+    std::string Body = P.Body;
+    for(size_t Pos; (Pos = Body.find('#')) != std::string::npos;)
+        Body.replace(Pos, 1, std::to_string(N));
+    //输出结果,避免循环被整个删去
+    return "FUNC main()\n{\n" + Body + "    PRINT s, \"\\n\"\n}\n";
+}
+
+int main(int argc, char *argv[])
+{
+    long N = 100000000;
+    for(int i = 1; i + 1 < argc; i += 2)
+        if(!strcmp(argv[i], "-n"))
+            N = atol(argv[i + 1]);
+
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetAsmParser();
+
+    printf("%-8s %-26s %10s %10s %10s\n", "program", "options", "IR before", "IR after", "run ms");
+    for(const Program &P : Programs)
+    {
+        std::string Src = genSource(P, N);
+        for(const Config &C : Configs)
+        {
+            CompilerOptions Opts;
+            Opts.OptLevel = C.OptLevel;
+            Opts.LoopUnroll = C.Unroll;
+            Opts.LoopVectorize = C.Vectorize;
+            size_t Before = 0, After = 0;
+            double RunMs = runOnce(Src, Opts, nullptr, [&](CompilerInstance &CI) {
+                Before = CI.InstsBeforeOpt;
+                After = CI.InstsAfterOpt;
+            });
+            printf("%-8s %-26s %10zu %10zu %10.1f\n", P.Name, C.Name, Before, After, RunMs);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,80 @@
+//记忆化的基准测试:对几个指数级的纯递归函数,分别在不加和加 -memoize 时
+//编译并运行,输出运行时间(含 JIT 生成机器码)和缓存的命中情况
+//用法: memobench [-O 优化级别] [-c 缓存项数]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "../CompilerInstance.h"
+#include "BenchUtil.h"
+
+struct Workload {
+    const char *Name;
+    const char *Func;	//被测函数 r
+    const char *Call;	//main 中的调用
+};
+
+static const Workload Workloads[] = {
+    { "fib",
+      "FUNC r(n)\n{\n    IF n - 1 THEN { IF n THEN RETURN r(n - 1) + r(n - 2) ELSE RETURN 0 FI }\n"
+      "    ELSE RETURN 1 FI\n}\n",
+      "r(36)" },
+    { "binom",
+      "FUNC r(n, k)\n{\n    IF k THEN { IF n - k THEN RETURN r(n - 1, k - 1) + r(n - 1, k) ELSE RETURN 1 FI }\n"
+      "    ELSE RETURN 1 FI\n}\n",
+      "r(28, 14)" },
+    //三个参数:三维格点上的路径数
+    { "paths",
+      "FUNC r(x, y, z)\n{\n    IF x * y * z THEN RETURN r(x - 1, y, z) + r(x, y - 1, z) + r(x, y, z - 1) FI\n"
+      "    RETURN 1\n}\n",
+      "r(6, 6, 6)" },
+};
+
+static std::string genSource(const Workload &W)
+{
+    return std::string(W.Func) + "FUNC main()\n{\n    PRINT " + W.Call + ", \"\\n\"\n}\n";
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned OptLevel = 0, CacheSize = 4096;
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        if(!strcmp(argv[i], "-O"))
+            OptLevel = atoi(argv[i + 1]);
+        else if(!strcmp(argv[i], "-c"))
+            CacheSize = atoi(argv[i + 1]);
+    }
+
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetAsmParser();
+
+    printf("-O%u, %u cache entries\n%-6s %14s %14s %12s %12s\n", OptLevel, CacheSize,
+           "func", "plain ms", "memoize ms", "hits", "misses");
+    for(const Workload &W : Workloads)
+    {
+        std::string Src = genSource(W);
+        double Ms[2];
+        uint64_t Hits = 0, Misses = 0;
+        for(bool Memoize : { false, true })
+        {
+            CompilerOptions Opts;
+            Opts.OptLevel = OptLevel;
+            Opts.Memoize = Memoize;
+            Opts.MemoCacheSize = CacheSize;
+            Ms[Memoize] = runOnce(Src, Opts, nullptr, [&](CompilerInstance &CI) {
+                if(!Memoize || !CI.JIT)
+                    return;
+                if(auto *H = (const uint64_t *)CI.getSymbolAddress("r.memo.hits"))
+                    Hits = *H;
+                if(auto *M = (const uint64_t *)CI.getSymbolAddress("r.memo.misses"))
+                    Misses = *M;
+            });
+        }
+        printf("%-6s %14.1f %14.1f %12llu %12llu\n", W.Name, Ms[0], Ms[1],
+               (unsigned long long)Hits, (unsigned long long)Misses);
+    }
+    return 0;
+}
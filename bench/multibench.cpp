@@ -0,0 +1,80 @@
+//多次编译基准测试:在同一进程中用互相独立的 CompilerInstance
+//先串行、再在多个线程上同时编译同一程序,检查每次生成的 IR 都相同
+//用法: multibench [-n 函数个数] [-c 编译次数] [-t 线程数]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "../CompilerInstance.h"
+#include "BenchUtil.h"
+
+//完整地编译一次(不运行),返回生成的 IR
+static std::string compileOnce(const std::string &Src)
+{
+    CompilerOptions Opts;
+    CompilerInstance CI(Opts);
+    CI.setSource(Src);
+    CI.parse();
+    CI.codegen();
+
+    std::string IR;
+    raw_string_ostream OS(IR);
+    CI.CG.TheModule->print(OS, nullptr);
+    return OS.str();
+}
+
+int main(int argc, char *argv[])
+{
+    int Funcs = 5000, Jobs = 16;
+    unsigned Threads = std::thread::hardware_concurrency();
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        if(!strcmp(argv[i], "-n"))
+            Funcs = atoi(argv[i + 1]);
+        else if(!strcmp(argv[i], "-c"))
+            Jobs = atoi(argv[i + 1]);
+        else if(!strcmp(argv[i], "-t"))
+            Threads = atoi(argv[i + 1]);
+    }
+    if(Threads == 0)
+        Threads = 1;
+
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetAsmParser();
+
+    std::string Src = genLoopFunctions(Funcs);
+    std::string Expected = compileOnce(Src);
+    printf("input: %.1f MB, %d functions, %d compilations\n",
+           Src.size() / (1024.0 * 1024), Funcs, Jobs);
+
+    std::vector<std::string> Results(Jobs);
+    auto T0 = Clock::now();
+    for(int i = 0; i < Jobs; i++)
+        Results[i] = compileOnce(Src);
+    double Serial = msSince(T0);
+    size_t Bad = 0;
+    for(auto &R : Results)
+        Bad += R != Expected;
+
+    std::fill(Results.begin(), Results.end(), std::string());
+    std::atomic<int> Next(0);
+    T0 = Clock::now();
+    std::vector<std::thread> Workers;
+    for(unsigned t = 0; t < Threads; t++)
+        Workers.emplace_back([&]() {
+            for(int i; (i = Next++) < Jobs;)
+                Results[i] = compileOnce(Src);
+        });
+    for(auto &T : Workers)
+        T.join();
+    double Parallel = msSince(T0);
+    for(auto &R : Results)
+        Bad += R != Expected;
+
+    printf("serial %.1f ms, %u threads %.1f ms (%.2fx)\n", Serial, Threads, Parallel,
+           Serial / Parallel);
+    printf("%zu of %d results differ from the first compilation\n", Bad, Jobs * 2);
+    return Bad != 0;
+}
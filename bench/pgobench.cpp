@@ -0,0 +1,79 @@
+//剖析引导优化的基准测试:对分支走向很偏的程序,先用 -fprofile-generate 运行一次得到剖析,
+//再分别在不用和用 -fprofile-use 时编译并运行,输出运行时间(含 JIT 生成机器码)
+//用法: pgobench [-O 优化级别] [-n 迭代次数] [-f 剖析文件]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "../CompilerInstance.h"
+#include "BenchUtil.h"
+
+struct Workload {
+    const char *Name;
+    const char *Funcs;	//main 的循环中调用的函数
+    const char *Expr;	//main 的循环中累加的表达式,i 为循环变量
+};
+
+static const Workload Workloads[] = {
+    //很少成立的条件:冷的分支放在循环外
+    { "rare",
+      "FUNC step(x)\n{\n    IF x - x / 1000 * 1000 THEN RETURN x + 1 ELSE { VAR a\n"
+      "        a := x * 3 a := a * a - x a := a / 7 RETURN a - a / 5 * 5 } FI\n}\n",
+      "step(i)" },
+    //几乎总是成立的条件,加上只在少数情况下调用的较大函数
+    { "hot",
+      "FUNC slow(x)\n{\n    VAR s, j\n    WHILE 20 - j DO { s := s + x * j j := j + 1 } DONE\n    RETURN s\n}\n"
+      "FUNC pick(x)\n{\n    IF x - x / 64 * 64 THEN RETURN x * 2 FI\n    RETURN slow(x)\n}\n",
+      "pick(i)" },
+    //有界的递归,入口计数高
+    { "tree",
+      "FUNC depth(n)\n{\n    IF n THEN RETURN 1 + depth(n / 2) ELSE RETURN 0 FI\n}\n",
+      "depth(i)" },
+};
+
+static std::string genSource(const Workload &W, long N)
+{
+    return std::string(W.Funcs) + "FUNC main()\n{\n    VAR i, t\n    WHILE " + std::to_string(N) +
+           " - i DO { t := t + " + W.Expr + " i := i + 1 } DONE\n    PRINT t, \"\\n\"\n}\n";
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned OptLevel = 2;
+    long N = 20000000;
+    std::string File = "pgobench.vslprof";
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        if(!strcmp(argv[i], "-O"))
+            OptLevel = atoi(argv[i + 1]);
+        else if(!strcmp(argv[i], "-n"))
+            N = atol(argv[i + 1]);
+        else if(!strcmp(argv[i], "-f"))
+            File = argv[i + 1];
+    }
+
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetAsmParser();
+
+    printf("-O%u, %ld iterations\n%-6s %14s %14s %14s\n", OptLevel, N, "prog", "generate ms",
+           "plain ms", "profile ms");
+    for(const Workload &W : Workloads)
+    {
+        std::string Src = genSource(W, N);
+        CompilerOptions Opts;
+        Opts.OptLevel = OptLevel;
+        Opts.ProfileFile = File;
+
+        Opts.ProfileGenerate = true;
+        double GenMs = runOnce(Src, Opts);
+        Opts.ProfileGenerate = false;
+        double PlainMs = runOnce(Src, Opts);
+        Opts.ProfileUse = true;
+        double UseMs = runOnce(Src, Opts);
+        printf("%-6s %14.1f %14.1f %14.1f\n", W.Name, GenMs, PlainMs, UseMs);
+    }
+    remove(File.c_str());
+    return 0;
+}
@@ -0,0 +1,48 @@
+//PRINT 的基准测试:运行每次循环输出一行的程序,与原来的代码生成方式
+//(每条 PRINT 一次变参 printf,格式串中为 " %d ")在宿主中的同样循环比较。
+//标准输出重定向到 /dev/null,结果输出到标准错误
+//用法: printbench [-n 行数] [-O 优化级别]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "../CompilerInstance.h"
+#include "BenchUtil.h"
+
+int main(int argc, char *argv[])
+{
+    long N = 5000000;
+    unsigned OptLevel = 2;
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        if(!strcmp(argv[i], "-n"))
+            N = atol(argv[i + 1]);
+        else if(!strcmp(argv[i], "-O"))
+            OptLevel = atoi(argv[i + 1]);
+    }
+    if(!freopen("/dev/null", "w", stdout))
+        return 1;
+
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetAsmParser();
+
+    //原来的方式:每行一次 printf
+    auto T = Clock::now();
+    for(long i = 0; i < N; i++)
+        printf("i = %d sq = %d \n", (int)i, (int)(i * i));
+    fflush(stdout);
+    double PrintfMs = msSince(T);
+
+    std::string Src = "FUNC main()\n{\n    VAR i\n    WHILE " + std::to_string(N) +
+                      " - i DO { PRINT \"i =\", i, \"sq =\", i * i, \"\\n\" i := i + 1 } DONE\n}\n";
+    CompilerOptions Opts;
+    Opts.OptLevel = OptLevel;
+    double RunMs = runOnce(Src, Opts);
+
+    fprintf(stderr, "%ld lines, -O%u\n", N, OptLevel);
+    fprintf(stderr, "printf per line:   %10.1f ms (%.1f ns/line)\n", PrintfMs, PrintfMs * 1e6 / N);
+    fprintf(stderr, "VSL buffered PRINT: %9.1f ms (%.1f ns/line, includes JIT)\n", RunMs, RunMs * 1e6 / N);
+    return 0;
+}
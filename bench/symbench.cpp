@@ -0,0 +1,159 @@
+//变量表基准测试:生成局部变量很多、块嵌套的函数,测量代码生成时间,
+//并与原来以 std::map 为变量表的查找方式比较同样的绑定/查找序列
+//用法: symbench [-n 函数个数] [-v 每个函数的变量数] [-r 重复次数]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "../CompilerInstance.h"
+#include "BenchUtil.h"
+
+//每个函数外层声明 Vars 个变量,再在若干嵌套块中重新声明其中一部分
+static std::string genSource(int Funcs, int Vars)
+{
+    std::string Src;
+    for(int f = 0; f < Funcs; f++)
+    {
+        Src += "FUNC f" + std::to_string(f) + "(a)\n{\n    VAR ";
+        for(int v = 0; v < Vars; v++)
+            Src += (v ? ", v" : "v") + std::to_string(v);
+        Src += "\n";
+        for(int v = 0; v < Vars; v++)
+            Src += "    v" + std::to_string(v) + " := a + v" + std::to_string((v * 7) % Vars) + "\n";
+        for(int b = 0; b < 8; b++)
+        {
+            Src += "    {\n        VAR ";
+            for(int v = b; v < Vars; v += 8)
+                Src += (v != b ? ", v" : "v") + std::to_string(v);
+            Src += "\n";
+            for(int v = b; v < Vars; v += 8)
+                Src += "        v" + std::to_string(v) + " := v" + std::to_string((v + 1) % Vars) + " * 2\n";
+            Src += "    }\n";
+        }
+        Src += "    RETURN v0\n}\n\n";
+    }
+    return Src;
+}
+
+//按代码生成时的顺序记录的变量表操作
+struct Op {
+    enum { Function, Push, Pop, Bind, Lookup } Kind;
+    unsigned Sym;
+};
+
+static void recordOps(StatAST *S, std::vector<Op> &Ops)
+{
+    switch(S->getKind())
+    {
+    case StatAST::SK_Variable:
+        Ops.push_back({ Op::Lookup, cast<VariableExprAST>(S)->getSym() });
+        break;
+    case StatAST::SK_Binary:
+        recordOps(cast<BinaryExprAST>(S)->getLHS(), Ops);
+        recordOps(cast<BinaryExprAST>(S)->getRHS(), Ops);
+        break;
+    case StatAST::SK_Assign:
+        recordOps(cast<AssStatAST>(S)->getExpr(), Ops);
+        Ops.push_back({ Op::Lookup, cast<AssStatAST>(S)->getName()->getSym() });
+        break;
+    case StatAST::SK_Ret:
+        recordOps(cast<RetStatAST>(S)->getVal(), Ops);
+        break;
+    case StatAST::SK_Block: {
+        auto *B = cast<BlockStatAST>(S);
+        Ops.push_back({ Op::Push, 0 });
+        for(DecAST *D : B->getDecList())
+            for(unsigned Sym : D->getVarNames())
+                Ops.push_back({ Op::Bind, Sym });
+        for(StatAST *C : B->getStatList())
+            recordOps(C, Ops);
+        Ops.push_back({ Op::Pop, 0 });
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int Funcs = 200, Vars = 2000, Reps = 5;
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        if(!strcmp(argv[i], "-n"))
+            Funcs = atoi(argv[i + 1]);
+        else if(!strcmp(argv[i], "-v"))
+            Vars = atoi(argv[i + 1]);
+        else if(!strcmp(argv[i], "-r"))
+            Reps = atoi(argv[i + 1]);
+    }
+
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetAsmParser();
+
+    std::string Src = genSource(Funcs, Vars);
+    printf("input: %.1f MB, %d functions, %d locals each\n",
+           Src.size() / (1024.0 * 1024), Funcs, Vars);
+
+    CompilerOptions Opts;
+    Opts.Simplify = false;
+    CompilerInstance CI(Opts);
+    CI.setSource(Src);
+    CI.parse();
+    auto T = Clock::now();
+    CI.codegen();
+    printf("codegen (-O0): %.1f ms\n", msSince(T));
+
+    std::vector<Op> Ops;
+    for(FunctionAST *F : CI.Functions)
+    {
+        Ops.push_back({ Op::Function, 0 });
+        for(unsigned Sym : F->getProto()->getArgs())
+            Ops.push_back({ Op::Bind, Sym });
+        recordOps(F->getBody(), Ops);
+    }
+
+    //变量的值只用来区分,用假的指针代替 AllocaInst,变量表中用编号 1
+    AllocaInst *Dummy = reinterpret_cast<AllocaInst *>(uintptr_t(16));
+    double MapMs = 1e100, TableMs = 1e100;
+    size_t MapHits = 0, TableHits = 0;
+    for(int r = 0; r < Reps; r++)
+    {
+        //原来的方式:一个 std::map,进入函数时清空,块结束时不恢复
+        T = Clock::now();
+        std::map<unsigned, AllocaInst *> Map;
+        MapHits = 0;
+        for(const Op &O : Ops)
+        {
+            if(O.Kind == Op::Bind)
+                Map[O.Sym] = Dummy;
+            else if(O.Kind == Op::Lookup)
+                MapHits += Map[O.Sym] != nullptr;
+            else if(O.Kind == Op::Function)
+                Map.clear();
+        }
+        MapMs = std::min(MapMs, msSince(T));
+
+        T = Clock::now();
+        ScopedSymbolTable Table;
+        TableHits = 0;
+        for(const Op &O : Ops)
+        {
+            switch(O.Kind)
+            {
+            case Op::Function: Table.clear(); break;
+            case Op::Push: Table.pushScope(); break;
+            case Op::Pop: Table.popScope(); break;
+            case Op::Bind: Table.bind(O.Sym, 1); break;
+            case Op::Lookup: TableHits += Table.lookup(O.Sym) != 0; break;
+            }
+        }
+        TableMs = std::min(TableMs, msSince(T));
+    }
+    printf("%zu symbol table operations: std::map %.2f ms, scoped table %.2f ms (%.1fx)\n",
+           Ops.size(), MapMs, TableMs, MapMs / TableMs);
+    printf("lookups found: %zu / %zu\n", MapHits, TableHits);
+    return MapHits == TableHits ? 0 : 1;
+}
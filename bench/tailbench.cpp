@@ -0,0 +1,121 @@
+//尾递归变换的基准测试:对不同的递归深度,分别在关闭(-no-tailrec)和打开尾递归变换时
+//编译并运行递归函数,输出运行时间和递归调用占用的栈帧数。
+//每次运行在单独的子进程中进行,栈溢出时只记录结果
+//用法: tailbench [-O 优化级别] [-d 最大深度]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../CompilerInstance.h"
+#include "BenchUtil.h"
+
+struct Workload {
+    const char *Name;
+    const char *Func;
+};
+
+//与 tests/t_final.VSL 同样形状的递归函数
+static const Workload Workloads[] = {
+    { "sum",   "FUNC r(n)\n{\n    IF n THEN RETURN n + r(n - 1) ELSE RETURN 0 FI\n}\n" },
+    { "fact",  "FUNC r(n)\n{\n    IF n THEN RETURN n * r(n - 1) ELSE RETURN 1 FI\n}\n" },
+    { "count", "FUNC r(n)\n{\n    IF n THEN RETURN r(n - 1) ELSE RETURN 7 FI\n}\n" },
+};
+
+static std::string genSource(const Workload &W, long Depth)
+{
+    return std::string(W.Func) + "FUNC main()\n{\n    PRINT r(" + std::to_string(Depth) +
+           "), \"\\n\"\n}\n";
+}
+
+//函数 r 中剩下的对自身的调用个数,为 0 时整个递归只占一个栈帧
+static size_t countSelfCalls(CompilerInstance &CI)
+{
+    Function *R = CI.CG.TheModule->getFunction("r");
+    size_t N = 0;
+    if(R)
+        for(BasicBlock &BB : *R)
+            for(Instruction &I : BB)
+                if(auto *C = dyn_cast<CallInst>(&I))
+                    N += C->getCalledFunction() == R;
+    return N;
+}
+
+struct Result {
+    double RunMs;
+    size_t SelfCalls;
+};
+
+//在子进程中编译并运行,返回 false 表示子进程异常退出(栈溢出)
+static bool runChild(const std::string &Src, unsigned OptLevel, bool TailRec, Result &Res)
+{
+    int Fds[2];
+    if(pipe(Fds))
+        return false;
+    fflush(stdout);
+    pid_t Pid = fork();
+    if(Pid == 0)
+    {
+        close(Fds[0]);
+        if(!freopen("/dev/null", "w", stdout))
+            _exit(1);
+        CompilerOptions Opts;
+        Opts.OptLevel = OptLevel;
+        Opts.TailRec = TailRec;
+        Result R;
+        R.RunMs = runOnce(Src, Opts, [&](CompilerInstance &CI) { R.SelfCalls = countSelfCalls(CI); });
+        if(write(Fds[1], &R, sizeof(R)) != sizeof(R))
+            _exit(1);
+        _exit(0);
+    }
+    close(Fds[1]);
+    bool Ok = read(Fds[0], &Res, sizeof(Res)) == sizeof(Res);
+    close(Fds[0]);
+    int Status;
+    waitpid(Pid, &Status, 0);
+    return Ok && WIFEXITED(Status) && WEXITSTATUS(Status) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned OptLevel = 0;
+    long MaxDepth = 10000000;
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        if(!strcmp(argv[i], "-O"))
+            OptLevel = atoi(argv[i + 1]);
+        else if(!strcmp(argv[i], "-d"))
+            MaxDepth = atol(argv[i + 1]);
+    }
+
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetAsmParser();
+
+    printf("-O%u\n%-6s %10s  %-28s %-28s\n", OptLevel, "func", "depth", "-no-tailrec", "tailrec");
+    for(const Workload &W : Workloads)
+    {
+        for(long Depth = 1000; Depth <= MaxDepth; Depth *= 10)
+        {
+            std::string Src = genSource(W, Depth);
+            printf("%-6s %10ld", W.Name, Depth);
+            for(bool TailRec : { false, true })
+            {
+                Result R;
+                if(!runChild(Src, OptLevel, TailRec, R))
+                    printf("  %-28s", "stack overflow");
+                else
+                {
+                    char Buf[64];
+                    snprintf(Buf, sizeof(Buf), "%9.2f ms, %ld frames", R.RunMs,
+                             R.SelfCalls ? Depth + 1 : 1);
+                    printf("  %-28s", Buf);
+                }
+            }
+            printf("\n");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+//分层执行的基准测试:运行时间很短和很长的程序,分别在 -O0、-O2 和 -tier(-O0 起步,热的函数升级到 -O2)下
+//计时从语法分析开始到程序结束,包括生成代码、生成机器码和后台线程的优化
+//用法: tierbench [-n 长程序的外层循环次数] [-t 升级阈值]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "../CompilerInstance.h"
+#include "BenchUtil.h"
+
+struct Workload {
+    const char *Name;
+    const char *Funcs;	//main 之前的函数
+    const char *Main;	//main 的函数体,# 替换为循环次数
+};
+
+//几个函数,各自只做很少的工作
+static const char *const ShortFuncs =
+    "FUNC gcd(a, b)\n{\n    WHILE b DO { VAR t t := a - a / b * b a := b b := t } DONE\n    RETURN a\n}\n"
+    "FUNC sq(x)\n{\n    RETURN x * x\n}\n"
+    "FUNC pick(x, y)\n{\n    IF x - y THEN RETURN gcd(x, y) ELSE RETURN sq(x) FI\n}\n";
+
+static const char *const LongFuncs =
+    "FUNC mix(n)\n{\n    VAR s, i\n    WHILE n - i DO { s := s + i * i - s / 3 i := i + 1 } DONE\n    RETURN s\n}\n"
+    "FUNC fib(n)\n{\n    IF n - 1 THEN IF n THEN RETURN fib(n - 1) + fib(n - 2) ELSE RETURN 0 FI ELSE RETURN 1 FI\n}\n";
+
+static const Workload Workloads[] = {
+    { "short", ShortFuncs, "    PRINT pick(84, 36), pick(7, 7), \"\\n\"\n" },
+    { "long", LongFuncs,
+      "    VAR k, t\n    WHILE # - k DO { t := t + mix(k + 20000) + fib(k - k / 16 * 16 + 12) k := k + 1 } DONE\n"
+      "    PRINT t, \"\\n\"\n" },
+};
+
+struct Config {
+    const char *Name;
+    unsigned OptLevel;
+    bool Tier;
+};
+
+static const Config Configs[] = {
+    { "-O0", 0, false },
+    { "-O2", 2, false },
+    { "-tier", 2, true },
+};
+
+int main(int argc, char *argv[])
+{
+    long N = 5000;
+    unsigned Threshold = 10000;
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        if(!strcmp(argv[i], "-n"))
+            N = atol(argv[i + 1]);
+        else if(!strcmp(argv[i], "-t"))
+            Threshold = atoi(argv[i + 1]);
+    }
+
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetAsmParser();
+
+    printf("long: %ld iterations, tier threshold %u\n%-6s %-6s %12s %12s %12s %8s\n", N, Threshold, "prog",
+           "mode", "total ms", "jit ms", "run ms", "tiered");
+    for(const Workload &W : Workloads)
+    {
+        std::string Main = W.Main;
+        for(size_t Pos; (Pos = Main.find('#')) != std::string::npos;)
+            Main.replace(Pos, 1, std::to_string(N));
+        std::string Src = std::string(W.Funcs) + "FUNC main()\n{\n" + Main + "}\n";
+        for(const Config &C : Configs)
+        {
+            CompilerOptions Opts;
+            Opts.OptLevel = C.OptLevel;
+            Opts.TierThreshold = C.Tier ? Threshold : 0;
+            double JitMs = 0, RunMs = 0;
+            size_t Tiered = 0;
+            auto T0 = Clock::now();
+            runOnce(Src, Opts, nullptr, [&](CompilerInstance &CI) {
+                JitMs = CI.JitMs;
+                RunMs = CI.RunMs;
+                if(CI.Tier)
+                    for(auto &R : CI.Tier->getRecords())
+                        Tiered += R.InstalledMs >= 0;
+            });
+            double TotalMs = msSince(T0);
+            printf("%-6s %-6s %12.1f %12.1f %12.1f %8zu\n", W.Name, C.Name, TotalMs, JitMs, RunMs,
+                   Tiered);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,110 @@
+//字节码虚拟机的基准测试:比较 JIT(CompilerInstance::run)和 VM.h 的解释器。
+//启动时间为小脚本从开始到输出写出的时间:JIT 从分析源程序开始,
+//VM 从装入已生成的映像开始(vslvm 运行 .vslbc 文件时只有这一步,也不需要初始化 LLVM);
+//JIT 的第一次运行含 LLVM 各个单例的初始化,单独列出。
+//稳定状态为一个长循环的运行时间。
+//标准输出重定向到 /dev/null,结果输出到标准错误
+//用法: vmbench [-n 循环次数] [-r 启动测试的重复次数] [-O JIT 的优化级别]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "../CompilerInstance.h"
+#include "../VM.h"
+#include "BenchUtil.h"
+
+//JIT:分析、生成代码和机器码、运行 main,返回总时间,RunMs 为 main 的运行时间
+static double runJIT(const std::string &Src, unsigned OptLevel, double &RunMs)
+{
+    auto T0 = Clock::now();
+    CompilerOptions Opts;
+    Opts.OptLevel = OptLevel;
+    runOnce(Src, Opts, nullptr, [&](CompilerInstance &CI) { RunMs = CI.RunMs; });
+    return msBetween(T0, Clock::now());
+}
+
+//生成字节码映像,放在 4 字节对齐的缓冲区中
+static std::vector<uint32_t> compileBytecode(const std::string &Src, BytecodeStats &Stats)
+{
+    CompilerOptions Opts;
+    CompilerInstance CI(Opts);
+    CI.setSource(Src);
+    CI.parse();
+    BytecodeCompiler BC(CI.Symbols);
+    if(!BC.compile(CI.Functions))
+        return std::vector<uint32_t>();
+    std::string Image = BC.getImage();
+    Stats = BC.Stats;
+    Stats.ImageBytes = Image.size();
+    std::vector<uint32_t> Words((Image.size() + 3) / 4);
+    memcpy(Words.data(), Image.data(), Image.size());
+    return Words;
+}
+
+//VM:装入映像并运行 main
+static double runVM(const std::vector<uint32_t> &Image)
+{
+    auto T0 = Clock::now();
+    VSLVM VM;
+    if(VM.load((const char *)Image.data(), Image.size() * 4))
+        VM.run();
+    vsl_flush();
+    return msBetween(T0, Clock::now());
+}
+
+int main(int argc, char *argv[])
+{
+    long N = 50000000;
+    int Reps = 20;
+    unsigned OptLevel = 2;
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        if(!strcmp(argv[i], "-n"))
+            N = atol(argv[i + 1]);
+        else if(!strcmp(argv[i], "-r"))
+            Reps = atoi(argv[i + 1]);
+        else if(!strcmp(argv[i], "-O"))
+            OptLevel = atoi(argv[i + 1]);
+    }
+    if(!freopen("/dev/null", "w", stdout))
+        return 1;
+
+    //典型的小脚本:几个函数,少量计算后输出
+    std::string Script =
+        "FUNC gcd(a, b)\n{\n    WHILE b DO { VAR t t := a - a / b * b a := b b := t } DONE\n    RETURN a\n}\n"
+        "FUNC sum(n)\n{\n    VAR s, i, a[16]\n    WHILE n - i DO { a[i] := i * i s := s + a[i] i := i + 1 } DONE\n"
+        "    RETURN s\n}\n"
+        "FUNC main()\n{\n    PRINT \"gcd \", gcd(84, 36), \" sum \", sum(16), \"\\n\"\n}\n";
+    std::string Loop = "FUNC main()\n{\n    VAR i, s\n    WHILE " + std::to_string(N) +
+                       " - i DO { s := s + i * i - s / 3 i := i + 1 } DONE\n    PRINT s, \"\\n\"\n}\n";
+
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetAsmParser();
+
+    BytecodeStats ScriptStats, LoopStats;
+    std::vector<uint32_t> ScriptImage = compileBytecode(Script, ScriptStats);
+    std::vector<uint32_t> LoopImage = compileBytecode(Loop, LoopStats);
+    if(ScriptImage.empty() || LoopImage.empty())
+        return 1;
+
+    fprintf(stderr, "script: %zu instructions, %zu bytes of bytecode; loop: %ld iterations, JIT at -O%u\n",
+            ScriptStats.Instructions, ScriptStats.ImageBytes, N, OptLevel);
+    fprintf(stderr, "%-10s %16s %18s %14s\n", "engine", "first run ms", "startup ms (avg)", "loop ns/iter");
+
+    double RunMs, StartMs = 0;
+    double FirstMs = runJIT(Script, OptLevel, RunMs);
+    for(int i = 0; i < Reps; i++)
+        StartMs += runJIT(Script, OptLevel, RunMs);
+    runJIT(Loop, OptLevel, RunMs);
+    fprintf(stderr, "%-10s %16.3f %18.3f %14.3f\n", "JIT", FirstMs, StartMs / Reps, RunMs * 1e6 / N);
+
+    StartMs = 0;
+    FirstMs = runVM(ScriptImage);
+    for(int i = 0; i < Reps; i++)
+        StartMs += runVM(ScriptImage);
+    RunMs = runVM(LoopImage);
+    fprintf(stderr, "%-10s %16.3f %18.3f %14.3f\n", "VM", FirstMs, StartMs / Reps, RunMs * 1e6 / N);
+    return 0;
+}
@@ -2,25 +2,35 @@
 #include <cstdlib>
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Target/TargetMachine.h"
-#ifdef linux    //linux
-#include "KaleidoscopeJIT.h"
-#else  //windows
-#include "../include/KaleidoscopeJIT.h"
-#endif
+#include "CompilerInstance.h"
 
-static int emitIR = 0;
-static int emitObj = 0; //如果添加了-obj选项，则只生成.o文件，不运行代码
+static CompilerOptions Opts;
 static char *inputFileName;
-#include "Lexer.h"
-#include "AST.h"
-#include "Parser.h"
 
 void usage()
 {
-    printf("usage: VSL inputFile [-r] [-h] [-obj]\n");
+    printf("usage: VSL inputFile [-r] [-h] [-obj] [-bc] [-j[N]] [-O[N]] [-no-simplify] [-no-tailrec] [-no-specialize] [-loop-unroll[=N]] [-loop-vectorize[=N]] [-ssa] [-memoize[=N]] [-fprofile-generate[=file]] [-fprofile-use[=file]] [-lazy] [-tier[=N]] [-cache[=dir]] [-cache-size=N] [-stats] [-flat]\n");
     printf("-r: emit IR code to IRcode.ll file\n");
     printf("-h: show help information\n");
     printf("-obj: emit obj file of the input file\n");
+    printf("-bc: emit bytecode file output.vslbc for vslvm instead of using LLVM\n");
+    printf("-j[N]: parse and generate code with N threads (default: all cores)\n");
+    printf("-O[N]: optimization level 0-3 (default: -O0, -O means -O1)\n");
+    printf("-no-simplify: do not fold constants or drop dead code before codegen\n");
+    printf("-no-tailrec: keep self-calls in RETURN as real calls\n");
+    printf("-no-specialize: do not clone functions for calls with constant arguments\n");
+    printf("-loop-unroll[=N]: unroll WHILE loops (N times; 0 disables)\n");
+    printf("-loop-vectorize[=N]: vectorize WHILE loops (width N; 0 disables)\n");
+    printf("-ssa: build SSA form directly instead of allocas\n");
+    printf("-memoize[=N]: cache results of pure recursive functions (N entries each, default 4096)\n");
+    printf("-fprofile-generate[=file]: count branches and calls, write the profile when main returns (default: default.vslprof)\n");
+    printf("-fprofile-use[=file]: optimize with branch weights and entry counts from a profile\n");
+    printf("-lazy: compile each function to machine code when it is first called\n");
+    printf("-tier[=N]: start at -O0, recompile functions called or looping N times (default 10000) at the -O level on a background thread\n");
+    printf("-cache[=dir]: cache the compiled object on disk and reuse it when the source and options are unchanged (default: ~/.cache/vsl)\n");
+    printf("-cache-size=N: evict least recently used cached objects beyond N MB (default 64)\n");
+    printf("-stats: print compilation statistics to stderr\n");
+    printf("-flat: generate code from the flat (index-based) AST\n");
 
     exit(EXIT_FAILURE);
 }
@@ -31,16 +41,102 @@ void getArgs(int argc, char *argv[])
     {
         if(argv[i][0] == '-' && argv[i][1] == 'r')
         {
-            emitIR = 1;
+            Opts.EmitIR = true;
+        }else if (argv[i][0] == '-' && argv[i][1] == 'j')
+        {
+            Opts.NumThreads = argv[i][2] ? atoi(argv[i] + 2)
+                                         : std::thread::hardware_concurrency();
+            if (Opts.NumThreads == 0)
+                Opts.NumThreads = 1;
+        }else if (argv[i][0] == '-' && argv[i][1] == 'O')
+        {
+            Opts.OptLevel = argv[i][2] ? atoi(argv[i] + 2) : 1;
+            if (Opts.OptLevel > 3)
+                usage();
         }else if (argv[i][0] == '-' && argv[i][1] == 'h')
         {
             usage();
         }
+        else if (!strcmp(argv[i], "-stats"))
+        {
+            Opts.PrintStats = true;
+        }
+        else if (!strcmp(argv[i], "-no-simplify"))
+        {
+            Opts.Simplify = false;
+        }
+        else if (!strcmp(argv[i], "-no-tailrec"))
+        {
+            Opts.TailRec = false;
+        }
+        else if (!strcmp(argv[i], "-no-specialize"))
+        {
+            Opts.Specialize = false;
+        }
+        else if (!strncmp(argv[i], "-loop-unroll", 12))
+        {
+            Opts.LoopUnroll = argv[i][12] == '=' ? atoi(argv[i] + 13) : 1;
+        }
+        else if (!strncmp(argv[i], "-loop-vectorize", 15))
+        {
+            Opts.LoopVectorize = argv[i][15] == '=' ? atoi(argv[i] + 16) : 1;
+        }
+        else if (!strcmp(argv[i], "-ssa"))
+        {
+            Opts.SSA = true;
+        }
+        else if (!strncmp(argv[i], "-memoize", 8))
+        {
+            Opts.Memoize = true;
+            if (argv[i][8] == '=')
+                Opts.MemoCacheSize = atoi(argv[i] + 9);
+        }
+        else if (!strncmp(argv[i], "-fprofile-generate", 18))
+        {
+            Opts.ProfileGenerate = true;
+            if (argv[i][18] == '=')
+                Opts.ProfileFile = argv[i] + 19;
+        }
+        else if (!strncmp(argv[i], "-fprofile-use", 13))
+        {
+            Opts.ProfileUse = true;
+            if (argv[i][13] == '=')
+                Opts.ProfileFile = argv[i] + 14;
+        }
+        else if (!strcmp(argv[i], "-lazy"))
+        {
+            Opts.LazyJIT = true;
+        }
+        else if (!strncmp(argv[i], "-tier", 5))
+        {
+            int N = argv[i][5] == '=' ? atoi(argv[i] + 6) : 10000;
+            if (N < 1)
+                usage();
+            Opts.TierThreshold = N;
+        }
+        else if (!strcmp(argv[i], "-bc"))
+        {
+            Opts.EmitBytecode = true;
+        }
+        else if (!strncmp(argv[i], "-cache-size=", 12))
+        {
+            Opts.CacheSizeMB = atoi(argv[i] + 12);
+        }
+        else if (!strncmp(argv[i], "-cache", 6))
+        {
+            Opts.UseCache = true;
+            if (argv[i][6] == '=')
+                Opts.CacheDir = argv[i] + 7;
+        }
+        else if (!strcmp(argv[i], "-flat"))
+        {
+            Opts.UseFlatAST = true;
+        }
         else if (argv[i][0] == '-' && argv[i][1] == 'o')
         {
             if (strlen(argv[i]) > 3 && 
                 (argv[i][2] == 'b' && argv[i][3] == 'j'))
-                emitObj = 1;
+                Opts.EmitObj = true;
             else
                 usage();
         }else
@@ -54,29 +150,12 @@ int main(int argc, char *argv[]) {
     if(argc < 2)
         usage();
     getArgs(argc, argv);
-    inputFile = fopen(inputFileName, "r");
-    if(!inputFile){
-        printf("%s open error!\n", argv[0]);
-        exit(EXIT_FAILURE);
-    }
 
     InitializeNativeTarget();
     InitializeNativeTargetAsmPrinter();
     InitializeNativeTargetAsmParser();
 
-    BinopPrecedence['+'] = 10;
-    BinopPrecedence['-'] = 10;
-    BinopPrecedence['*'] = 40;
-    BinopPrecedence['/'] = 40;
-
-    TheJIT = llvm::make_unique<KaleidoscopeJIT>();
-    InitializeModuleAndPassManager();
-
-    // Run the main "interpreter loop" now.
-    getNextToken();
-    MainLoop();
-
-    if(emitObj)
+    if(Opts.EmitObj)
     {
         // Initialize the target registry etc.
         InitializeAllTargetInfos();
@@ -84,56 +163,13 @@ int main(int argc, char *argv[]) {
         InitializeAllTargetMCs();
         InitializeAllAsmParsers();
         InitializeAllAsmPrinters();
+    }
 
-        auto TargetTriple = sys::getDefaultTargetTriple();
-        TheModule->setTargetTriple(TargetTriple);
-
-        std::string Error;
-        auto Target = TargetRegistry::lookupTarget(TargetTriple, Error);
-
-        // Print an error and exit if we couldn't find the requested target.
-        // This generally occurs if we've forgotten to initialise the
-        // TargetRegistry or we have a bogus target triple.
-        if (!Target)
-        {
-            errs() << Error;
-            return 1;
-        }
-
-        auto CPU = "generic";
-        auto Features = "";
-
-        TargetOptions opt;
-        auto RM = Optional<Reloc::Model>();
-        auto TheTargetMachine =
-            Target->createTargetMachine(TargetTriple, CPU, Features, opt, RM);
-
-        TheModule->setDataLayout(TheTargetMachine->createDataLayout());
-
-        auto Filename = "output.o";
-        std::error_code EC;
-        raw_fd_ostream dest(Filename, EC, sys::fs::F_None);
-
-        if (EC)
-        {
-            errs() << "Could not open file: " << EC.message();
-            return 1;
-        }
-
-        legacy::PassManager pass;
-        auto FileType = TargetMachine::CGFT_ObjectFile;
-
-        if (TheTargetMachine->addPassesToEmitFile(pass, dest, FileType))
-        {
-            errs() << "TheTargetMachine can't emit a file of this type";
-            return 1;
-        }
-
-        pass.run(*TheModule);
-        dest.flush();
-
-        outs() << "Wrote " << Filename << "\n";
+    CompilerInstance CI(Opts);
+    if(!inputFileName || !CI.openSource(inputFileName)){
+        printf("%s open error!\n", argv[0]);
+        exit(EXIT_FAILURE);
     }
 
-    return 0;
+    return CI.compile();
 }
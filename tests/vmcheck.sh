@@ -0,0 +1,25 @@
+#!/bin/sh
+#字节码与 JIT 的对比测试:tests 中每个有 main 的程序分别用 JIT 运行和用 -bc 编译后由 vslvm 运行,
+#两者的输出应当完全相同。需要先 make all vm(make vmcheck 会先生成它们)
+#用法: tests/vmcheck.sh [VSL] [vslvm] [VSL 的其他选项...]  (路径相对于仓库的根目录)
+cd "$(dirname "$0")/.." || exit 1
+Root=$(pwd)
+VSL=$Root/${1:-bin/Debug/VSL}
+VM=$Root/${2:-bin/vslvm}
+if [ $# -ge 2 ]; then shift 2; else shift $#; fi
+Tmp=$(mktemp -d) || exit 1
+Failed=0
+for T in tests/t_*.VSL; do
+	grep -q "FUNC main" "$T" || continue
+	(cd "$Tmp" && "$VSL" "$Root/$T" "$@" > jit.out 2>&1)
+	(cd "$Tmp" && "$VSL" "$Root/$T" -bc "$@" > /dev/null 2>&1 && "$VM" output.vslbc > vm.out 2>&1)
+	if cmp -s "$Tmp/jit.out" "$Tmp/vm.out"; then
+		echo "$T: ok"
+	else
+		echo "$T: FAILED"
+		diff "$Tmp/jit.out" "$Tmp/vm.out"
+		Failed=1
+	fi
+done
+rm -r -f "$Tmp"
+exit $Failed
@@ -0,0 +1,8 @@
+//VSL 运行时库的独立版本:make runtime 生成 bin/libvslrt.a,
+//与 -obj 生成的目标文件一起链接,提供 PRINT 使用的 vsl_print_str/vsl_print_int
+#include "VSLRuntime.h"
+
+//头文件中的函数是 inline 的,没有用到时不生成代码;在这里取它们的地址,
+//使 libvslrt.a 中有外部可见的定义
+extern void *const VSLRuntimeFuncs[];
+void *const VSLRuntimeFuncs[] = { (void *)&vsl_flush, (void *)&vsl_print_str, (void *)&vsl_print_int };
@@ -0,0 +1,101 @@
+//字节码解释器的独立程序:make vm 生成 bin/vslvm,运行 VSL -bc 生成的 .vslbc 文件。
+//不链接 LLVM,也不做任何目标初始化:映像直接 mmap 到内存中解释执行
+//用法: vslvm [-t] file.vslbc   (-t: 在 stderr 输出装入和运行的时间)
+#include "VM.h"
+#include <chrono>
+#if defined(linux) || defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define VSLVM_MMAP 1
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+//映像的内容,mmap 的页面总是对齐的;不能 mmap 时读入 4 字节对齐的缓冲区
+struct Image {
+	const char *Data = nullptr;
+	size_t Size = 0;
+	bool Mapped = false;
+	std::vector<uint32_t> Buffer;
+
+	bool open(const char *FileName) {
+#ifdef VSLVM_MMAP
+		int FD = ::open(FileName, O_RDONLY);
+		if (FD < 0)
+			return false;
+		struct stat St;
+		if (fstat(FD, &St) == 0 && St.st_size > 0) {
+			void *P = mmap(nullptr, St.st_size, PROT_READ, MAP_PRIVATE, FD, 0);
+			if (P != MAP_FAILED) {
+				Data = (const char *)P;
+				Size = St.st_size;
+				Mapped = true;
+			}
+		}
+		close(FD);
+		if (Mapped)
+			return true;
+#endif
+		FILE *F = fopen(FileName, "rb");
+		if (!F)
+			return false;
+		fseek(F, 0, SEEK_END);
+		long Len = ftell(F);
+		fseek(F, 0, SEEK_SET);
+		if (Len < 0) {
+			fclose(F);
+			return false;
+		}
+		Buffer.resize((Len + 3) / 4);
+		Size = fread(Buffer.data(), 1, Len, F);
+		fclose(F);
+		Data = (const char *)Buffer.data();
+		return Size == (size_t)Len;
+	}
+
+	~Image() {
+#ifdef VSLVM_MMAP
+		if (Mapped)
+			munmap((void *)Data, Size);
+#endif
+	}
+};
+
+int main(int argc, char *argv[])
+{
+	auto T0 = Clock::now();
+	const char *FileName = nullptr;
+	bool Timing = false;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-t"))
+			Timing = true;
+		else
+			FileName = argv[i];
+	}
+	if (!FileName) {
+		printf("usage: vslvm [-t] file.vslbc\n");
+		return EXIT_FAILURE;
+	}
+
+	Image Img;
+	if (!Img.open(FileName)) {
+		fprintf(stderr, "%s: cannot open %s\n", argv[0], FileName);
+		return EXIT_FAILURE;
+	}
+	VSLVM VM;
+	if (!VM.load(Img.Data, Img.Size)) {
+		fprintf(stderr, "%s: %s is not a VSL bytecode file\n", argv[0], FileName);
+		return EXIT_FAILURE;
+	}
+	auto T1 = Clock::now();
+	VM.run();
+	vsl_flush();
+	auto T2 = Clock::now();
+	if (Timing)
+		fprintf(stderr, "vslvm: load %.3f ms, run %.3f ms\n",
+			std::chrono::duration<double, std::milli>(T1 - T0).count(),
+			std::chrono::duration<double, std::milli>(T2 - T1).count());
+	return 0;
+}